@@ -0,0 +1,388 @@
+// Мікробенчмарки шляху керування на симуляторі моторів:
+//   - розбір команди з WebSocket (signaling_codec, JSON і MessagePack)
+//     і з data channel (control_frame_decode);
+//   - обчислення і запис стану виходів у drive_vehicle()/stop_vehicle(vehicle);
+//   - повний шлях повідомлення → виходи: синхронно, як on_ws_message і
+//     apply_command разом, і через чергу та потік керування.
+// Результат — JSON на stdout (або у файл --output). З --compare попередній
+// результат стає базовим: код виходу 1, якщо медіана гірша за допуск.
+#include "signaling_codec.h"
+#include "control_channel.h"
+#include "gpio_control.h"
+#include "motor_backend.h"
+#include "motor_thread.h"
+#include "config.h"
+#include "log.h"
+#include "bench/report.h"
+#include <json-glib/json-glib.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <time.h>
+#include <vector>
+
+#define BENCH_RUNS          7       // медіана з непарної кількості прогонів
+#define BENCH_ITERATIONS    200000
+#define BENCH_QUICK_DIVISOR 20      // --quick для CTest
+#define LATENCY_COMMANDS    200
+#define LATENCY_TICK_US     1000    // такт потоку керування під час заміру
+
+struct Result {
+    const char *name;
+    const char *unit;
+    guint iterations;
+    double median;
+    double min;
+    double max;
+};
+
+static std::vector<Result> results;
+static volatile gint64 sink;        // не дає компілятору викинути цикл
+static Vehicle *vehicle = nullptr;  // машина на симуляторі
+static const MotorBridge *bridge = nullptr;
+
+static gint64 now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (gint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void add_result(const char *name, const char *unit, guint iterations, std::vector<double> &samples) {
+    std::sort(samples.begin(), samples.end());
+    results.push_back({ name, unit, iterations, samples[samples.size() / 2], samples.front(), samples.back() });
+}
+
+// Один прогін для розігріву, далі BENCH_RUNS замірів; результат — нс на операцію
+template <typename Op>
+static void run(const char *name, guint iterations, Op op) {
+    for (guint i = 0; i < iterations; i++) op(i);
+
+    std::vector<double> samples;
+    for (int r = 0; r < BENCH_RUNS; r++) {
+        gint64 start = now_ns();
+        for (guint i = 0; i < iterations; i++) op(i);
+        samples.push_back((double)(now_ns() - start) / iterations);
+    }
+    add_result(name, "ns/op", iterations, samples);
+}
+
+static GBytes *encode_control(SignalingCodec codec, const char *direction, const char *turn, int speed) {
+    SignalingWriter w;
+    signaling_writer_begin(&w, codec);
+    signaling_writer_string(&w, "action", "control");
+    signaling_writer_string(&w, "device", "bench");
+    signaling_writer_string(&w, "peer", "viewer-1");
+    signaling_writer_string(&w, "direction", direction);
+    signaling_writer_string(&w, "turn", turn);
+    signaling_writer_int(&w, "speed", speed);
+    return signaling_writer_finish(&w);
+}
+
+static void encode_frame(guint8 *out, guint32 seq, int8_t direction, int8_t turn, uint8_t speed) {
+    memset(out, 0, CONTROL_FRAME_SIZE);
+    for (int i = 0; i < 4; i++) out[i] = (seq >> (8 * i)) & 0xff;
+    out[8] = CONTROL_FRAME_VERSION;
+    out[9] = CONTROL_FRAME_DRIVE;
+    out[10] = (guint8)direction;
+    out[11] = (guint8)turn;
+    out[12] = speed;
+}
+
+// Фіксована послідовність команд: кожна відрізняється від попередньої,
+// тож drive_vehicle щоразу записує і лінії, і заповнення
+struct Step {
+    const char *direction;
+    const char *turn;
+    int speed;
+};
+
+static const Step steps[] = {
+    { "forward", "none", 40 },
+    { "forward", "left", 60 },
+    { "backward", "right", 80 },
+    { "none", "left", 20 },
+};
+#define STEP_COUNT G_N_ELEMENTS(steps)
+
+// Вихід симулятора має відповідати останній команді
+static bool outputs_match(const Step &s) {
+    int dir = motor_direction_from_string(s.direction);
+    int turn = motor_turn_from_string(s.turn);
+    return motor_sim_pin(bridge, MOTOR_PIN_IN2_FWD) == (dir > 0) &&
+           motor_sim_pin(bridge, MOTOR_PIN_IN1_BACK) == (dir < 0) &&
+           motor_sim_pin(bridge, MOTOR_PIN_IN3_LEFT) == (turn < 0) &&
+           motor_sim_pin(bridge, MOTOR_PIN_IN4_RIGHT) == (turn > 0) &&
+           motor_sim_duty(bridge, MOTOR_PWM_A) == (dir ? s.speed : 0);
+}
+
+static bool bench_decode(guint iterations) {
+    GBytes *json = encode_control(SIGNALING_CODEC_JSON, "forward", "left", 65);
+    GBytes *msgpack = encode_control(SIGNALING_CODEC_MSGPACK, "forward", "left", 65);
+    gsize json_size, msgpack_size;
+    const guint8 *json_data = (const guint8*)g_bytes_get_data(json, &json_size);
+    const guint8 *msgpack_data = (const guint8*)g_bytes_get_data(msgpack, &msgpack_size);
+    guint8 frame[CONTROL_FRAME_SIZE];
+    encode_frame(frame, 1, 1, -1, 65);
+
+    SignalingMessage msg;
+    ControlFrame cf;
+    bool ok = signaling_decode(SIGNALING_CODEC_JSON, json_data, json_size, &msg) && msg.speed == 65 &&
+              signaling_decode(SIGNALING_CODEC_MSGPACK, msgpack_data, msgpack_size, &msg) && msg.speed == 65 &&
+              control_frame_decode(frame, sizeof(frame), &cf) && cf.speed == 65;
+    if (ok) {
+        run("ws_decode_json", iterations, [&](guint) {
+            signaling_decode(SIGNALING_CODEC_JSON, json_data, json_size, &msg);
+            sink = sink + msg.speed;
+        });
+        run("ws_decode_msgpack", iterations, [&](guint) {
+            signaling_decode(SIGNALING_CODEC_MSGPACK, msgpack_data, msgpack_size, &msg);
+            sink = sink + msg.speed;
+        });
+        run("dc_decode", iterations, [&](guint) {
+            control_frame_decode(frame, sizeof(frame), &cf);
+            sink = sink + cf.speed;
+        });
+    }
+    g_bytes_unref(json);
+    g_bytes_unref(msgpack);
+    return ok;
+}
+
+static bool bench_actuation(guint iterations) {
+    int dirs[STEP_COUNT], turns[STEP_COUNT];
+    for (gsize i = 0; i < STEP_COUNT; i++) {
+        dirs[i] = motor_direction_from_string(steps[i].direction);
+        turns[i] = motor_turn_from_string(steps[i].turn);
+    }
+
+    run("drive_vehicle_change", iterations, [&](guint i) {
+        gsize s = i % STEP_COUNT;
+        drive_vehicle(vehicle, dirs[s], turns[s], steps[s].speed);
+    });
+    if (!outputs_match(steps[(iterations - 1) % STEP_COUNT])) return false;
+
+    // Утримання клавіші: та сама команда не доходить до бекенда
+    run("drive_vehicle_repeat", iterations, [&](guint) {
+        drive_vehicle(vehicle, 1, 0, 50);
+    });
+    run("stop_vehicle_toggle", iterations, [&](guint i) {
+        if (i & 1) stop_vehicle(vehicle);
+        else drive_vehicle(vehicle, 1, 0, 50);
+    });
+    return motor_sim_pin(bridge, MOTOR_PIN_IN2_FWD) == 0 && motor_sim_duty(bridge, MOTOR_PWM_A) == 0;
+}
+
+// Повний шлях без черги: розбір, перетворення рядків, запис виходів
+static bool bench_ws_to_outputs(guint iterations) {
+    GBytes *frames[STEP_COUNT];
+    for (gsize i = 0; i < STEP_COUNT; i++) {
+        frames[i] = encode_control(SIGNALING_CODEC_JSON, steps[i].direction, steps[i].turn, steps[i].speed);
+    }
+
+    run("ws_to_outputs", iterations, [&](guint i) {
+        gsize size;
+        const guint8 *data = (const guint8*)g_bytes_get_data(frames[i % STEP_COUNT], &size);
+        SignalingMessage msg;
+        if (!signaling_decode(SIGNALING_CODEC_JSON, data, size, &msg) || msg.type != SIGNALING_CONTROL) return;
+        drive_vehicle(vehicle, motor_direction_from_string(msg.direction), motor_turn_from_string(msg.turn),
+                      msg.speed >= 0 ? MIN(msg.speed, 100) : 50);
+    });
+    bool ok = outputs_match(steps[(iterations - 1) % STEP_COUNT]);
+
+    for (GBytes *f : frames) g_bytes_unref(f);
+    return ok;
+}
+
+// Через чергу і потік керування: від прийому до останнього запису виходу
+// в журнал симулятора. Включає очікування такту, тож залежить від tick_us.
+static bool bench_queue_latency(guint commands) {
+    // Відомий початковий стан: перша команда точно змінює виходи
+    stop_vehicle(vehicle);
+    if (!motor_thread_start(&vehicle, 1)) return false;
+    MotorQueue *queue = motor_queue_new(vehicle, "bench");
+    if (!queue) {
+        motor_thread_stop();
+        return false;
+    }
+
+    std::vector<double> latencies;
+    bool ok = true;
+    for (guint i = 0; i < commands && ok; i++) {
+        const Step &s = steps[i % STEP_COUNT];
+        guint64 before = motor_sim_transition_count(bridge);
+
+        MotorCommand cmd = {};
+        cmd.direction = (int8_t)motor_direction_from_string(s.direction);
+        cmd.turn = (int8_t)motor_turn_from_string(s.turn);
+        cmd.speed = (uint8_t)s.speed;
+        cmd.source = MOTOR_SOURCE_WEBSOCKET;
+        cmd.received_us = g_get_monotonic_time();
+        motor_queue_push(queue, &cmd);
+
+        // Не довше кількох тактів; інакше потік керування не працює
+        gint64 deadline = cmd.received_us + 100 * LATENCY_TICK_US;
+        while (motor_sim_transition_count(bridge) == before) {
+            if (g_get_monotonic_time() > deadline) {
+                ok = false;
+                break;
+            }
+            g_usleep(20);
+        }
+        if (!ok) break;
+
+        // Команда застосовується повністю в межах такту; пауза також не
+        // дає наступній команді злитися з цією
+        g_usleep(2 * LATENCY_TICK_US);
+        MotorTransition t;
+        motor_sim_transitions(bridge, &t, 1);
+        latencies.push_back((double)(t.time_us - cmd.received_us));
+    }
+
+    motor_queue_release(queue);
+    motor_thread_stop();
+    if (ok) add_result("queue_to_outputs", "us", commands, latencies);
+    return ok;
+}
+
+// --- Вивід і порівняння ---
+static gchar *render_json() {
+    JsonBuilder *b = json_builder_new();
+    json_builder_begin_object(b);
+    json_builder_set_member_name(b, "tick_us");
+    json_builder_add_int_value(b, LATENCY_TICK_US);
+    json_builder_set_member_name(b, "runs");
+    json_builder_add_int_value(b, BENCH_RUNS);
+    json_builder_set_member_name(b, "benchmarks");
+    json_builder_begin_array(b);
+    for (const Result &r : results) {
+        json_builder_begin_object(b);
+        json_builder_set_member_name(b, "name");
+        json_builder_add_string_value(b, r.name);
+        json_builder_set_member_name(b, "unit");
+        json_builder_add_string_value(b, r.unit);
+        json_builder_set_member_name(b, "iterations");
+        json_builder_add_int_value(b, r.iterations);
+        json_builder_set_member_name(b, "median");
+        json_builder_add_double_value(b, r.median);
+        json_builder_set_member_name(b, "min");
+        json_builder_add_double_value(b, r.min);
+        json_builder_set_member_name(b, "max");
+        json_builder_add_double_value(b, r.max);
+        json_builder_end_object(b);
+    }
+    json_builder_end_array(b);
+    json_builder_end_object(b);
+    return report_to_json(b);
+}
+
+// false — хоча б одна медіана гірша за базову більш ніж на tolerance
+static bool compare_with(const char *path, double tolerance) {
+    JsonParser *parser = json_parser_new();
+    GError *error = nullptr;
+    if (!json_parser_load_from_file(parser, path, &error)) {
+        fprintf(stderr, "control_bench: cannot read %s: %s\n", path, error->message);
+        g_error_free(error);
+        g_object_unref(parser);
+        return false;
+    }
+
+    bool ok = true;
+    JsonNode *root = json_parser_get_root(parser);
+    JsonArray *base = JSON_NODE_HOLDS_OBJECT(root)
+        ? json_object_get_array_member(json_node_get_object(root), "benchmarks") : nullptr;
+    for (guint i = 0; base && i < json_array_get_length(base); i++) {
+        JsonObject *o = json_array_get_object_element(base, i);
+        const char *name = json_object_get_string_member_with_default(o, "name", "");
+        double before = json_object_get_double_member_with_default(o, "median", 0);
+        for (const Result &r : results) {
+            if (g_strcmp0(r.name, name) || before <= 0) continue;
+            double change = r.median / before - 1;
+            bool regressed = change > tolerance;
+            fprintf(stderr, "%-22s %10.1f -> %10.1f %-5s %+6.1f%%%s\n",
+                    name, before, r.median, r.unit, change * 100, regressed ? "  REGRESSION" : "");
+            if (regressed) ok = false;
+        }
+    }
+    g_object_unref(parser);
+    return ok;
+}
+
+// Конфігурація для заміру: симулятор, фіксований такт, журнал вимкнено
+static bool load_bench_config() {
+    gchar *text = g_strdup_printf("[control]\nbackend=sim\ntick_us=%u\n[log]\nlevel=off\n", LATENCY_TICK_US);
+    bool ok = config_load_from_data(text);
+    g_free(text);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    gboolean quick = FALSE;
+    gchar *output = nullptr;
+    gchar *compare = nullptr;
+    gdouble tolerance = 0.25;
+    GOptionEntry entries[] = {
+        { "quick", 0, 0, G_OPTION_ARG_NONE, &quick, "Fewer iterations (CTest)", NULL },
+        { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output, "Write JSON results to FILE", "FILE" },
+        { "compare", 'c', 0, G_OPTION_ARG_FILENAME, &compare, "Fail if slower than results in FILE", "FILE" },
+        { "tolerance", 't', 0, G_OPTION_ARG_DOUBLE, &tolerance, "Allowed slowdown for --compare (0.25 = 25%)", "R" },
+        { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
+    };
+    GOptionContext *ctx = g_option_context_new("- control path microbenchmarks");
+    g_option_context_add_main_entries(ctx, entries, NULL);
+    GError *error = nullptr;
+    if (!g_option_context_parse(ctx, &argc, &argv, &error)) {
+        fprintf(stderr, "control_bench: %s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(ctx);
+        return 2;
+    }
+    g_option_context_free(ctx);
+
+    if (!load_bench_config()) {
+        fprintf(stderr, "control_bench: invalid built-in config\n");
+        return 2;
+    }
+    log_set_level(log_level_from_string(config_get()->log.level));
+    vehicle = vehicle_new("bench", &config_get()->motors);
+    if (!vehicle || vehicle_bridge(vehicle)->backend != &motor_backend_sim) {
+        fprintf(stderr, "control_bench: simulated motor backend is not available\n");
+        return 2;
+    }
+    bridge = vehicle_bridge(vehicle);
+
+    guint iterations = quick ? BENCH_ITERATIONS / BENCH_QUICK_DIVISOR : BENCH_ITERATIONS;
+    guint commands = quick ? LATENCY_COMMANDS / 4 : LATENCY_COMMANDS;
+
+    // Перевірки результатів: швидкий, але неправильний шлях — теж провал
+    int status = 0;
+    if (!bench_decode(iterations)) {
+        fprintf(stderr, "control_bench: decoders returned a wrong command\n");
+        status = 1;
+    }
+    if (!bench_actuation(iterations) || !bench_ws_to_outputs(iterations)) {
+        fprintf(stderr, "control_bench: simulated outputs do not match the commands\n");
+        status = 1;
+    }
+    if (!bench_queue_latency(commands)) {
+        fprintf(stderr, "control_bench: control thread did not apply a command\n");
+        status = 1;
+    }
+
+    gchar *json = render_json();
+    if (output) {
+        if (!g_file_set_contents(output, json, -1, NULL)) {
+            fprintf(stderr, "control_bench: cannot write %s\n", output);
+            status = 1;
+        }
+    } else {
+        printf("%s\n", json);
+    }
+    if (compare && !compare_with(compare, tolerance)) status = 1;
+
+    g_free(json);
+    g_free(output);
+    g_free(compare);
+    vehicle_free(vehicle);
+    config_free();
+    return status;
+}
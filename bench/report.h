@@ -0,0 +1,20 @@
+#ifndef BENCH_REPORT_H
+#define BENCH_REPORT_H
+
+#include <json-glib/json-glib.h>
+
+// Результати бенчмарків і наскрізних тестів: об'єкт з JsonBuilder у
+// відформатований JSON. Звільняє builder; рядок звільняє g_free().
+static inline gchar *report_to_json(JsonBuilder *b) {
+    JsonGenerator *gen = json_generator_new();
+    JsonNode *root = json_builder_get_root(b);
+    json_generator_set_root(gen, root);
+    json_generator_set_pretty(gen, TRUE);
+    gchar *text = json_generator_to_data(gen, NULL);
+    json_node_unref(root);
+    g_object_unref(gen);
+    g_object_unref(b);
+    return text;
+}
+
+#endif // BENCH_REPORT_H
@@ -0,0 +1,92 @@
+// Порівняння розбору signaling: старий шлях (новий JsonParser на кожне
+// повідомлення і ланцюжок has_member/strcmp) проти signaling_codec у JSON
+// і MessagePack. Друкує кількість повідомлень за секунду.
+#include "signaling_codec.h"
+#include <json-glib/json-glib.h>
+#include <cstdio>
+
+#define ITERATIONS 200000
+
+static const char *const control_fields[][2] = {
+    { "action", "control" },
+    { "device", "vid" },
+    { "peer", "viewer-1" },
+    { "direction", "forward" },
+    { "turn", "left" },
+};
+
+static GBytes *encode_control(SignalingCodec codec) {
+    SignalingWriter w;
+    signaling_writer_begin(&w, codec);
+    for (auto &f : control_fields) signaling_writer_string(&w, f[0], f[1]);
+    signaling_writer_int(&w, "speed", 65);
+    return signaling_writer_finish(&w);
+}
+
+// Повторює розбір з on_ws_message до переходу на signaling_codec
+static int legacy_decode(const gchar *data, gsize size) {
+    int speed = -1;
+    JsonParser *parser = json_parser_new();
+    GError *error = nullptr;
+    if (!json_parser_load_from_data(parser, data, size, &error)) {
+        g_error_free(error);
+        g_object_unref(parser);
+        return speed;
+    }
+    JsonNode *root = json_parser_get_root(parser);
+    if (JSON_NODE_HOLDS_OBJECT(root)) {
+        JsonObject *obj = json_node_get_object(root);
+        if (json_object_has_member(obj, "device")) json_object_get_string_member(obj, "device");
+        json_object_get_string_member_with_default(obj, "peer", "default");
+        if (json_object_has_member(obj, "action")) {
+            const gchar *action = json_object_get_string_member(obj, "action");
+            if (!g_strcmp0(action, "ready")) {
+            } else if (!g_strcmp0(action, "control")) {
+                json_object_get_string_member_with_default(obj, "direction", nullptr);
+                json_object_get_string_member_with_default(obj, "turn", nullptr);
+                speed = json_object_get_int_member_with_default(obj, "speed", 50);
+            }
+        }
+    }
+    g_object_unref(parser);
+    return speed;
+}
+
+static void report(const char *name, gint64 elapsed_us, gsize size) {
+    double rate = ITERATIONS * 1e6 / (double)MAX(elapsed_us, 1);
+    printf("%-10s %6zu B  %10.0f msg/s  %7.3f us/msg\n",
+           name, size, rate, (double)elapsed_us / ITERATIONS);
+}
+
+int main() {
+    GBytes *json = encode_control(SIGNALING_CODEC_JSON);
+    GBytes *msgpack = encode_control(SIGNALING_CODEC_MSGPACK);
+    gsize json_size, msgpack_size;
+    const guint8 *json_data = (const guint8*)g_bytes_get_data(json, &json_size);
+    const guint8 *msgpack_data = (const guint8*)g_bytes_get_data(msgpack, &msgpack_size);
+
+    // Контроль: усі три шляхи мають бачити ту саму команду
+    SignalingMessage msg;
+    if (legacy_decode((const gchar*)json_data, json_size) != 65
+        || !signaling_decode(SIGNALING_CODEC_JSON, json_data, json_size, &msg) || msg.speed != 65
+        || !signaling_decode(SIGNALING_CODEC_MSGPACK, msgpack_data, msgpack_size, &msg) || msg.speed != 65) {
+        fprintf(stderr, "signaling_bench: decoders disagree\n");
+        return 1;
+    }
+
+    gint64 start = g_get_monotonic_time();
+    for (int i = 0; i < ITERATIONS; i++) legacy_decode((const gchar*)json_data, json_size);
+    report("legacy", g_get_monotonic_time() - start, json_size);
+
+    start = g_get_monotonic_time();
+    for (int i = 0; i < ITERATIONS; i++) signaling_decode(SIGNALING_CODEC_JSON, json_data, json_size, &msg);
+    report("json", g_get_monotonic_time() - start, json_size);
+
+    start = g_get_monotonic_time();
+    for (int i = 0; i < ITERATIONS; i++) signaling_decode(SIGNALING_CODEC_MSGPACK, msgpack_data, msgpack_size, &msg);
+    report("msgpack", g_get_monotonic_time() - start, msgpack_size);
+
+    g_bytes_unref(json);
+    g_bytes_unref(msgpack);
+    return 0;
+}
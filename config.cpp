@@ -0,0 +1,456 @@
+#include "config.h"
+#include <cstring>
+
+static AppConfig g_config;
+
+static void set_defaults() {
+    g_config.media.hot_standby = FALSE;
+    g_config.media.source = g_strdup("udp");
+    g_config.media.device = g_strdup("/dev/video0");
+    g_config.media.encoder = g_strdup("auto");
+    g_config.media.width = 640;
+    g_config.media.height = 480;
+    g_config.media.framerate = 25;
+    g_config.media.bitrate = 1500000;
+    g_config.media.keyframe_interval = 250;
+    g_config.media.keyframe_min_interval_ms = 500;
+    g_config.media.udp_port = 5001;
+    g_config.media.stun_server = g_strdup("stun://stun.l.google.com:19302");
+    g_config.media.gop_cache_max_bytes = 1024 * 1024;
+    g_config.media.preset = g_strdup("");
+    g_config.media.profile = g_strdup("default");
+    g_config.media.max_frame_age_ms = 150;
+    g_config.media.capture_timestamps = TRUE;
+    g_config.media.layers = g_strdup("");
+    g_config.signaling.reconnect_min_ms = 250;
+    g_config.signaling.reconnect_max_ms = 30000;
+    g_config.webrtc.max_peers = 1;
+    g_config.webrtc.ice_restart = TRUE;
+    g_config.webrtc.ice_restart_delay_ms = 300;
+    g_config.webrtc.ice_restart_timeout_ms = 10000;
+    g_config.rate.enabled = TRUE;
+    g_config.rate.interval_ms = 500;
+    g_config.rate.min_bitrate = 250000;
+    g_config.rate.max_bitrate = 0;
+    g_config.rate.loss_high = 0.10;
+    g_config.rate.loss_low = 0.02;
+    g_config.rate.increase_percent = 5;
+    g_config.rate.increase_delay_ms = 3000;
+    g_config.rate.twcc = TRUE;
+    g_config.rate.adapt_resolution = FALSE;
+    g_config.rate.adapt_framerate = FALSE;
+    g_config.rate.degrade_bitrate = 400000;
+    g_config.rate.min_framerate = 10;
+    g_config.control.tick_us = 5000;
+    g_config.control.realtime = FALSE;
+    g_config.control.priority = 50;
+    g_config.control.cpu = -1;
+    g_config.motors.backend = g_strdup("");
+    g_config.motors.pins[0] = 23;     // IN1 назад
+    g_config.motors.pins[1] = 18;     // IN2 вперед
+    g_config.motors.pins[2] = 25;     // IN3 вліво
+    g_config.motors.pins[3] = 24;     // IN4 вправо
+    g_config.motors.pwm_pins[0] = 13;
+    g_config.motors.pwm_pins[1] = 12;
+    g_config.metrics.enabled = TRUE;
+    g_config.metrics.port = 9101;
+    g_config.dashcam.enabled = FALSE;
+    g_config.dashcam.directory = g_strdup("/var/lib/webrccar/dashcam");
+    g_config.dashcam.segment_seconds = 10;
+    g_config.dashcam.max_size_mb = 2048;
+    g_config.dashcam.max_locked_mb = 1024;
+    g_config.dashcam.lock_seconds = 60;
+    g_config.recovery.profile = g_strdup("rtx");
+    g_config.recovery.rtx_time_ms = 200;
+    g_config.recovery.fec_min_percent = 5;
+    g_config.recovery.fec_max_percent = 50;
+    g_config.recovery.fec_loss_gain = 2.0;
+    g_config.recovery.interval_ms = 1000;
+    g_config.telemetry.enabled = TRUE;
+    g_config.telemetry.sample_interval_ms = 100;
+    g_config.telemetry.send_interval_ms = 500;
+    g_config.telemetry.thermal_zone = g_strdup("/sys/class/thermal/thermal_zone0/temp");
+    g_config.log.level = g_strdup("info");
+}
+
+// Значення відсутніх ключів лишаються за замовчуванням
+static void read_bool(GKeyFile *kf, const char *group, const char *key, gboolean *out) {
+    GError *err = nullptr;
+    gboolean v = g_key_file_get_boolean(kf, group, key, &err);
+    if (err) { g_error_free(err); return; }
+    *out = v;
+}
+
+static void read_uint(GKeyFile *kf, const char *group, const char *key, guint *out) {
+    GError *err = nullptr;
+    guint64 v = g_key_file_get_uint64(kf, group, key, &err);
+    if (err) { g_error_free(err); return; }
+    *out = (guint)v;
+}
+
+static void read_int(GKeyFile *kf, const char *group, const char *key, gint *out) {
+    GError *err = nullptr;
+    gint v = g_key_file_get_integer(kf, group, key, &err);
+    if (err) { g_error_free(err); return; }
+    *out = v;
+}
+
+static void read_double(GKeyFile *kf, const char *group, const char *key, gdouble *out) {
+    GError *err = nullptr;
+    gdouble v = g_key_file_get_double(kf, group, key, &err);
+    if (err) { g_error_free(err); return; }
+    *out = v;
+}
+
+static void read_string(GKeyFile *kf, const char *group, const char *key, gchar **out) {
+    gchar *v = g_key_file_get_string(kf, group, key, NULL);
+    if (!v) return;
+    g_free(*out);
+    *out = v;
+}
+
+// Список рівно з n невід'ємних чисел через кому
+static void read_uint_list(GKeyFile *kf, const char *group, const char *key, guint *out, gsize n) {
+    gsize len = 0;
+    gint *v = g_key_file_get_integer_list(kf, group, key, &len, NULL);
+    if (!v) return;
+    bool valid = len == n;
+    for (gsize i = 0; valid && i < n; i++) valid = v[i] >= 0;
+    if (valid) {
+        for (gsize i = 0; i < n; i++) out[i] = (guint)v[i];
+    } else {
+        g_printerr("[CONFIG] [%s] %s needs %" G_GSIZE_FORMAT " numbers, ignored\n", group, key, n);
+    }
+    g_free(v);
+}
+
+// --- Групи, які пристрій може уточнити своєю [GROUP:ID] ---
+static void read_media(GKeyFile *kf, const char *group, MediaConfig *m) {
+    read_bool(kf, group, "hot_standby", &m->hot_standby);
+    read_string(kf, group, "source", &m->source);
+    read_string(kf, group, "device", &m->device);
+    read_string(kf, group, "encoder", &m->encoder);
+    read_uint(kf, group, "width", &m->width);
+    read_uint(kf, group, "height", &m->height);
+    read_uint(kf, group, "framerate", &m->framerate);
+    read_uint(kf, group, "bitrate", &m->bitrate);
+    read_uint(kf, group, "keyframe_interval", &m->keyframe_interval);
+    read_uint(kf, group, "keyframe_min_interval_ms", &m->keyframe_min_interval_ms);
+    read_uint(kf, group, "udp_port", &m->udp_port);
+    read_string(kf, group, "stun_server", &m->stun_server);
+    read_uint(kf, group, "gop_cache_max_bytes", &m->gop_cache_max_bytes);
+    read_string(kf, group, "preset", &m->preset);
+    read_string(kf, group, "profile", &m->profile);
+    read_uint(kf, group, "max_frame_age_ms", &m->max_frame_age_ms);
+    read_bool(kf, group, "capture_timestamps", &m->capture_timestamps);
+    read_string(kf, group, "layers", &m->layers);
+}
+
+static void read_dashcam(GKeyFile *kf, const char *group, DashcamConfig *d) {
+    read_bool(kf, group, "enabled", &d->enabled);
+    read_string(kf, group, "directory", &d->directory);
+    read_uint(kf, group, "segment_seconds", &d->segment_seconds);
+    read_uint(kf, group, "max_size_mb", &d->max_size_mb);
+    read_uint(kf, group, "max_locked_mb", &d->max_locked_mb);
+    read_uint(kf, group, "lock_seconds", &d->lock_seconds);
+}
+
+static void read_motors(GKeyFile *kf, const char *group, MotorConfig *mc) {
+    read_string(kf, group, "backend", &mc->backend);
+    read_uint_list(kf, group, "pins", mc->pins, G_N_ELEMENTS(mc->pins));
+    read_uint_list(kf, group, "pwm_pins", mc->pwm_pins, G_N_ELEMENTS(mc->pwm_pins));
+}
+
+// Копії з власними рядками: пристрій змінює і звільняє їх окремо від основних
+static void copy_media(const MediaConfig &from, MediaConfig *to) {
+    *to = from;
+    to->source = g_strdup(from.source);
+    to->device = g_strdup(from.device);
+    to->encoder = g_strdup(from.encoder);
+    to->stun_server = g_strdup(from.stun_server);
+    to->preset = g_strdup(from.preset);
+    to->profile = g_strdup(from.profile);
+    to->layers = g_strdup(from.layers);
+}
+
+static void free_media(MediaConfig *m) {
+    g_clear_pointer(&m->source, g_free);
+    g_clear_pointer(&m->device, g_free);
+    g_clear_pointer(&m->encoder, g_free);
+    g_clear_pointer(&m->stun_server, g_free);
+    g_clear_pointer(&m->preset, g_free);
+    g_clear_pointer(&m->profile, g_free);
+    g_clear_pointer(&m->layers, g_free);
+}
+
+#define PRESET_GROUP_PREFIX "preset:"
+
+static void free_presets() {
+    for (guint i = 0; i < g_config.n_presets; i++) {
+        g_free(g_config.presets[i].name);
+    }
+    g_clear_pointer(&g_config.presets, g_free);
+    g_config.n_presets = 0;
+}
+
+// Кожна група [preset:NAME] — окремий набір; відсутні ключі беруться з [media]
+static void read_presets(GKeyFile *kf) {
+    free_presets();
+    gsize n_groups = 0;
+    gchar **groups = g_key_file_get_groups(kf, &n_groups);
+    g_config.presets = g_new0(VideoPreset, n_groups);
+    for (gsize i = 0; i < n_groups; i++) {
+        if (!g_str_has_prefix(groups[i], PRESET_GROUP_PREFIX)) continue;
+        const char *name = groups[i] + strlen(PRESET_GROUP_PREFIX);
+        if (!*name || config_find_preset(name)) {
+            g_printerr("[CONFIG] Ignoring preset group [%s]\n", groups[i]);
+            continue;
+        }
+        VideoPreset &p = g_config.presets[g_config.n_presets++];
+        p.name = g_strdup(name);
+        p.width = g_config.media.width;
+        p.height = g_config.media.height;
+        p.framerate = g_config.media.framerate;
+        p.bitrate = g_config.media.bitrate;
+        read_uint(kf, groups[i], "width", &p.width);
+        read_uint(kf, groups[i], "height", &p.height);
+        read_uint(kf, groups[i], "framerate", &p.framerate);
+        read_uint(kf, groups[i], "bitrate", &p.bitrate);
+    }
+    g_strfreev(groups);
+}
+
+// [media] preset замінює власні значення [media] на значення набору
+static bool apply_startup_preset(MediaConfig *m) {
+    if (!*m->preset) return true;
+    const VideoPreset *p = config_find_preset(m->preset);
+    if (!p) {
+        g_printerr("[CONFIG] Unknown preset '%s'\n", m->preset);
+        return false;
+    }
+    m->width = p->width;
+    m->height = p->height;
+    m->framerate = p->framerate;
+    m->bitrate = p->bitrate;
+    return true;
+}
+
+// --- Пристрої ---
+#define DEVICE_GROUP_PREFIX "device:"
+
+static void free_device(DeviceConfig *d) {
+    g_free(d->id);
+    g_free(d->server);
+    g_free(d->port);
+    free_media(&d->media);
+    g_free(d->dashcam.directory);
+    g_free(d->motors.backend);
+}
+
+static void free_devices() {
+    for (guint i = 0; i < g_config.n_devices; i++) free_device(&g_config.devices[i]);
+    g_clear_pointer(&g_config.devices, g_free);
+    g_config.n_devices = 0;
+}
+
+// Пристрій з основних груп; kf != nullptr — з уточненнями [GROUP:ID]
+static bool init_device(DeviceConfig *d, GKeyFile *kf, const char *id) {
+    d->id = g_strdup(id);
+    copy_media(g_config.media, &d->media);
+    d->dashcam = g_config.dashcam;
+    d->dashcam.directory = g_strdup(g_config.dashcam.directory);
+    d->motors = g_config.motors;
+    d->motors.backend = g_strdup(g_config.motors.backend);
+    if (!kf) return true;
+
+    gchar *group = g_strconcat("media:", id, NULL);
+    read_media(kf, group, &d->media);
+    // Основний набір уже застосовано; власний preset пристрою — поверх уточнень
+    bool ok = !g_key_file_has_key(kf, group, "preset", NULL) || apply_startup_preset(&d->media);
+    g_free(group);
+    group = g_strconcat("dashcam:", id, NULL);
+    read_dashcam(kf, group, &d->dashcam);
+    g_free(group);
+    group = g_strconcat("control:", id, NULL);
+    read_motors(kf, group, &d->motors);
+    g_free(group);
+    return ok;
+}
+
+static const DeviceConfig *find_device(const char *id) {
+    for (guint i = 0; i < g_config.n_devices; i++) {
+        if (!g_strcmp0(g_config.devices[i].id, id)) return &g_config.devices[i];
+    }
+    return nullptr;
+}
+
+static bool read_devices(GKeyFile *kf) {
+    gsize n_groups = 0;
+    gchar **groups = g_key_file_get_groups(kf, &n_groups);
+    g_config.devices = g_new0(DeviceConfig, n_groups);
+    bool ok = true;
+    for (gsize i = 0; i < n_groups && ok; i++) {
+        if (!g_str_has_prefix(groups[i], DEVICE_GROUP_PREFIX)) continue;
+        const char *id = groups[i] + strlen(DEVICE_GROUP_PREFIX);
+        if (!*id || find_device(id)) {
+            g_printerr("[CONFIG] Duplicate or empty device group [%s]\n", groups[i]);
+            ok = false;
+            break;
+        }
+        DeviceConfig &d = g_config.devices[g_config.n_devices++];
+        ok = init_device(&d, kf, id);
+        read_string(kf, groups[i], "server", &d.server);
+        read_string(kf, groups[i], "port", &d.port);
+        if (!d.server || !d.port) {
+            g_printerr("[CONFIG] [%s] needs server and port\n", groups[i]);
+            ok = false;
+        }
+    }
+
+    // Два реєстратори в одному каталозі видаляли б сегменти один одного
+    for (guint i = 0; ok && g_config.n_devices > 1 && i < g_config.n_devices; i++) {
+        DeviceConfig &d = g_config.devices[i];
+        gchar *group = g_strconcat("dashcam:", d.id, NULL);
+        if (!g_key_file_has_key(kf, group, "directory", NULL)) {
+            gchar *dir = g_build_filename(d.dashcam.directory, d.id, NULL);
+            g_free(d.dashcam.directory);
+            d.dashcam.directory = dir;
+        }
+        g_free(group);
+    }
+    g_strfreev(groups);
+    return ok;
+}
+
+void config_use_device(const char *id, const char *server, const char *port) {
+    DeviceConfig d = {};
+    const DeviceConfig *found = find_device(id);
+    if (found) {
+        // Уточнення з файлу лишаються, адреса — з командного рядка
+        d = *found;
+        d.server = nullptr;
+        d.port = nullptr;
+        g_free(found->server);
+        g_free(found->port);
+        g_config.devices[found - g_config.devices] = {};
+    } else {
+        init_device(&d, nullptr, id);
+    }
+    d.server = g_strdup(server);
+    d.port = g_strdup(port);
+    free_devices();
+    g_config.devices = g_new(DeviceConfig, 1);
+    g_config.devices[0] = d;
+    g_config.n_devices = 1;
+}
+
+// Усі групи з уже розібраного файлу поверх значень за замовчуванням
+static bool read_key_file(GKeyFile *kf) {
+    read_media(kf, "media", &g_config.media);
+    read_uint(kf, "signaling", "reconnect_min_ms", &g_config.signaling.reconnect_min_ms);
+    read_uint(kf, "signaling", "reconnect_max_ms", &g_config.signaling.reconnect_max_ms);
+    read_uint(kf, "webrtc", "max_peers", &g_config.webrtc.max_peers);
+    read_bool(kf, "webrtc", "ice_restart", &g_config.webrtc.ice_restart);
+    read_uint(kf, "webrtc", "ice_restart_delay_ms", &g_config.webrtc.ice_restart_delay_ms);
+    read_uint(kf, "webrtc", "ice_restart_timeout_ms", &g_config.webrtc.ice_restart_timeout_ms);
+
+    read_bool(kf, "rate", "enabled", &g_config.rate.enabled);
+    read_uint(kf, "rate", "interval_ms", &g_config.rate.interval_ms);
+    read_uint(kf, "rate", "min_bitrate", &g_config.rate.min_bitrate);
+    read_uint(kf, "rate", "max_bitrate", &g_config.rate.max_bitrate);
+    read_double(kf, "rate", "loss_high", &g_config.rate.loss_high);
+    read_double(kf, "rate", "loss_low", &g_config.rate.loss_low);
+    read_uint(kf, "rate", "increase_percent", &g_config.rate.increase_percent);
+    read_uint(kf, "rate", "increase_delay_ms", &g_config.rate.increase_delay_ms);
+    read_bool(kf, "rate", "twcc", &g_config.rate.twcc);
+    read_bool(kf, "rate", "adapt_resolution", &g_config.rate.adapt_resolution);
+    read_bool(kf, "rate", "adapt_framerate", &g_config.rate.adapt_framerate);
+    read_uint(kf, "rate", "degrade_bitrate", &g_config.rate.degrade_bitrate);
+    read_uint(kf, "rate", "min_framerate", &g_config.rate.min_framerate);
+
+    read_uint(kf, "control", "tick_us", &g_config.control.tick_us);
+    read_bool(kf, "control", "realtime", &g_config.control.realtime);
+    read_int(kf, "control", "priority", &g_config.control.priority);
+    read_int(kf, "control", "cpu", &g_config.control.cpu);
+    read_motors(kf, "control", &g_config.motors);
+
+    read_bool(kf, "metrics", "enabled", &g_config.metrics.enabled);
+    read_uint(kf, "metrics", "port", &g_config.metrics.port);
+
+    read_dashcam(kf, "dashcam", &g_config.dashcam);
+
+    read_string(kf, "recovery", "profile", &g_config.recovery.profile);
+    read_uint(kf, "recovery", "rtx_time_ms", &g_config.recovery.rtx_time_ms);
+    read_uint(kf, "recovery", "fec_min_percent", &g_config.recovery.fec_min_percent);
+    read_uint(kf, "recovery", "fec_max_percent", &g_config.recovery.fec_max_percent);
+    read_double(kf, "recovery", "fec_loss_gain", &g_config.recovery.fec_loss_gain);
+    read_uint(kf, "recovery", "interval_ms", &g_config.recovery.interval_ms);
+    read_bool(kf, "telemetry", "enabled", &g_config.telemetry.enabled);
+    read_uint(kf, "telemetry", "sample_interval_ms", &g_config.telemetry.sample_interval_ms);
+    read_uint(kf, "telemetry", "send_interval_ms", &g_config.telemetry.send_interval_ms);
+    read_string(kf, "telemetry", "thermal_zone", &g_config.telemetry.thermal_zone);
+
+    read_string(kf, "log", "level", &g_config.log.level);
+
+    read_presets(kf);
+
+    // Пристрої успадковують [media] уже з застосованим набором
+    return apply_startup_preset(&g_config.media) && read_devices(kf);
+}
+
+bool config_load(const char *path) {
+    set_defaults();
+    if (!path) return true;
+
+    GKeyFile *kf = g_key_file_new();
+    GError *err = nullptr;
+    if (!g_key_file_load_from_file(kf, path, G_KEY_FILE_NONE, &err)) {
+        g_printerr("[CONFIG] Cannot load %s: %s\n", path, err->message);
+        g_error_free(err);
+        g_key_file_free(kf);
+        return false;
+    }
+    bool ok = read_key_file(kf);
+    g_key_file_free(kf);
+    if (!ok) return false;
+    g_print("[CONFIG] Loaded %s, %u device(s)\n", path, g_config.n_devices);
+    return true;
+}
+
+bool config_load_from_data(const char *text) {
+    set_defaults();
+
+    GKeyFile *kf = g_key_file_new();
+    GError *err = nullptr;
+    if (!g_key_file_load_from_data(kf, text, -1, G_KEY_FILE_NONE, &err)) {
+        g_printerr("[CONFIG] Cannot parse configuration: %s\n", err->message);
+        g_error_free(err);
+        g_key_file_free(kf);
+        return false;
+    }
+    bool ok = read_key_file(kf);
+    g_key_file_free(kf);
+    return ok;
+}
+
+const AppConfig *config_get() {
+    return &g_config;
+}
+
+const VideoPreset *config_find_preset(const char *name) {
+    for (guint i = 0; i < g_config.n_presets; i++) {
+        if (!g_strcmp0(g_config.presets[i].name, name)) return &g_config.presets[i];
+    }
+    return nullptr;
+}
+
+void config_free() {
+    free_media(&g_config.media);
+    g_clear_pointer(&g_config.motors.backend, g_free);
+    g_clear_pointer(&g_config.dashcam.directory, g_free);
+    g_clear_pointer(&g_config.recovery.profile, g_free);
+    g_clear_pointer(&g_config.telemetry.thermal_zone, g_free);
+    g_clear_pointer(&g_config.log.level, g_free);
+    free_presets();
+    free_devices();
+}
@@ -0,0 +1,166 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <glib.h>
+
+// Налаштування медіа-конвеєра (група [media] у файлі конфігурації)
+struct MediaConfig {
+    gboolean hot_standby;         // тримати ingest у PLAYING між сесіями
+    gchar   *source;              // udp | libcamera | v4l2 | test
+    gchar   *device;              // вузол камери для source=v4l2
+    gchar   *encoder;             // auto | v4l2h264enc | x264enc
+    guint    width;
+    guint    height;
+    guint    framerate;
+    guint    bitrate;             // біт/с
+    guint    keyframe_interval;   // кадрів між IDR
+    guint    keyframe_min_interval_ms; // не частіше за це передавати PLI/FIR кодеру
+    guint    udp_port;            // порт RTP від start_camera.sh
+    gchar   *stun_server;         // порожній рядок — без STUN
+    guint    gop_cache_max_bytes; // межа кешу останньої GOP
+    gchar   *preset;              // стартовий набір [preset:NAME], порожньо — значення вище
+    gchar   *profile;             // default | low-latency
+    guint    max_frame_age_ms;    // low-latency: старіші кадри не відправляються
+    gboolean capture_timestamps;  // SEI з часом захоплення в кожному кадрі
+    gchar   *layers;              // набори [preset:NAME] через кому — шари для глядачів, порожньо — один потік
+};
+
+// Набір параметрів відео (групи [preset:NAME]) для дії configure;
+// відсутні ключі успадковуються з [media]
+struct VideoPreset {
+    gchar   *name;
+    guint    width;
+    guint    height;
+    guint    framerate;
+    guint    bitrate;             // біт/с
+};
+
+// З'єднання з сервером сигналізації (група [signaling])
+struct SignalingConfig {
+    guint    reconnect_min_ms;    // перша затримка перепідключення
+    guint    reconnect_max_ms;    // межа експоненційного зростання
+};
+
+// Налаштування WebRTC-сесій (група [webrtc])
+struct WebRTCConfig {
+    guint max_peers;              // 1 — новий глядач витісняє попереднього
+    gboolean ice_restart;         // відновлювати зв'язок ICE restart, не перестворюючи гілку
+    guint ice_restart_delay_ms;   // скільки DISCONNECTED може відновитися сам
+    guint ice_restart_timeout_ms; // після цього глядача прибирають повністю
+};
+
+// Регулятор бітрейту за зворотним зв'язком WebRTC (група [rate])
+struct RateConfig {
+    gboolean enabled;
+    guint    interval_ms;         // період опитування get-stats
+    guint    min_bitrate;         // біт/с
+    guint    max_bitrate;         // біт/с, 0 — поточний bitrate ([media] або configure)
+    gdouble  loss_high;           // вище — швидке зниження
+    gdouble  loss_low;            // нижче — повільне зростання
+    guint    increase_percent;    // крок зростання за інтервал
+    guint    increase_delay_ms;   // пауза після зниження перед зростанням
+    gboolean twcc;                // rtpgccbwe, якщо плагін доступний
+    gboolean adapt_resolution;    // половинна роздільність нижче degrade_bitrate
+    gboolean adapt_framerate;     // половинна частота нижче degrade_bitrate
+    guint    degrade_bitrate;
+    guint    min_framerate;
+};
+
+// Захист відео від втрат (група [recovery])
+struct RecoveryConfig {
+    gchar   *profile;             // off | rtx | fec | rtx-fec; глядач може обрати свій у ready
+    guint    rtx_time_ms;         // відправлені пакети тримаються для повтору не довше
+    guint    fec_min_percent;     // надлишок ULPFEC на чистому лінку
+    guint    fec_max_percent;
+    gdouble  fec_loss_gain;       // відсоток надлишку на відсоток втрат
+    guint    interval_ms;         // період підлаштування FEC і лічильників
+};
+
+// Потік керування моторами (група [control]), спільний для всіх машин
+struct ControlConfig {
+    guint    tick_us;             // період застосування команд
+    gboolean realtime;            // SCHED_FIFO (потрібен CAP_SYS_NICE)
+    gint     priority;            // пріоритет SCHED_FIFO
+    gint     cpu;                 // прив'язка до ядра, -1 — без прив'язки
+};
+
+// Виходи моторів однієї машини (backend, pins і pwm_pins у групі [control])
+struct MotorConfig {
+    gchar   *backend;             // hw | sim | none (лише камера), порожньо — типовий для збірки
+    guint    pins[4];             // BCM GPIO входів IN1..IN4 моста
+    guint    pwm_pins[2];         // BCM GPIO PWM моторів A і B
+};
+
+// Локальний ендпоінт Prometheus (група [metrics])
+struct MetricsConfig {
+    gboolean enabled;
+    guint    port;                // слухає лише 127.0.0.1
+};
+
+// Відеореєстратор (група [dashcam])
+struct DashcamConfig {
+    gboolean enabled;
+    gchar   *directory;           // кільце сегментів; збережені — у locked/
+    guint    segment_seconds;     // тривалість сегмента (ріжеться на IDR)
+    guint    max_size_mb;         // межа кільця на диску
+    guint    max_locked_mb;       // межа збережених у locked/, найстаріші видаляються
+    guint    lock_seconds;        // lock без "seconds"
+};
+
+// Телеметрія для глядачів (група [telemetry])
+struct TelemetryConfig {
+    gboolean enabled;
+    guint    sample_interval_ms;  // період вибірки стану
+    guint    send_interval_ms;    // період відправки пакета з накопиченими вибірками
+    gchar   *thermal_zone;        // файл температури CPU, мілі°C
+};
+
+// Журнал (група [log])
+struct LogConfig {
+    gchar   *level;               // debug | info | warn | error | off
+};
+
+// Один пристрій процесу (група [device:ID]): власне з'єднання з
+// сигналізацією, ingest, регулятор і машина. Групи [media:ID],
+// [dashcam:ID] і [control:ID] уточнюють для нього [media], [dashcam]
+// і [control]; решта груп спільна.
+struct DeviceConfig {
+    gchar   *id;
+    gchar   *server;              // адреса сервера сигналізації
+    gchar   *port;
+    MediaConfig media;
+    DashcamConfig dashcam;
+    MotorConfig motors;
+};
+
+struct AppConfig {
+    MediaConfig media;
+    SignalingConfig signaling;
+    WebRTCConfig webrtc;
+    RateConfig rate;
+    RecoveryConfig recovery;
+    ControlConfig control;
+    MotorConfig motors;
+    MetricsConfig metrics;
+    DashcamConfig dashcam;
+    TelemetryConfig telemetry;
+    LogConfig log;
+    VideoPreset *presets;
+    guint n_presets;
+    DeviceConfig *devices;
+    guint n_devices;
+};
+
+// Завантажує GKeyFile; path == nullptr — лише значення за замовчуванням
+bool config_load(const char *path);
+// Те саме з тексту в пам'яті (тести й бенчмарки)
+bool config_load_from_data(const char *text);
+// Один пристрій із командного рядка замість груп [device:ID]. Уточнення
+// [media:ID] тощо для цього id застосовуються, якщо є у файлі.
+void config_use_device(const char *id, const char *server, const char *port);
+const AppConfig *config_get();
+// nullptr — набору з такою назвою немає
+const VideoPreset *config_find_preset(const char *name);
+void config_free();
+
+#endif // CONFIG_H
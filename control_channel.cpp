@@ -0,0 +1,133 @@
+#include "control_channel.h"
+#include "motor_thread.h"
+#include "metrics.h"
+#include "log.h"
+#include <gst/webrtc/webrtc.h>
+#include <glib.h>
+
+// Стан одного каналу: останній прийнятий номер кадру і власна черга команд.
+// on-message-data приходить з одного потоку SCTP, тож виробник у черги один.
+struct ControlChannelState {
+    bool        have_seq;
+    guint32     last_seq;
+    guint64     dropped;
+    MotorQueue *queue;
+    Vehicle    *vehicle;
+};
+
+static void free_channel_state(gpointer data) {
+    ControlChannelState *st = (ControlChannelState*)data;
+    motor_queue_release(st->queue);
+    g_free(st);
+}
+
+static guint32 read_u32_le(const guint8 *p) {
+    return (guint32)p[0] | ((guint32)p[1] << 8) | ((guint32)p[2] << 16) | ((guint32)p[3] << 24);
+}
+
+bool control_frame_decode(const guint8 *data, gsize size, ControlFrame *out) {
+    if (!data || size != CONTROL_FRAME_SIZE) return false;
+    if (data[8] != CONTROL_FRAME_VERSION) return false;
+    if (data[9] != CONTROL_FRAME_DRIVE && data[9] != CONTROL_FRAME_STOP) return false;
+
+    out->seq          = read_u32_le(data);
+    out->timestamp_ms = read_u32_le(data + 4);
+    out->type         = data[9];
+    out->direction    = (int8_t)data[10];
+    out->turn         = (int8_t)data[11];
+    out->speed        = data[12] > 100 ? 100 : data[12];
+    return true;
+}
+
+static void on_control_message_data(GstWebRTCDataChannel *channel, GBytes *bytes, gpointer) {
+    gint64 received_us = g_get_monotonic_time();
+    gsize size;
+    const guint8 *data = (const guint8*)g_bytes_get_data(bytes, &size);
+
+    ControlFrame frame;
+    if (!control_frame_decode(data, size, &frame)) {
+        // Потік SCTP; зіпсовані кадри може слати будь-який глядач
+        LOG_DEBUG("CONTROL", "Malformed control frame (%" G_GSIZE_FORMAT " bytes)", size);
+        return;
+    }
+
+    metrics_inc(METRIC_COMMANDS_RECEIVED_DC);
+
+    // Канал неупорядкований: усе, що не новіше за останній кадр, застаріле
+    ControlChannelState *st = (ControlChannelState*)g_object_get_data(G_OBJECT(channel), "control-state");
+    if (st->have_seq && (gint32)(frame.seq - st->last_seq) <= 0) {
+        st->dropped++;
+        metrics_inc(METRIC_COMMANDS_DROPPED_STALE);
+        return;
+    }
+    st->have_seq = true;
+    st->last_seq = frame.seq;
+
+    MotorCommand cmd = {};
+    cmd.stop        = frame.type == CONTROL_FRAME_STOP;
+    cmd.direction   = frame.direction > 0 ? 1 : frame.direction < 0 ? -1 : 0;
+    cmd.turn        = frame.turn > 0 ? 1 : frame.turn < 0 ? -1 : 0;
+    cmd.speed       = frame.speed;
+    cmd.source      = MOTOR_SOURCE_DATACHANNEL;
+    cmd.received_us = received_us;
+
+    if (!st->queue || !motor_queue_push(st->queue, &cmd)) {
+        // Черга недоступна — зупинка надійніша за ігнорування команди
+        if (cmd.stop) motor_thread_request_stop(st->vehicle);
+        st->dropped++;
+    }
+}
+
+static void on_control_open(GstWebRTCDataChannel *channel, gpointer) {
+    LOG_INFO("CONTROL", "Data channel opened");
+}
+
+static void on_control_close(GstWebRTCDataChannel *channel, gpointer) {
+    ControlChannelState *st = (ControlChannelState*)g_object_get_data(G_OBJECT(channel), "control-state");
+    LOG_INFO("CONTROL", "Data channel closed (stale frames dropped: %" G_GUINT64_FORMAT ")", st->dropped);
+    // Втрата каналу керування не повинна залишати машину в русі
+    motor_thread_request_stop(st->vehicle);
+}
+
+static void setup_control_channel(GstWebRTCDataChannel *channel, Vehicle *vehicle) {
+    ControlChannelState *st = g_new0(ControlChannelState, 1);
+    st->vehicle = vehicle;
+    st->queue = motor_queue_new(vehicle, CONTROL_CHANNEL_LABEL);
+    g_object_set_data_full(G_OBJECT(channel), "control-state", st, free_channel_state);
+    g_signal_connect(channel, "on-message-data", G_CALLBACK(on_control_message_data), NULL);
+    g_signal_connect(channel, "on-open", G_CALLBACK(on_control_open), NULL);
+    g_signal_connect(channel, "on-close", G_CALLBACK(on_control_close), NULL);
+}
+
+static void on_data_channel(GstElement*, GstWebRTCDataChannel *channel, gpointer vehicle) {
+    gchar *label = nullptr;
+    g_object_get(channel, "label", &label, NULL);
+    if (!g_strcmp0(label, CONTROL_CHANNEL_LABEL)) {
+        LOG_INFO("CONTROL", "Remote peer opened control channel");
+        setup_control_channel(channel, (Vehicle*)vehicle);
+    }
+    g_free(label);
+}
+
+void control_channel_attach(GstElement *webrtc, Vehicle *vehicle) {
+    // Без упорядкування і без повторних передач: загублений кадр
+    // однаково застарів би до моменту повтору
+    GstStructure *opts = gst_structure_new("application/data-channel",
+        "ordered", G_TYPE_BOOLEAN, FALSE,
+        "max-retransmits", G_TYPE_INT, 0,
+        NULL);
+
+    GstWebRTCDataChannel *channel = nullptr;
+    g_signal_emit_by_name(webrtc, "create-data-channel", CONTROL_CHANNEL_LABEL, opts, &channel);
+    gst_structure_free(opts);
+
+    if (channel) {
+        setup_control_channel(channel, vehicle);
+        // webrtcbin тримає власне посилання на канал
+        g_object_unref(channel);
+    } else {
+        LOG_WARN("CONTROL", "Failed to create control data channel, WebSocket control only");
+    }
+
+    g_signal_connect(webrtc, "on-data-channel", G_CALLBACK(on_data_channel), vehicle);
+}
@@ -0,0 +1,45 @@
+#ifndef CONTROL_CHANNEL_H
+#define CONTROL_CHANNEL_H
+
+#include <gst/gst.h>
+#include <cstdint>
+
+// Бінарний кадр керування, що приходить через WebRTC data channel "control".
+// Фіксований розмір 16 байт, little-endian:
+//   0..3   seq           — монотонний лічильник кадрів відправника
+//   4..7   timestamp_ms  — час відправки за годинником клієнта
+//   8      version       — CONTROL_FRAME_VERSION
+//   9      type          — ControlFrameType
+//   10     direction     — -1 назад, 0 немає, 1 вперед
+//   11     turn          — -1 вліво, 0 прямо, 1 вправо
+//   12     speed         — 0–100 %
+//   13..15 reserved      — нулі
+#define CONTROL_FRAME_SIZE    16
+#define CONTROL_FRAME_VERSION 1
+#define CONTROL_CHANNEL_LABEL "control"
+
+enum ControlFrameType : uint8_t {
+    CONTROL_FRAME_DRIVE = 1,
+    CONTROL_FRAME_STOP  = 2,
+};
+
+struct ControlFrame {
+    uint32_t seq;
+    uint32_t timestamp_ms;
+    uint8_t  type;
+    int8_t   direction;
+    int8_t   turn;
+    uint8_t  speed;
+};
+
+// Розбір кадру; false, якщо розмір, версія чи тип некоректні
+bool control_frame_decode(const guint8 *data, gsize size, ControlFrame *out);
+
+struct Vehicle;
+
+// Створює неупорядкований канал без повторних передач на webrtcbin
+// і приймає канал "control", відкритий браузером; команди йдуть машині
+// vehicle. Викликати, коли webrtcbin вже у стані READY, але до PLAYING.
+void control_channel_attach(GstElement *webrtc, Vehicle *vehicle);
+
+#endif // CONTROL_CHANNEL_H
@@ -0,0 +1,360 @@
+#include "dashcam.h"
+#include "media_ingest.h"
+#include "lifecycle.h"
+#include "config.h"
+#include "metrics.h"
+#include "log.h"
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <cerrno>
+#include <unistd.h>
+
+// Черга перед записом: ~20 с відео при 1.5 Мбіт/с, поки SD-картка стоїть
+#define DASHCAM_QUEUE_BYTES (4 * 1024 * 1024)
+#define LOCKED_SUBDIR "locked"
+
+struct Segment {
+    gchar  *path;
+    gint64  start_us;   // g_get_monotonic_time() відкриття, 0 — з попереднього запуску
+    goffset size;       // -1 — сегмент ще пишеться
+};
+
+struct Dashcam {
+    gatomicrefcount ref;
+    const DashcamConfig *dc;
+    MediaIngest *ingest;
+    GstElement *branch;
+
+    // Кільце сегментів від найстарішого. Нові сегменти відкриває потік
+    // splitmuxsink, lock читає з головного циклу.
+    GMutex segments_lock;
+    GQueue segments;
+    guint64 segments_bytes;           // сума закритих сегментів
+    bool segments_scanned;
+};
+
+static void segment_free(Segment *seg) {
+    g_free(seg->path);
+    g_free(seg);
+}
+
+// splitmuxsink тримає посилання, доки робочий потік не зупинить гілку
+static Dashcam *dashcam_ref(Dashcam *d) {
+    g_atomic_ref_count_inc(&d->ref);
+    return d;
+}
+
+static void dashcam_unref(Dashcam *d) {
+    if (!g_atomic_ref_count_dec(&d->ref)) return;
+    g_queue_clear_full(&d->segments, (GDestroyNotify)segment_free);
+    g_mutex_clear(&d->segments_lock);
+    g_free(d);
+}
+
+static void dashcam_closure_notify(gpointer data, GClosure*) {
+    dashcam_unref((Dashcam*)data);
+}
+
+static goffset file_size(const char *path) {
+    GStatBuf st;
+    return g_stat(path, &st) == 0 ? (goffset)st.st_size : 0;
+}
+
+// Видаляє найстаріші сегменти, доки кільце з наступним сегментом такого ж
+// розміру, як останній, не вкладається в max_size_mb
+static GList *collect_expired_locked(Dashcam *d) {
+    guint64 limit = (guint64)d->dc->max_size_mb * 1024 * 1024;
+    goffset last = 0;
+    for (GList *l = d->segments.tail; l; l = l->prev) {
+        goffset size = ((Segment*)l->data)->size;
+        if (size >= 0) { last = size; break; }
+    }
+
+    GList *expired = nullptr;
+    while (g_queue_get_length(&d->segments) > 1 && d->segments_bytes + last > limit) {
+        Segment *oldest = (Segment*)g_queue_pop_head(&d->segments);
+        if (oldest->size > 0) d->segments_bytes -= oldest->size;
+        expired = g_list_prepend(expired, oldest);
+    }
+    return expired;
+}
+
+static void scan_existing_segments(Dashcam *d) {
+    const char *dir = d->dc->directory;
+    // Сегменти попередніх запусків теж займають місце в межах кільця
+    GDir *gd = g_dir_open(dir, 0, NULL);
+    if (!gd) return;
+    GPtrArray *names = g_ptr_array_new_with_free_func(g_free);
+    const gchar *name;
+    while ((name = g_dir_read_name(gd))) {
+        if (g_str_has_prefix(name, "seg-") && g_str_has_suffix(name, ".ts")) {
+            g_ptr_array_add(names, g_strdup(name));
+        }
+    }
+    g_dir_close(gd);
+    // Назви містять дату й час, тож лексикографічний порядок — хронологічний
+    g_ptr_array_sort(names, [](gconstpointer a, gconstpointer b) {
+        return g_strcmp0(*(const gchar* const*)a, *(const gchar* const*)b);
+    });
+    for (guint i = 0; i < names->len; i++) {
+        Segment *seg = g_new(Segment, 1);
+        seg->path = g_build_filename(dir, (const gchar*)names->pdata[i], NULL);
+        seg->start_us = 0;
+        seg->size = file_size(seg->path);
+        d->segments_bytes += seg->size;
+        g_queue_push_tail(&d->segments, seg);
+    }
+    g_ptr_array_unref(names);
+}
+
+// Потік splitmuxsink: закриває облік попереднього сегмента, видаляє
+// застарілі й повертає ім'я нового. Дискові операції — тут, не в головному циклі.
+static gchar *on_format_location(GstElement*, guint fragment_id, GstSample*, gpointer data) {
+    Dashcam *d = (Dashcam*)data;
+    const DashcamConfig &dc = *d->dc;
+    GDateTime *now = g_date_time_new_now_local();
+    gchar *stamp = g_date_time_format(now, "%Y%m%d-%H%M%S");
+    g_date_time_unref(now);
+    gchar *name = g_strdup_printf("seg-%s-%05u.ts", stamp, fragment_id);
+    g_free(stamp);
+
+    Segment *seg = g_new(Segment, 1);
+    seg->path = g_build_filename(dc.directory, name, NULL);
+    seg->start_us = g_get_monotonic_time();
+    seg->size = -1;
+    g_free(name);
+
+    g_mutex_lock(&d->segments_lock);
+    Segment *prev = (Segment*)g_queue_peek_tail(&d->segments);
+    if (prev && prev->size < 0) {
+        prev->size = file_size(prev->path);
+        d->segments_bytes += prev->size;
+    }
+    g_queue_push_tail(&d->segments, seg);
+    GList *expired = collect_expired_locked(d);
+    gchar *path = g_strdup(seg->path);
+    g_mutex_unlock(&d->segments_lock);
+
+    for (GList *l = expired; l; l = l->next) {
+        Segment *old = (Segment*)l->data;
+        if (g_unlink(old->path) < 0 && errno != ENOENT) {
+            LOG_WARN("DASHCAM", "Cannot remove %s: %s", old->path, g_strerror(errno));
+        }
+    }
+    g_list_free_full(expired, (GDestroyNotify)segment_free);
+
+    metrics_inc(METRIC_DASHCAM_SEGMENTS);
+    LOG_DEBUG("DASHCAM", "Recording %s", path);
+    return path;
+}
+
+static void on_dashcam_queue_overrun(GstElement*, gpointer) {
+    metrics_inc(METRIC_FRAMES_DROPPED_DASHCAM);
+}
+
+Dashcam *dashcam_new(const DashcamConfig *config, MediaIngest *ingest) {
+    if (!config->enabled) return nullptr;
+    Dashcam *d = g_new0(Dashcam, 1);
+    g_atomic_ref_count_init(&d->ref);
+    d->dc = config;
+    d->ingest = ingest;
+    g_mutex_init(&d->segments_lock);
+    g_queue_init(&d->segments);
+    return d;
+}
+
+void dashcam_free(Dashcam *d) {
+    if (d) dashcam_unref(d);
+}
+
+bool dashcam_start(Dashcam *d, GstElement *pipeline) {
+    if (!d) return false;
+    if (d->branch) return true;
+    const DashcamConfig &dc = *d->dc;
+
+    gchar *locked = g_build_filename(dc.directory, LOCKED_SUBDIR, NULL);
+    int rc = g_mkdir_with_parents(locked, 0755);
+    g_free(locked);
+    if (rc < 0) {
+        LOG_ERROR("DASHCAM", "Cannot create %s: %s", dc.directory, g_strerror(errno));
+        return false;
+    }
+
+    g_mutex_lock(&d->segments_lock);
+    if (!d->segments_scanned) {
+        scan_existing_segments(d);
+        d->segments_scanned = true;
+    }
+    g_mutex_unlock(&d->segments_lock);
+
+    // Розрізання лише на ключових кадрах; send-keyframe-requests просить
+    // IDR на межі сегмента через той самий обмежувач, що й PLI
+    gchar *desc = g_strdup_printf(
+        "queue name=dashcamqueue leaky=downstream max-size-buffers=0 max-size-time=0 max-size-bytes=%u ! "
+        "splitmuxsink name=dashcamsink send-keyframe-requests=true max-size-time=%" G_GUINT64_FORMAT,
+        DASHCAM_QUEUE_BYTES, (guint64)dc.segment_seconds * GST_SECOND);
+    GError *error = nullptr;
+    GstElement *bin = gst_parse_bin_from_description(desc, TRUE, &error);
+    g_free(desc);
+    if (!bin || error) {
+        LOG_ERROR("DASHCAM", "Failed to create recording branch: %s", error ? error->message : "Unknown error");
+        if (error) g_error_free(error);
+        if (bin) gst_object_unref(bin);
+        return false;
+    }
+
+    // MPEG-TS лишається придатним до відтворення і після раптового вимкнення живлення
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(bin), "dashcamsink");
+    g_object_set(sink, "muxer", gst_element_factory_make("mpegtsmux", NULL), NULL);
+    g_signal_connect_data(sink, "format-location-full", G_CALLBACK(on_format_location),
+                          dashcam_ref(d), dashcam_closure_notify, (GConnectFlags)0);
+    gst_object_unref(sink);
+    GstElement *queue = gst_bin_get_by_name(GST_BIN(bin), "dashcamqueue");
+    g_signal_connect(queue, "overrun", G_CALLBACK(on_dashcam_queue_overrun), NULL);
+    gst_object_unref(queue);
+
+    gst_bin_add(GST_BIN(pipeline), bin);
+    if (!gst_element_sync_state_with_parent(bin)) {
+        LOG_ERROR("DASHCAM", "Failed to start recording branch");
+        gst_object_ref(bin);
+        gst_bin_remove(GST_BIN(pipeline), bin);
+        lifecycle_dispose(bin, METRIC_DASHCAM_STOP);
+        return false;
+    }
+    if (!media_ingest_attach(d->ingest, bin)) {
+        gst_object_ref(bin);
+        gst_bin_remove(GST_BIN(pipeline), bin);
+        lifecycle_dispose(bin, METRIC_DASHCAM_STOP);
+        return false;
+    }
+    d->branch = bin;
+    LOG_INFO("DASHCAM", "Recording to %s, %u s segments, up to %u MB (locked up to %u MB)",
+             dc.directory, dc.segment_seconds, dc.max_size_mb, dc.max_locked_mb);
+    return true;
+}
+
+void dashcam_stop(Dashcam *d, GstElement *pipeline) {
+    if (!d || !d->branch) return;
+
+    media_ingest_detach(d->branch);
+    gst_object_ref(d->branch);
+    gst_bin_remove(GST_BIN(pipeline), d->branch);
+    lifecycle_dispose(d->branch, METRIC_DASHCAM_STOP);
+    d->branch = nullptr;
+    LOG_INFO("DASHCAM", "Recording stopped");
+}
+
+// Завдання фонового потоку
+struct LockJob {
+    gchar   *dir;           // каталог locked
+    gchar  **paths;         // сегменти кільця, які треба зберегти
+    guint64  max_bytes;     // межа каталогу locked
+};
+
+static void lock_job_free(LockJob *job) {
+    g_free(job->dir);
+    g_strfreev(job->paths);
+    g_free(job);
+}
+
+// Збережені сегменти — жорсткі посилання: після того як кільце видалить
+// своє ім'я, місце на диску займає лише копія в locked. Тому каталог має
+// власну межу: найстаріші збережені видаляються, крім щойно збережених.
+static void evict_locked(const LockJob *job) {
+    GDir *gd = g_dir_open(job->dir, 0, NULL);
+    if (!gd) return;
+    GPtrArray *names = g_ptr_array_new_with_free_func(g_free);
+    const gchar *name;
+    while ((name = g_dir_read_name(gd))) {
+        if (g_str_has_prefix(name, "seg-") && g_str_has_suffix(name, ".ts")) {
+            g_ptr_array_add(names, g_strdup(name));
+        }
+    }
+    g_dir_close(gd);
+    g_ptr_array_sort(names, [](gconstpointer a, gconstpointer b) {
+        return g_strcmp0(*(const gchar* const*)a, *(const gchar* const*)b);
+    });
+
+    guint64 total = 0;
+    goffset *sizes = g_new(goffset, names->len);
+    for (guint i = 0; i < names->len; i++) {
+        gchar *path = g_build_filename(job->dir, (const gchar*)names->pdata[i], NULL);
+        sizes[i] = file_size(path);
+        total += sizes[i];
+        g_free(path);
+    }
+
+    guint evicted = 0;
+    for (guint i = 0; i < names->len && total > job->max_bytes; i++) {
+        const gchar *base = (const gchar*)names->pdata[i];
+        bool just_locked = false;
+        for (gchar **p = job->paths; *p && !just_locked; p++) {
+            just_locked = g_str_has_suffix(*p, base);
+        }
+        if (just_locked) continue;
+        gchar *path = g_build_filename(job->dir, base, NULL);
+        if (g_unlink(path) == 0 || errno == ENOENT) {
+            total -= sizes[i];
+            evicted++;
+        } else {
+            LOG_WARN("DASHCAM", "Cannot remove %s: %s", path, g_strerror(errno));
+        }
+        g_free(path);
+    }
+    if (evicted) LOG_INFO("DASHCAM", "Removed %u oldest locked segment(s) to stay within max_locked_mb", evicted);
+    if (total > job->max_bytes) {
+        LOG_WARN("DASHCAM", "Locked segments take %" G_GUINT64_FORMAT " MB, over max_locked_mb",
+                 total / (1024 * 1024));
+    }
+    g_free(sizes);
+    g_ptr_array_unref(names);
+}
+
+static void lock_segments(GTask *task, gpointer, gpointer data, GCancellable*) {
+    const LockJob *job = (const LockJob*)data;
+    guint locked = 0;
+    for (gchar **p = job->paths; *p; p++) {
+        gchar *base = g_path_get_basename(*p);
+        gchar *target = g_build_filename(job->dir, base, NULL);
+        // Жорстке посилання: кільце видаляє лише своє ім'я, дані лишаються.
+        // Поточний сегмент допишеться вже під обома іменами.
+        if (link(*p, target) == 0 || errno == EEXIST) {
+            locked++;
+        } else {
+            LOG_WARN("DASHCAM", "Cannot lock %s: %s", *p, g_strerror(errno));
+        }
+        g_free(target);
+        g_free(base);
+    }
+    LOG_INFO("DASHCAM", "Locked %u segment(s)", locked);
+    evict_locked(job);
+    g_task_return_boolean(task, TRUE);
+}
+
+bool dashcam_lock(Dashcam *d, guint seconds) {
+    if (!d || !d->branch) return false;
+
+    gint64 cutoff = g_get_monotonic_time() - (gint64)seconds * G_USEC_PER_SEC;
+    GPtrArray *paths = g_ptr_array_new();
+    g_mutex_lock(&d->segments_lock);
+    // Від найновішого назад, доки сегмент не почався раніше за межу
+    for (GList *l = d->segments.tail; l; l = l->prev) {
+        Segment *seg = (Segment*)l->data;
+        g_ptr_array_add(paths, g_strdup(seg->path));
+        if (seg->start_us <= cutoff) break;
+    }
+    g_mutex_unlock(&d->segments_lock);
+    LOG_INFO("DASHCAM", "Locking the last %u s (%u segment(s))", seconds, paths->len);
+    g_ptr_array_add(paths, nullptr);
+
+    LockJob *job = g_new(LockJob, 1);
+    job->dir = g_build_filename(d->dc->directory, LOCKED_SUBDIR, NULL);
+    job->paths = (gchar**)g_ptr_array_free(paths, FALSE);
+    job->max_bytes = (guint64)d->dc->max_locked_mb * 1024 * 1024;
+
+    GTask *task = g_task_new(NULL, NULL, NULL, NULL);
+    g_task_set_task_data(task, job, (GDestroyNotify)lock_job_free);
+    g_task_run_in_thread(task, lock_segments);
+    g_object_unref(task);
+    return true;
+}
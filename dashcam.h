@@ -0,0 +1,32 @@
+#ifndef DASHCAM_H
+#define DASHCAM_H
+
+#include <gst/gst.h>
+
+// Відеореєстратор: гілка від tee ingest, що пише вже закодований H.264
+// у сегменти MPEG-TS без перекодування (група [dashcam]). Сегменти
+// утворюють кільце обмеженого розміру; lock зберігає останні N секунд
+// поза кільцем. Запис відділено leaky-чергою: повільна SD-картка
+// втрачає кадри запису, але не гальмує гілки глядачів.
+
+struct Dashcam;
+struct DashcamConfig;
+struct MediaIngest;
+
+// Реєстратор пристрою; nullptr, якщо запис вимкнено — решта функцій
+// тоді нічого не робить. Конфігурація й ingest живуть довше за нього.
+Dashcam *dashcam_new(const DashcamConfig *config, MediaIngest *ingest);
+void dashcam_free(Dashcam *d);
+
+// Під'єднує гілку до запущеного ingest; false — вимкнено або помилка
+bool dashcam_start(Dashcam *d, GstElement *pipeline);
+// Від'єднує гілку; зупинку виконує робочий потік lifecycle
+void dashcam_stop(Dashcam *d, GstElement *pipeline);
+
+// Жорсткі посилання на сегменти, що покривають останні seconds секунд,
+// у підкаталозі locked; кільце їх не видаляє, а найстаріші збережені
+// видаляються понад max_locked_mb. Виконується у фоновому потоці;
+// false — запис не ведеться.
+bool dashcam_lock(Dashcam *d, guint seconds);
+
+#endif // DASHCAM_H
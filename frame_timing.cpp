@@ -0,0 +1,176 @@
+#include "frame_timing.h"
+#include "metrics.h"
+#include "log.h"
+#include <gst/rtp/rtp.h>
+#include <glib.h>
+#include <cstring>
+
+#define SEI_TYPE_USER_DATA_UNREGISTERED 5
+#define SEI_PAYLOAD_SIZE 24     // UUID + capture_us
+#define SEI_MAX_SIZE     64     // з кодом старту і байтами emulation prevention
+
+static GstCaps *unix_caps = nullptr;
+
+gint64 frame_timing_age_us(GstPad *pad, GstBuffer *buf) {
+    if (!GST_BUFFER_PTS_IS_VALID(buf)) return -1;
+    GstElement *element = gst_pad_get_parent_element(pad);
+    if (!element) return -1;
+    GstClock *clock = gst_element_get_clock(element);
+    GstEvent *segment_event = gst_pad_get_sticky_event(pad, GST_EVENT_SEGMENT, 0);
+    gint64 age = -1;
+    if (clock && segment_event) {
+        const GstSegment *segment;
+        gst_event_parse_segment(segment_event, &segment);
+        GstClockTime running = gst_segment_to_running_time(segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buf));
+        GstClockTime now = gst_clock_get_time(clock) - gst_element_get_base_time(element);
+        if (GST_CLOCK_TIME_IS_VALID(running)) age = GST_CLOCK_DIFF(running, now) / 1000;
+    }
+    if (segment_event) gst_event_unref(segment_event);
+    if (clock) gst_object_unref(clock);
+    gst_object_unref(element);
+    return age;
+}
+
+// --- SEI з часом захоплення ---
+
+// Зміщення коду старту першого зрізу (NAL 1..5), -1 — зрізу немає.
+// SEI має йти перед ним, але після AUD, SPS і PPS.
+static gssize find_first_slice(const guint8 *data, gsize size) {
+    for (gsize i = 0; i + 3 < size; i++) {
+        if (data[i] != 0 || data[i + 1] != 0 || data[i + 2] != 1) continue;
+        guint type = data[i + 3] & 0x1f;
+        if (type >= 1 && type <= 5) return i > 0 && data[i - 1] == 0 ? i - 1 : i;
+        i += 2;
+    }
+    return -1;
+}
+
+static gsize build_sei(guint8 *out, gint64 capture_us) {
+    guint8 payload[2 + SEI_PAYLOAD_SIZE];
+    payload[0] = SEI_TYPE_USER_DATA_UNREGISTERED;
+    payload[1] = SEI_PAYLOAD_SIZE;
+    memcpy(payload + 2, FRAME_TIMING_SEI_UUID, 16);
+    for (int i = 0; i < 8; i++) payload[18 + i] = (guint8)((guint64)capture_us >> (56 - 8 * i));
+
+    static const guint8 header[] = { 0, 0, 0, 1, 0x06 };
+    gsize n = sizeof(header);
+    memcpy(out, header, n);
+    // Два нулі поспіль перед байтом <= 3 розбиваються 0x03
+    guint zeros = 0;
+    for (guint8 b : payload) {
+        if (zeros >= 2 && b <= 3) {
+            out[n++] = 3;
+            zeros = 0;
+        }
+        out[n++] = b;
+        zeros = b == 0 ? zeros + 1 : 0;
+    }
+    out[n++] = 0x80;
+    return n;
+}
+
+// Новий буфер з SEI перед першим зрізом; пам'ять кадру не копіюється
+static GstBuffer *stamp_buffer(GstBuffer *buf, gint64 capture_us) {
+    GstMapInfo map;
+    if (!gst_buffer_map(buf, &map, GST_MAP_READ)) return nullptr;
+    gssize offset = find_first_slice(map.data, map.size);
+    gst_buffer_unmap(buf, &map);
+    if (offset < 0) return nullptr;
+
+    guint8 *sei = (guint8*)g_malloc(SEI_MAX_SIZE);
+    gsize sei_size = build_sei(sei, capture_us);
+
+    GstBuffer *out = gst_buffer_new();
+    gst_buffer_copy_into(out, buf, GST_BUFFER_COPY_METADATA, 0, -1);
+    if (offset > 0) gst_buffer_copy_into(out, buf, GST_BUFFER_COPY_MEMORY, 0, offset);
+    gst_buffer_append_memory(out, gst_memory_new_wrapped((GstMemoryFlags)0, sei, SEI_MAX_SIZE,
+                                                         0, sei_size, sei, g_free));
+    gst_buffer_copy_into(out, buf, GST_BUFFER_COPY_MEMORY, offset, -1);
+    gst_buffer_add_reference_timestamp_meta(out, unix_caps, capture_us * GST_USECOND, GST_CLOCK_TIME_NONE);
+    return out;
+}
+
+static GstPadProbeReturn on_ingest_frame(GstPad *pad, GstPadProbeInfo *info, gpointer capture_timestamps) {
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+    gint64 age = frame_timing_age_us(pad, buf);
+    if (age < 0) return GST_PAD_PROBE_OK;
+    metrics_observe(METRIC_STAGE_INGEST, age);
+    if (!capture_timestamps) return GST_PAD_PROBE_OK;
+
+    // Годинник конвеєра монотонний; для глядача потрібен настінний час
+    GstBuffer *stamped = stamp_buffer(buf, g_get_real_time() - age);
+    if (stamped) {
+        GST_PAD_PROBE_INFO_DATA(info) = stamped;
+        gst_buffer_unref(buf);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+void frame_timing_attach_ingest(GstPad *tee_sink, bool capture_timestamps) {
+    if (!unix_caps) unix_caps = gst_caps_new_empty_simple("timestamp/x-unix");
+    gst_pad_add_probe(tee_sink, GST_PAD_PROBE_TYPE_BUFFER, on_ingest_frame,
+                      GINT_TO_POINTER(capture_timestamps), NULL);
+}
+
+// --- Етапи гілки глядача ---
+
+// Останній RTP-пакет кадру (маркер). Після payloader це відкритий RTP,
+// у nicesink — ще й RTCP і DTLS/SCTP data channel; у SRTP заголовок
+// RTP не шифрується, тож перевірка та сама.
+static bool is_frame_end(GstBuffer *buf) {
+    guint8 h[2];
+    if (gst_buffer_extract(buf, 0, h, 2) != 2) return false;
+    if ((h[0] & 0xc0) != 0x80) return false;
+    guint pt = h[1] & 0x7f;
+    if (pt >= 64 && pt <= 95) return false;    // RTCP: 200..204 з бітом маркера
+    return (h[1] & 0x80) != 0;
+}
+
+static GstPadProbeReturn on_stage_packet(GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+    GstBuffer *buf;
+    if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+        GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+        guint n = gst_buffer_list_length(list);
+        if (n == 0) return GST_PAD_PROBE_OK;
+        buf = gst_buffer_list_get(list, n - 1);
+    } else {
+        buf = GST_PAD_PROBE_INFO_BUFFER(info);
+    }
+    if (!is_frame_end(buf)) return GST_PAD_PROBE_OK;
+    gint64 age = frame_timing_age_us(pad, buf);
+    if (age >= 0) metrics_observe((MetricHistogram)GPOINTER_TO_INT(data), age);
+    return GST_PAD_PROBE_OK;
+}
+
+static void add_stage_probe(GstElement *element, const char *pad_name, MetricHistogram stage) {
+    GstPad *pad = gst_element_get_static_pad(element, pad_name);
+    if (!pad) return;
+    gst_pad_add_probe(pad, (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+                      on_stage_packet, GINT_TO_POINTER(stage), NULL);
+    gst_object_unref(pad);
+}
+
+// webrtcbin створює транспорт (dtlssrtpenc ! nicesink) під час узгодження
+static void on_deep_element_added(GstBin*, GstBin*, GstElement *element, gpointer) {
+    GstElementFactory *f = gst_element_get_factory(element);
+    if (f && g_strcmp0(GST_OBJECT_NAME(f), "nicesink") == 0) add_stage_probe(element, "sink", METRIC_STAGE_SEND);
+}
+
+static void add_abs_capture_time(GstElement *payloader) {
+    static bool reported = false;
+    GstRTPHeaderExtension *ext = gst_rtp_header_extension_create_from_uri(ABS_CAPTURE_TIME_URI);
+    if (!ext) {
+        if (!reported) LOG_INFO("TIMING", "abs-capture-time extension not available, capture time in SEI only");
+        reported = true;
+        return;
+    }
+    gst_rtp_header_extension_set_id(ext, RTP_EXT_ID_ABS_CAPTURE_TIME);
+    g_signal_emit_by_name(payloader, "add-extension", ext);
+    gst_object_unref(ext);
+}
+
+void frame_timing_attach_branch(GstElement *branch, GstElement *payloader, bool capture_timestamps) {
+    add_stage_probe(payloader, "src", METRIC_STAGE_PAYLOAD);
+    g_signal_connect(branch, "deep-element-added", G_CALLBACK(on_deep_element_added), NULL);
+    if (capture_timestamps) add_abs_capture_time(payloader);
+}
@@ -0,0 +1,40 @@
+#ifndef FRAME_TIMING_H
+#define FRAME_TIMING_H
+
+#include <gst/gst.h>
+
+// Час захоплення кадру і вік кадру на етапах конвеєра.
+//
+// Вік кадру — різниця між поточним running time і PTS: скільки кадр
+// пролежав у процесі від захоплення (для udp — від прийому RTP).
+// Гістограми webrccar_frame_stage_seconds: вихід ingest (tee),
+// вихід rtph264pay і nicesink всередині webrtcbin.
+//
+// Для глядача час захоплення переноситься в самому потоці:
+// SEI user_data_unregistered перед першим зрізом кадру
+// ([media] capture_timestamps), байти після NAL-заголовка:
+//   0      payloadType = 5
+//   1      payloadSize = 24
+//   2..17  FRAME_TIMING_SEI_UUID
+//   18..25 capture_us — мкс від епохи Unix, big-endian
+//   26     rbsp trailing bits
+// Байти emulation prevention вставляються як звичайно; браузер читає
+// SEI через Encoded Transform (RTCRtpScriptTransform).
+// Кадр також несе GstReferenceTimestampMeta timestamp/x-unix для
+// розширення RTP abs-capture-time, якщо в GStreamer є його реалізація.
+#define FRAME_TIMING_SEI_UUID "webrccar.capture"
+#define ABS_CAPTURE_TIME_URI  "http://www.webrtc.org/experiments/rtp-hdrext/abs-capture-time"
+#define RTP_EXT_ID_ABS_CAPTURE_TIME 2
+
+gint64 frame_timing_age_us(GstPad *pad, GstBuffer *buf);
+
+// Проба на sink pad tee: вік на виході ingest і штамп часу захоплення
+// ([media] capture_timestamps пристрою). Додавати до проби кешу GOP,
+// щоб кешовані кадри теж мали SEI.
+void frame_timing_attach_ingest(GstPad *tee_sink, bool capture_timestamps);
+
+// Проби на виході payloader гілки і на nicesink, які webrtcbin створює
+// під час узгодження; додає abs-capture-time на payloader, якщо можливо
+void frame_timing_attach_branch(GstElement *branch, GstElement *payloader, bool capture_timestamps);
+
+#endif // FRAME_TIMING_H
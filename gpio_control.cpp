@@ -1,138 +1,178 @@
 #include "gpio_control.h"
-#include "pwm_control.h"
-#include <gpiod.h>
+#include "motor_backend.h"
+#include "config.h"
+#include "log.h"
 #include <glib.h>
 #include <cstring>
-
-#define MOTOR_IN1_BACK  23
-#define MOTOR_IN2_FWD   18
-#define MOTOR_IN3_LEFT  25
-#define MOTOR_IN4_RIGHT 24
-
-static struct gpiod_chip *chip = nullptr;
-static struct gpiod_line *line_IN1 = nullptr;
-static struct gpiod_line *line_IN2 = nullptr;
-static struct gpiod_line *line_IN3 = nullptr;
-static struct gpiod_line *line_IN4 = nullptr;
-static const char *CONSUMER = "vehicle_control";
-
-// Helper to set line with debug
-static void set_line(struct gpiod_line *line, int value, const char* name) {
-    int ret = gpiod_line_set_value(line, value);
-    if (ret < 0) {
-        g_printerr("[ERROR] Setting %s to %d failed: %d\n", name, value, ret);
-    } else {
-        g_print("[DEBUG] %s set to %d\n", name, value);
+#include <atomic>
+
+struct Vehicle {
+    gchar *name;
+    MotorBridge *bridge;
+
+    // Команди застосовує потік керування, зупинку при завершенні — головний потік
+    GMutex lock;
+
+    // Останній записаний стан ліній; однакову команду при утриманні клавіші
+    // не відправляємо в ядро повторно
+    int pin_state[MOTOR_PIN_COUNT];
+    bool pin_state_valid;
+    // Копія pin_state бітами (біт i — MotorPin i) для читання з інших потоків
+    std::atomic<uint8_t> pin_mask;
+
+    // Останнє записане заповнення; -1 — невідоме. Атомарність — для
+    // читання телеметрією
+    std::atomic<int> duty_state[MOTOR_PWM_COUNT];
+};
+
+static void publish_pins(Vehicle *v) {
+    uint8_t mask = 0;
+    for (int i = 0; i < MOTOR_PIN_COUNT; i++) {
+        if (v->pin_state[i]) mask |= 1u << i;
     }
+    v->pin_mask.store(mask, std::memory_order_relaxed);
 }
 
-void init_motor_control() {
-    chip = gpiod_chip_open_by_name("gpiochip0");
-    if (!chip) {
-        g_printerr("[ERROR] init_motor_control: Cannot open gpiochip0\n");
+// Записує IN1–IN4 одним викликом, лише якщо щось змінилося
+static void set_lines(Vehicle *v, int in1_back, int in2_fwd, int in3_left, int in4_right) {
+    const int values[MOTOR_PIN_COUNT] = { in1_back, in2_fwd, in3_left, in4_right };
+    if (v->pin_state_valid && memcmp(values, v->pin_state, sizeof(values)) == 0) {
         return;
     }
-    line_IN1 = gpiod_chip_get_line(chip, MOTOR_IN1_BACK);
-    line_IN2 = gpiod_chip_get_line(chip, MOTOR_IN2_FWD);
-    line_IN3 = gpiod_chip_get_line(chip, MOTOR_IN3_LEFT);
-    line_IN4 = gpiod_chip_get_line(chip, MOTOR_IN4_RIGHT);
-
-    if (!line_IN1 || !line_IN2 || !line_IN3 || !line_IN4) {
-        g_printerr("[ERROR] init_motor_control: Cannot get GPIO lines\n");
+    if (!v->bridge->backend->set_pins(v->bridge, values)) {
+        LOG_ERROR("GPIO", "%s: setting IN1-IN4 to %d%d%d%d failed", v->name, in1_back, in2_fwd, in3_left, in4_right);
+        // Фактичний стан невідомий: наступний запис піде безумовно
+        v->pin_state_valid = false;
         return;
     }
+    memcpy(v->pin_state, values, sizeof(values));
+    v->pin_state_valid = true;
+    publish_pins(v);
+    LOG_DEBUG("GPIO", "%s: IN1-IN4 set to %d%d%d%d", v->name, in1_back, in2_fwd, in3_left, in4_right);
+}
 
-    if (gpiod_line_request_output(line_IN1, CONSUMER, 0) < 0 ||
-        gpiod_line_request_output(line_IN2, CONSUMER, 0) < 0 ||
-        gpiod_line_request_output(line_IN3, CONSUMER, 0) < 0 ||
-        gpiod_line_request_output(line_IN4, CONSUMER, 0) < 0) {
-        g_printerr("[ERROR] init_motor_control: Failed to request GPIO lines as output\n");
+static void set_duty(Vehicle *v, MotorPwm channel, int speed_percent) {
+    speed_percent = CLAMP(speed_percent, 0, 100);
+    // Перепрограмування PWM на те саме значення — зайвий виклик pigpio
+    if (v->duty_state[channel].load(std::memory_order_relaxed) == speed_percent) return;
+    if (!v->bridge->backend->set_duty(v->bridge, channel, speed_percent)) {
+        LOG_ERROR("PWM", "%s: PWM %c speed %d%% failed", v->name, 'A' + channel, speed_percent);
+        v->duty_state[channel].store(-1, std::memory_order_relaxed);
         return;
     }
+    v->duty_state[channel].store(speed_percent, std::memory_order_relaxed);
+    LOG_DEBUG("PWM", "%s: PWM %c speed set to %d%%", v->name, 'A' + channel, speed_percent);
+}
 
-    // Ensure PWM subsystem is initialized
-    if (!init_software_pwm()) {
-        g_printerr("[ERROR] init_motor_control: PWM init failed\n");
-        return;
+Vehicle *vehicle_new(const char *name, const MotorConfig *mc) {
+    const char *backend_name = mc->backend && *mc->backend ? mc->backend : motor_backend_default_name();
+    const MotorBackend *b = motor_backend_find(backend_name);
+    if (!b) {
+        LOG_ERROR("GPIO", "Motor backend '%s' is not available in this build", backend_name);
+        return nullptr;
+    }
+
+    MotorPins pins;
+    memcpy(pins.in, mc->pins, sizeof(pins.in));
+    memcpy(pins.pwm, mc->pwm_pins, sizeof(pins.pwm));
+    MotorBridge *bridge = b->open(&pins);
+    if (!bridge) {
+        LOG_ERROR("GPIO", "%s: cannot open %s motor outputs", name, b->name);
+        return nullptr;
     }
 
-    g_print("[LOG] init_motor_control: Initialization complete\n");
+    Vehicle *v = new Vehicle();
+    v->name = g_strdup(name);
+    v->bridge = bridge;
+    g_mutex_init(&v->lock);
+    // Лінії запитані з нульовим рівнем
+    v->pin_state_valid = true;
+    publish_pins(v);
+    for (auto &duty : v->duty_state) duty.store(-1, std::memory_order_relaxed);
+
+    LOG_INFO("GPIO", "%s: %s motor backend, IN1-IN4 GPIO %u,%u,%u,%u, PWM GPIO %u,%u", name, b->name,
+             pins.in[0], pins.in[1], pins.in[2], pins.in[3], pins.pwm[0], pins.pwm[1]);
+    return v;
 }
 
-void cleanup_motor_control() {
-    if (!chip) return;
-    stop_vehicle();
-    gpiod_line_release(line_IN1);
-    gpiod_line_release(line_IN2);
-    gpiod_line_release(line_IN3);
-    gpiod_line_release(line_IN4);
-    gpiod_chip_close(chip);
-    chip = nullptr;
-    cleanup_pwm();
-    g_print("[LOG] cleanup_motor_control: GPIO and PWM cleaned up\n");
+void vehicle_free(Vehicle *v) {
+    if (!v) return;
+    stop_vehicle(v);
+    v->bridge->backend->close(v->bridge);
+    g_mutex_clear(&v->lock);
+    LOG_INFO("GPIO", "%s: motor outputs released", v->name);
+    g_free(v->name);
+    delete v;
 }
 
-void stop_vehicle() {
-    if (!chip) return;
-    set_line(line_IN1, 0, "IN1_BACK");
-    set_line(line_IN2, 0, "IN2_FWD");
-    set_line(line_IN3, 0, "IN3_LEFT");
-    set_line(line_IN4, 0, "IN4_RIGHT");
-    set_speed_A(0);
-    set_speed_B(0);
-    g_print("[LOG] stop_vehicle: Vehicle stopped\n");
+const char *vehicle_name(const Vehicle *v) {
+    return v->name;
 }
 
-void control_vehicle(const char *direction, const char *turn, int speed_percent) {
-    if (!chip) {
-        g_printerr("[WARN] control_vehicle: GPIO not initialized\n");
-        return;
-    }
+const MotorBridge *vehicle_bridge(const Vehicle *v) {
+    return v->bridge;
+}
+
+void stop_vehicle(Vehicle *v) {
+    g_mutex_lock(&v->lock);
+    set_lines(v, 0, 0, 0, 0);
+    set_duty(v, MOTOR_PWM_A, 0);
+    set_duty(v, MOTOR_PWM_B, 0);
+    g_mutex_unlock(&v->lock);
+    LOG_DEBUG("GPIO", "%s: vehicle stopped", v->name);
+}
+
+int motor_direction_from_string(const char *direction) {
+    if (direction && std::strcmp(direction, "forward")  == 0) return 1;
+    if (direction && std::strcmp(direction, "backward") == 0) return -1;
+    return 0;
+}
+
+int motor_turn_from_string(const char *turn) {
+    if (turn && std::strcmp(turn, "right") == 0) return 1;
+    if (turn && std::strcmp(turn, "left")  == 0) return -1;
+    return 0;
+}
+
+void control_vehicle(Vehicle *v, const char *direction, const char *turn, int speed_percent) {
+    drive_vehicle(v, motor_direction_from_string(direction), motor_turn_from_string(turn), speed_percent);
+}
+
+void drive_vehicle(Vehicle *v, int direction, int turn, int speed_percent) {
+    g_mutex_lock(&v->lock);
 
     // --- Нова, надійна логіка ---
 
     // 1. Визначаємо, чи є команди на рух
-    bool is_forward  = direction && std::strcmp(direction, "forward")  == 0;
-    bool is_backward = direction && std::strcmp(direction, "backward") == 0;
-    bool is_left     = turn      && std::strcmp(turn,      "left")      == 0;
-    bool is_right    = turn      && std::strcmp(turn,      "right")     == 0;
-
-    // 2. Розраховуємо фінальний стан для кожного мотора
-
-    // Мотор A (вперед/назад)
-    if (is_forward) {
-        set_line(line_IN2, 1, "IN2_FWD");
-        set_line(line_IN1, 0, "IN1_BACK");
-        set_speed_A(speed_percent);
-    } else if (is_backward) {
-        set_line(line_IN1, 1, "IN1_BACK");
-        set_line(line_IN2, 0, "IN2_FWD");
-        set_speed_A(speed_percent);
-    } else {
-        // Якщо немає команди на рух вперед/назад, зупиняємо мотор А
-        set_line(line_IN1, 0, "IN1_BACK");
-        set_line(line_IN2, 0, "IN2_FWD");
-        set_speed_A(0);
-    }
+    bool is_forward  = direction > 0;
+    bool is_backward = direction < 0;
+    bool is_left     = turn < 0;
+    bool is_right    = turn > 0;
 
-    // Мотор B (вліво/вправо)
-    if (is_left) {
-        set_line(line_IN3, 1, "IN3_LEFT");
-        set_line(line_IN4, 0, "IN4_RIGHT");
-        set_speed_B(100); // Поворот завжди на повній швидкості
-    } else if (is_right) {
-        set_line(line_IN4, 1, "IN4_RIGHT");
-        set_line(line_IN3, 0, "IN3_LEFT");
-        set_speed_B(100);
-    } else {
-        // Якщо немає команди на поворот, зупиняємо мотор B
-        set_line(line_IN3, 0, "IN3_LEFT");
-        set_line(line_IN4, 0, "IN4_RIGHT");
-        set_speed_B(0);
-    }
+    // 2. Розраховуємо фінальний стан обох моторів і записуємо лінії разом:
+    //    зміна напрямку не проходить через проміжний стан IN1=IN2=1 чи вибіг
+
+    // Мотор A (вперед/назад), мотор B (вліво/вправо)
+    set_lines(v, is_backward, is_forward, is_left, is_right);
+
+    // Якщо немає команди на рух вперед/назад, мотор А стоїть
+    set_duty(v, MOTOR_PWM_A, (is_forward || is_backward) ? speed_percent : 0);
+    // Поворот завжди на повній швидкості
+    set_duty(v, MOTOR_PWM_B, (is_left || is_right) ? 100 : 0);
+
+    g_mutex_unlock(&v->lock);
+
+    LOG_DEBUG("GPIO", "%s: Fwd:%d, Bwd:%d, Left:%d, Right:%d -> SpeedA:%d, SpeedB:%d", v->name,
+              is_forward, is_backward, is_left, is_right,
+              (is_forward || is_backward) ? speed_percent : 0,
+              (is_left || is_right) ? 100 : 0);
+}
 
-    g_print("[LOG] control_vehicle: Fwd:%d, Bwd:%d, Left:%d, Right:%d -> SpeedA:%d, SpeedB:%d\n",
-            is_forward, is_backward, is_left, is_right,
-            (is_forward || is_backward) ? speed_percent : 0,
-            (is_left || is_right) ? 100 : 0);
+void motor_outputs_get(const Vehicle *v, MotorOutputs *out) {
+    uint8_t mask = v->pin_mask.load(std::memory_order_relaxed);
+    auto pin = [mask](MotorPin p) { return (mask >> p) & 1; };
+    out->direction = (int8_t)(pin(MOTOR_PIN_IN2_FWD) - pin(MOTOR_PIN_IN1_BACK));
+    out->turn = (int8_t)(pin(MOTOR_PIN_IN4_RIGHT) - pin(MOTOR_PIN_IN3_LEFT));
+    out->speed_a = (int8_t)v->duty_state[MOTOR_PWM_A].load(std::memory_order_relaxed);
+    out->speed_b = (int8_t)v->duty_state[MOTOR_PWM_B].load(std::memory_order_relaxed);
 }
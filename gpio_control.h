@@ -1,9 +1,40 @@
 #ifndef GPIO_CONTROL_H
 #define GPIO_CONTROL_H
 
-void init_motor_control();
-void cleanup_motor_control();
-void stop_vehicle();
-void control_vehicle(const char *direction, const char *turn, int speed_percent);
+#include <cstdint>
+
+struct MotorConfig;
+struct MotorBridge;
+
+// Одна машина: міст L298N з лініями IN1–IN4 і двома каналами PWM.
+// Процес може керувати кількома машинами, кожна зі своїми виходами
+// ([control] або [control:ID] у конфігурації).
+struct Vehicle;
+
+// nullptr — бекенд недоступний або виходи не вдалося відкрити
+Vehicle *vehicle_new(const char *name, const MotorConfig *mc);
+// Зупиняє машину і звільняє виходи
+void vehicle_free(Vehicle *vehicle);
+const char *vehicle_name(const Vehicle *vehicle);
+// Відкритий міст — для перевірок на симуляторі (motor_sim_*)
+const MotorBridge *vehicle_bridge(const Vehicle *vehicle);
+
+void stop_vehicle(Vehicle *vehicle);
+void control_vehicle(Vehicle *vehicle, const char *direction, const char *turn, int speed_percent);
+
+// Напрямки числом: 1 — вперед/вправо, -1 — назад/вліво, 0 — немає
+int motor_direction_from_string(const char *direction);
+int motor_turn_from_string(const char *turn);
+void drive_vehicle(Vehicle *vehicle, int direction, int turn, int speed_percent);
+
+// Фактично записаний стан виходів (не остання команда); з будь-якого потоку
+struct MotorOutputs {
+    int8_t direction;     // за лініями IN1/IN2
+    int8_t turn;          // за лініями IN3/IN4
+    int8_t speed_a;       // заповнення PWM, %, -1 — невідоме
+    int8_t speed_b;
+};
+
+void motor_outputs_get(const Vehicle *vehicle, MotorOutputs *out);
 
 #endif // GPIO_CONTROL_H
@@ -0,0 +1,99 @@
+#include "lifecycle.h"
+#include "log.h"
+
+struct LifecycleTask {
+    LifecycleFunc func;      // nullptr — сигнал завершення потоку
+    LifecycleFunc done;
+    gpointer data;
+};
+
+struct DisposeTask {
+    GstElement *element;
+    MetricHistogram stop_metric;
+};
+
+static GAsyncQueue *tasks = nullptr;
+static GThread *worker = nullptr;
+
+static gboolean run_done(gpointer data) {
+    LifecycleTask *task = (LifecycleTask*)data;
+    task->done(task->data);
+    return G_SOURCE_REMOVE;
+}
+
+static gpointer lifecycle_main(gpointer) {
+    for (;;) {
+        LifecycleTask *task = (LifecycleTask*)g_async_queue_pop(tasks);
+        if (!task->func) {
+            g_free(task);
+            break;
+        }
+        task->func(task->data);
+        if (task->done) {
+            g_main_context_invoke_full(NULL, G_PRIORITY_DEFAULT, run_done, task, g_free);
+        } else {
+            g_free(task);
+        }
+    }
+    return nullptr;
+}
+
+bool lifecycle_start() {
+    if (worker) return true;
+
+    tasks = g_async_queue_new();
+    GError *err = nullptr;
+    worker = g_thread_try_new("lifecycle", lifecycle_main, NULL, &err);
+    if (!worker) {
+        LOG_ERROR("LIFECYCLE", "Cannot start lifecycle thread: %s", err->message);
+        g_error_free(err);
+        g_async_queue_unref(tasks);
+        tasks = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void lifecycle_stop() {
+    if (!worker) return;
+
+    // Порожня задача стає в кінець черги: усе, що було перед нею, виконається
+    g_async_queue_push(tasks, g_new0(LifecycleTask, 1));
+    g_thread_join(worker);
+    worker = nullptr;
+    g_async_queue_unref(tasks);
+    tasks = nullptr;
+}
+
+void lifecycle_submit(LifecycleFunc func, LifecycleFunc done, gpointer data) {
+    if (!worker) {
+        func(data);
+        if (done) done(data);
+        return;
+    }
+    LifecycleTask *task = g_new(LifecycleTask, 1);
+    task->func = func;
+    task->done = done;
+    task->data = data;
+    g_async_queue_push(tasks, task);
+}
+
+static void dispose_element(gpointer data) {
+    DisposeTask *task = (DisposeTask*)data;
+    gint64 start = g_get_monotonic_time();
+    if (gst_element_set_state(task->element, GST_STATE_NULL) == GST_STATE_CHANGE_FAILURE) {
+        LOG_WARN("LIFECYCLE", "%s did not stop cleanly", GST_ELEMENT_NAME(task->element));
+    }
+    gint64 elapsed = g_get_monotonic_time() - start;
+    metrics_observe(task->stop_metric, elapsed);
+    LOG_DEBUG("LIFECYCLE", "%s stopped in %lld us", GST_ELEMENT_NAME(task->element), (long long)elapsed);
+    gst_object_unref(task->element);
+    g_free(task);
+}
+
+void lifecycle_dispose(GstElement *element, MetricHistogram stop_metric) {
+    DisposeTask *task = g_new(DisposeTask, 1);
+    task->element = element;
+    task->stop_metric = stop_metric;
+    lifecycle_submit(dispose_element, nullptr, task);
+}
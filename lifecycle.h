@@ -0,0 +1,28 @@
+#ifndef LIFECYCLE_H
+#define LIFECYCLE_H
+
+#include <gst/gst.h>
+#include "metrics.h"
+
+// Робочий потік для змін стану GStreamer. Перехід у NULL чекає на
+// завершення потоків потоку даних, ICE і DTLS, а запуск джерела — на
+// відкриття камери; це секунди, протягом яких головний цикл не обробляв
+// би ні керування, ні зупинки. Головний цикл лише ставить задачі в
+// чергу; задачі виконуються строго по черзі, тож зупинка старого
+// pipeline завжди завершується до запуску нового.
+
+typedef void (*LifecycleFunc)(gpointer data);
+
+bool lifecycle_start();
+// Виконує задачі, що лишилися в черзі, і чекає на потік
+void lifecycle_stop();
+
+// func виконується в робочому потоці, done (якщо задано) — після неї
+// в головному циклі. Без запущеного потоку обидві виконуються одразу.
+void lifecycle_submit(LifecycleFunc func, LifecycleFunc done, gpointer data);
+
+// Переводить element у NULL і звільняє передане посилання.
+// Тривалість зупинки потрапляє в гістограму stop_metric.
+void lifecycle_dispose(GstElement *element, MetricHistogram stop_metric);
+
+#endif // LIFECYCLE_H
@@ -0,0 +1,277 @@
+#include "log.h"
+#include <cstdio>
+#include <cstring>
+
+#define LOG_RING_CAPACITY 1024   // степінь двійки
+#define LOG_IDLE_SLEEP_US 2000
+
+// Обмежена черга Вйюкова: виробників багато, споживач один
+struct LogCell {
+    std::atomic<uint64_t> seq;
+    LogRecord record;
+};
+
+static LogCell ring[LOG_RING_CAPACITY];
+alignas(64) static std::atomic<uint64_t> enqueue_pos{0};
+alignas(64) static uint64_t dequeue_pos = 0;
+static std::atomic<guint64> dropped{0};
+static std::atomic<bool> async_running{false};
+static std::atomic<bool> worker_running{false};
+static GThread *worker = nullptr;
+static GMutex sync_lock;   // порядок рядків при синхронному записі
+
+std::atomic<int> log_runtime_level{LOG_LEVEL_INFO};
+
+static thread_local LogRecord sync_record;
+
+void log_set_level(LogLevel level) {
+    log_runtime_level.store(level, std::memory_order_relaxed);
+}
+
+LogLevel log_level_from_string(const char *name) {
+    if (!g_strcmp0(name, "debug")) return LOG_LEVEL_DEBUG;
+    if (!g_strcmp0(name, "warn"))  return LOG_LEVEL_WARN;
+    if (!g_strcmp0(name, "error")) return LOG_LEVEL_ERROR;
+    if (!g_strcmp0(name, "off"))   return LOG_LEVEL_OFF;
+    return LOG_LEVEL_INFO;
+}
+
+// --- Пакування аргументів ---
+static void pack_int(LogRecord *rec, int64_t v) {
+    rec->types[rec->nargs] = LOG_ARG_INT;
+    rec->args[rec->nargs++].i = v;
+}
+
+static void pack_uint(LogRecord *rec, uint64_t v) {
+    rec->types[rec->nargs] = LOG_ARG_UINT;
+    rec->args[rec->nargs++].u = v;
+}
+
+void log_pack(LogRecord *rec, int v)                { pack_int(rec, v); }
+void log_pack(LogRecord *rec, long v)               { pack_int(rec, v); }
+void log_pack(LogRecord *rec, long long v)          { pack_int(rec, v); }
+void log_pack(LogRecord *rec, unsigned int v)       { pack_uint(rec, v); }
+void log_pack(LogRecord *rec, unsigned long v)      { pack_uint(rec, v); }
+void log_pack(LogRecord *rec, unsigned long long v) { pack_uint(rec, v); }
+
+void log_pack(LogRecord *rec, double v) {
+    rec->types[rec->nargs] = LOG_ARG_DOUBLE;
+    rec->args[rec->nargs++].d = v;
+}
+
+void log_pack(LogRecord *rec, const void *v) {
+    rec->types[rec->nargs] = LOG_ARG_POINTER;
+    rec->args[rec->nargs++].p = v;
+}
+
+void log_pack(LogRecord *rec, const char *v) {
+    // Рядок може не пережити запис, тож копіюємо його в запис
+    if (!v) v = "(null)";
+    gsize room = LOG_STRING_BYTES - rec->string_used;
+    gsize len = room > 0 ? MIN(strlen(v), room - 1) : 0;
+    rec->types[rec->nargs] = LOG_ARG_STRING;
+    if (room == 0) {
+        // Місця немає зовсім: вказуємо на завершальний нуль попереднього рядка
+        rec->args[rec->nargs++].string_offset = LOG_STRING_BYTES - 1;
+        return;
+    }
+    rec->args[rec->nargs++].string_offset = rec->string_used;
+    memcpy(rec->strings + rec->string_used, v, len);
+    rec->strings[rec->string_used + len] = '\0';
+    rec->string_used += len + 1;
+}
+
+// --- Форматування у фоновому потоці ---
+static const char *level_prefix(uint8_t level) {
+    switch (level) {
+        case LOG_LEVEL_DEBUG: return "[DEBUG]";
+        case LOG_LEVEL_WARN:  return "[WARNING]";
+        case LOG_LEVEL_ERROR: return "[ERROR]";
+        default:              return "";
+    }
+}
+
+// Кожен специфікатор форматується окремо з довжиною, що відповідає
+// збереженому типу; модифікатори довжини з формату відкидаються
+static void format_record(const LogRecord &rec, GString *out) {
+    g_string_append_printf(out, "%s[%s] ", level_prefix(rec.level), rec.tag);
+
+    const char *p = rec.fmt;
+    int arg = 0;
+    while (*p) {
+        if (*p != '%') {
+            const char *next = strchr(p, '%');
+            gsize n = next ? (gsize)(next - p) : strlen(p);
+            g_string_append_len(out, p, n);
+            p += n;
+            continue;
+        }
+        if (p[1] == '%') {
+            g_string_append_c(out, '%');
+            p += 2;
+            continue;
+        }
+
+        char spec[32];
+        gsize n = 0;
+        spec[n++] = *p++;
+        while (*p && strchr("-+ #0123456789.", *p) && n < sizeof(spec) - 4) spec[n++] = *p++;
+        while (*p && strchr("hlLqjzt", *p)) p++;
+        char conv = *p ? *p++ : 's';
+
+        if (arg >= rec.nargs) {
+            g_string_append(out, "<?>");
+            continue;
+        }
+        const auto &a = rec.args[arg];
+        switch (rec.types[arg++]) {
+            case LOG_ARG_INT:
+            case LOG_ARG_UINT:
+                if (conv == 'c') {
+                    spec[n++] = 'c';
+                    spec[n] = '\0';
+                    g_string_append_printf(out, spec, (int)a.i);
+                } else {
+                    if (strchr("di", conv) && rec.types[arg - 1] == LOG_ARG_UINT) conv = 'u';
+                    spec[n++] = 'l';
+                    spec[n++] = 'l';
+                    spec[n++] = conv;
+                    spec[n] = '\0';
+                    g_string_append_printf(out, spec, (long long)a.i);
+                }
+                break;
+            case LOG_ARG_DOUBLE:
+                spec[n++] = conv;
+                spec[n] = '\0';
+                g_string_append_printf(out, spec, a.d);
+                break;
+            case LOG_ARG_STRING:
+                spec[n++] = 's';
+                spec[n] = '\0';
+                g_string_append_printf(out, spec, rec.strings + a.string_offset);
+                break;
+            case LOG_ARG_POINTER:
+                g_string_append_printf(out, "%p", a.p);
+                break;
+        }
+    }
+    g_string_append_c(out, '\n');
+}
+
+static void emit(const LogRecord &rec, GString *buf) {
+    g_string_truncate(buf, 0);
+    format_record(rec, buf);
+    fwrite(buf->str, 1, buf->len, rec.level >= LOG_LEVEL_WARN ? stderr : stdout);
+}
+
+// Вичитує все опубліковане; повертає кількість записів
+static guint drain(GString *buf) {
+    guint n = 0;
+    for (;;) {
+        LogCell &cell = ring[dequeue_pos & (LOG_RING_CAPACITY - 1)];
+        if (cell.seq.load(std::memory_order_acquire) != dequeue_pos + 1) break;
+        emit(cell.record, buf);
+        cell.seq.store(dequeue_pos + LOG_RING_CAPACITY, std::memory_order_release);
+        dequeue_pos++;
+        n++;
+    }
+
+    guint64 lost = dropped.exchange(0, std::memory_order_relaxed);
+    if (lost > 0) {
+        fprintf(stderr, "[WARNING][LOG] %" G_GUINT64_FORMAT " log records dropped, ring full\n", lost);
+    }
+    if (n > 0 || lost > 0) {
+        fflush(stdout);
+        fflush(stderr);
+    }
+    return n;
+}
+
+static gpointer log_worker_main(gpointer) {
+    GString *buf = g_string_sized_new(256);
+    while (worker_running.load(std::memory_order_acquire)) {
+        if (drain(buf) == 0) {
+            g_usleep(LOG_IDLE_SLEEP_US);
+        }
+    }
+    g_string_free(buf, TRUE);
+    return nullptr;
+}
+
+// --- Виробники ---
+LogRecord *log_claim(LogSlot *slot, LogLevel level, const char *tag, const char *fmt) {
+    LogRecord *rec;
+    if (!async_running.load(std::memory_order_acquire)) {
+        slot->cell = nullptr;
+        rec = &sync_record;
+    } else {
+        uint64_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        LogCell *cell;
+        for (;;) {
+            cell = &ring[pos & (LOG_RING_CAPACITY - 1)];
+            uint64_t seq = cell->seq.load(std::memory_order_acquire);
+            int64_t diff = (int64_t)(seq - pos);
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                // Журнал ніколи не блокує гарячий шлях
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        slot->cell = cell;
+        slot->pos = pos;
+        rec = &cell->record;
+    }
+
+    rec->time_us = g_get_monotonic_time();
+    rec->tag = tag;
+    rec->fmt = fmt;
+    rec->level = (uint8_t)level;
+    rec->nargs = 0;
+    rec->string_used = 0;
+    slot->record = rec;
+    return rec;
+}
+
+void log_publish(LogSlot *slot) {
+    if (!slot->cell) {
+        GString *buf = g_string_sized_new(256);
+        g_mutex_lock(&sync_lock);
+        emit(*slot->record, buf);
+        fflush(slot->record->level >= LOG_LEVEL_WARN ? stderr : stdout);
+        g_mutex_unlock(&sync_lock);
+        g_string_free(buf, TRUE);
+        return;
+    }
+    LogCell *cell = (LogCell*)slot->cell;
+    cell->seq.store(slot->pos + 1, std::memory_order_release);
+}
+
+void log_start() {
+    if (worker) return;
+    for (uint64_t i = 0; i < LOG_RING_CAPACITY; i++) {
+        ring[i].seq.store(i, std::memory_order_relaxed);
+    }
+    enqueue_pos.store(0, std::memory_order_relaxed);
+    dequeue_pos = 0;
+
+    worker_running.store(true, std::memory_order_release);
+    worker = g_thread_new("log", log_worker_main, NULL);
+    async_running.store(true, std::memory_order_release);
+}
+
+void log_stop() {
+    if (!worker) return;
+    // Нові записи знову йдуть синхронно; опубліковані дописуємо тут
+    async_running.store(false, std::memory_order_release);
+    worker_running.store(false, std::memory_order_release);
+    g_thread_join(worker);
+    worker = nullptr;
+
+    GString *buf = g_string_sized_new(256);
+    drain(buf);
+    g_string_free(buf, TRUE);
+}
@@ -0,0 +1,118 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <glib.h>
+#include <atomic>
+#include <cstdint>
+
+// Рівні журналу. LOG_COMPILE_LEVEL відсікає виклики під час компіляції
+// (WEBRCCAR_LOG_LEVEL у CMake), log_set_level() — під час роботи.
+enum LogLevel {
+    LOG_LEVEL_DEBUG,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_OFF
+};
+
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+#define LOG_MAX_ARGS      8
+#define LOG_STRING_BYTES  256   // рядкові аргументи копіюються, решта обрізається
+
+enum LogArgType : uint8_t {
+    LOG_ARG_INT,
+    LOG_ARG_UINT,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_STRING,
+    LOG_ARG_POINTER
+};
+
+// Двійковий запис: формат і тег — статичні рядки, аргументи зберігаються
+// як є, рядок форматує фоновий потік
+struct LogRecord {
+    gint64      time_us;
+    const char *tag;
+    const char *fmt;
+    uint8_t     level;
+    uint8_t     nargs;
+    uint16_t    string_used;
+    uint8_t     types[LOG_MAX_ARGS];
+    union {
+        int64_t     i;
+        uint64_t    u;
+        double      d;
+        const void *p;
+        uint32_t    string_offset;
+    } args[LOG_MAX_ARGS];
+    char        strings[LOG_STRING_BYTES];
+};
+
+// Слот, зайнятий виробником між log_claim() і log_publish()
+struct LogSlot {
+    void      *cell;      // nullptr — синхронний запис
+    uint64_t   pos;
+    LogRecord *record;
+};
+
+extern std::atomic<int> log_runtime_level;
+
+static inline bool log_enabled(LogLevel level) {
+    return level >= log_runtime_level.load(std::memory_order_relaxed);
+}
+
+// Фоновий потік форматування; до старту і після зупинки записи
+// форматуються синхронно в потоці, що пише
+void log_start();
+void log_stop();
+void log_set_level(LogLevel level);
+// nullptr або невідома назва — LOG_LEVEL_INFO
+LogLevel log_level_from_string(const char *name);
+
+// nullptr — кільце переповнене, запис відкинуто (враховується в лічильнику)
+LogRecord *log_claim(LogSlot *slot, LogLevel level, const char *tag, const char *fmt);
+void log_publish(LogSlot *slot);
+
+void log_pack(LogRecord *rec, int v);
+void log_pack(LogRecord *rec, unsigned int v);
+void log_pack(LogRecord *rec, long v);
+void log_pack(LogRecord *rec, unsigned long v);
+void log_pack(LogRecord *rec, long long v);
+void log_pack(LogRecord *rec, unsigned long long v);
+void log_pack(LogRecord *rec, double v);
+void log_pack(LogRecord *rec, const char *v);
+void log_pack(LogRecord *rec, const void *v);
+
+template <typename... Args>
+inline void log_write(LogLevel level, const char *tag, const char *fmt, Args... args) {
+    static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "too many log arguments");
+    LogSlot slot;
+    LogRecord *rec = log_claim(&slot, level, tag, fmt);
+    if (!rec) return;
+    (log_pack(rec, args), ...);
+    log_publish(&slot);
+}
+
+// Ніколи не викликається: лише дає компілятору перевірити формат
+static inline void log_format_check(const char *, ...) G_GNUC_PRINTF(1, 2);
+static inline void log_format_check(const char *, ...) {}
+
+// Аргументи не обчислюються, якщо рівень вимкнено.
+// Формат — рядковий літерал без завершального \n.
+#define LOG_AT(level, tag, ...) do {                                        \
+        if constexpr ((level) >= LOG_COMPILE_LEVEL) {                       \
+            if (log_enabled(level)) {                                       \
+                if (false) log_format_check(__VA_ARGS__);                   \
+                log_write(level, tag, __VA_ARGS__);                         \
+            }                                                               \
+        }                                                                   \
+    } while (0)
+
+#define LOG_DEBUG(tag, ...) LOG_AT(LOG_LEVEL_DEBUG, tag, __VA_ARGS__)
+#define LOG_INFO(tag, ...)  LOG_AT(LOG_LEVEL_INFO,  tag, __VA_ARGS__)
+#define LOG_WARN(tag, ...)  LOG_AT(LOG_LEVEL_WARN,  tag, __VA_ARGS__)
+#define LOG_ERROR(tag, ...) LOG_AT(LOG_LEVEL_ERROR, tag, __VA_ARGS__)
+
+#endif // LOG_H
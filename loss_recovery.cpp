@@ -0,0 +1,205 @@
+#include "loss_recovery.h"
+#include "rate_control.h"
+#include "metrics.h"
+#include "config.h"
+#include "log.h"
+#include <gst/webrtc/webrtc.h>
+#include <glib.h>
+
+// Стан одного глядача. Елементи RTX і FEC webrtcbin створює у своїх
+// потоках під час узгодження, тому на них — слабкі посилання, а
+// замикання deep-element-added тримає посилання на стан.
+struct RecoveryPeer {
+    gchar *id;
+    bool rtx;
+    bool fec;
+    GWeakRef rtx_sender;      // rtprtxsend
+    GWeakRef fec_encoder;     // rtpulpfecenc
+
+    // Далі — лише головний цикл
+    guint rtx_requests;       // останні прочитані лічильники rtprtxsend
+    guint rtx_packets;
+    guint64 packets_lost;
+    guint fec_percent;
+};
+
+struct LossRecovery {
+    RateControl *rate;          // може бути nullptr
+    GHashTable *peers;          // id → RecoveryPeer*
+    guint tick_id;
+};
+
+static void recovery_peer_clear(RecoveryPeer *rp) {
+    g_weak_ref_clear(&rp->rtx_sender);
+    g_weak_ref_clear(&rp->fec_encoder);
+    g_free(rp->id);
+}
+
+static RecoveryPeer *recovery_peer_ref(RecoveryPeer *rp) {
+    return (RecoveryPeer*)g_rc_box_acquire(rp);
+}
+
+static void recovery_peer_unref(RecoveryPeer *rp) {
+    g_rc_box_release_full(rp, (GDestroyNotify)recovery_peer_clear);
+}
+
+static void recovery_peer_closure_notify(gpointer data, GClosure*) {
+    recovery_peer_unref((RecoveryPeer*)data);
+}
+
+static bool parse_profile(const char *name, bool *rtx, bool *fec) {
+    if (!g_strcmp0(name, "off")) { *rtx = false; *fec = false; }
+    else if (!g_strcmp0(name, "rtx")) { *rtx = true; *fec = false; }
+    else if (!g_strcmp0(name, "fec")) { *rtx = false; *fec = true; }
+    else if (!g_strcmp0(name, "rtx-fec")) { *rtx = true; *fec = true; }
+    else return false;
+    return true;
+}
+
+// --- Елементи webrtcbin ---
+// Пакети FEC — ті, що йдуть з rtpulpfecenc з його payload type
+static GstPadProbeReturn on_fec_packet(GstPad*, GstPadProbeInfo *info, gpointer data) {
+    guint8 h[2];
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (gst_buffer_extract(buf, 0, h, 2) == 2 && (guint)(h[1] & 0x7f) == GPOINTER_TO_UINT(data)) {
+        metrics_inc(METRIC_FEC_PACKETS);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static void on_deep_element_added(GstBin*, GstBin*, GstElement *element, gpointer user_data) {
+    RecoveryPeer *rp = (RecoveryPeer*)user_data;
+    GstElementFactory *f = gst_element_get_factory(element);
+    const char *name = f ? GST_OBJECT_NAME(f) : "";
+
+    if (rp->rtx && !g_strcmp0(name, "rtprtxsend")) {
+        g_object_set(element, "max-size-time", config_get()->recovery.rtx_time_ms, NULL);
+        g_weak_ref_set(&rp->rtx_sender, element);
+    } else if (rp->fec && !g_strcmp0(name, "rtpulpfecenc")) {
+        g_weak_ref_set(&rp->fec_encoder, element);
+        guint pt = 0;
+        g_object_get(element, "pt", &pt, NULL);
+        GstPad *src = gst_element_get_static_pad(element, "src");
+        if (src) {
+            gst_pad_add_probe(src, GST_PAD_PROBE_TYPE_BUFFER, on_fec_packet, GUINT_TO_POINTER(pt), NULL);
+            gst_object_unref(src);
+        }
+    }
+}
+
+// --- Лічильники і підлаштування FEC ---
+static void update_rtx(RecoveryPeer *rp) {
+    GstElement *rtx = (GstElement*)g_weak_ref_get(&rp->rtx_sender);
+    if (!rtx) return;
+    guint requests = 0, packets = 0;
+    g_object_get(rtx, "num-rtx-requests", &requests, "num-rtx-packets", &packets, NULL);
+    gst_object_unref(rtx);
+
+    // Після повторного узгодження webrtcbin може створити новий rtprtxsend
+    if (requests < rp->rtx_requests || packets < rp->rtx_packets) rp->rtx_requests = rp->rtx_packets = 0;
+    metrics_inc(METRIC_RTX_REQUESTED, requests - rp->rtx_requests);
+    metrics_inc(METRIC_RTX_RETRANSMITTED, packets - rp->rtx_packets);
+    rp->rtx_requests = requests;
+    rp->rtx_packets = packets;
+}
+
+static void update_fec(RecoveryPeer *rp, const LinkStats &ls) {
+    const RecoveryConfig &rc = config_get()->recovery;
+    double percent = rc.fec_min_percent + rc.fec_loss_gain * ls.fraction_lost * 100;
+    guint target = (guint)CLAMP(percent, (double)rc.fec_min_percent, (double)rc.fec_max_percent);
+    if (target == rp->fec_percent) return;
+
+    GstElement *fec = (GstElement*)g_weak_ref_get(&rp->fec_encoder);
+    if (!fec) return;
+    g_object_set(fec, "percentage", target, NULL);
+    gst_object_unref(fec);
+    LOG_INFO("RECOVERY", "Peer %s FEC overhead %u%% -> %u%% (loss %.1f%%)",
+             rp->id, rp->fec_percent, target, ls.fraction_lost * 100);
+    rp->fec_percent = target;
+}
+
+static gboolean recovery_tick(gpointer data) {
+    LossRecovery *lr = (LossRecovery*)data;
+    GHashTableIter it;
+    gpointer value;
+    g_hash_table_iter_init(&it, lr->peers);
+    while (g_hash_table_iter_next(&it, NULL, &value)) {
+        RecoveryPeer *rp = (RecoveryPeer*)value;
+        update_rtx(rp);
+
+        LinkStats ls;
+        if (!rate_control_get_link_stats(lr->rate, rp->id, &ls)) continue;
+        // RTCP RR рахує лише пакети, яких глядач так і не отримав:
+        // повторені вчасно і відновлені з FEC туди не потрапляють
+        if (ls.packets_lost > rp->packets_lost) {
+            metrics_inc(METRIC_PACKETS_UNRECOVERED, ls.packets_lost - rp->packets_lost);
+        }
+        rp->packets_lost = ls.packets_lost;
+        if (rp->fec) update_fec(rp, ls);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+LossRecovery *loss_recovery_new(RateControl *rate) {
+    LossRecovery *lr = g_new0(LossRecovery, 1);
+    lr->rate = rate;
+    lr->peers = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)recovery_peer_unref);
+    lr->tick_id = g_timeout_add(MAX(config_get()->recovery.interval_ms, 100u), recovery_tick, lr);
+    return lr;
+}
+
+void loss_recovery_free(LossRecovery *lr) {
+    if (!lr) return;
+    g_source_remove(lr->tick_id);
+    g_hash_table_unref(lr->peers);
+    g_free(lr);
+}
+
+void loss_recovery_attach(LossRecovery *lr, const char *peer_id, GstElement *branch, GstElement *webrtc,
+                          const char *profile) {
+    const RecoveryConfig &rc = config_get()->recovery;
+
+    bool rtx, fec;
+    if (!profile || !parse_profile(profile, &rtx, &fec)) {
+        if (profile) LOG_WARN("RECOVERY", "Peer %s asked for unknown profile '%s'", peer_id, profile);
+        profile = rc.profile;
+        if (!parse_profile(profile, &rtx, &fec)) {
+            LOG_WARN("RECOVERY", "Unknown [recovery] profile '%s', using off", profile);
+            profile = "off";
+            rtx = fec = false;
+        }
+    }
+
+    // Гілка має один відеотрансивер — з pad, який rtph264pay уже запитав
+    GstWebRTCRTPTransceiver *trans = nullptr;
+    g_signal_emit_by_name(webrtc, "get-transceiver", 0, &trans);
+    if (!trans) {
+        LOG_WARN("RECOVERY", "No video transceiver for %s, loss recovery disabled", peer_id);
+        return;
+    }
+    if (rtx) g_object_set(trans, "do-nack", TRUE, NULL);
+    if (fec) {
+        g_object_set(trans, "fec-type", GST_WEBRTC_FEC_TYPE_ULP_RED,
+                     "fec-percentage", rc.fec_min_percent, NULL);
+    }
+    gst_object_unref(trans);
+
+    RecoveryPeer *rp = g_rc_box_new0(RecoveryPeer);
+    rp->id = g_strdup(peer_id);
+    rp->rtx = rtx;
+    rp->fec = fec;
+    g_weak_ref_init(&rp->rtx_sender, NULL);
+    g_weak_ref_init(&rp->fec_encoder, NULL);
+    rp->fec_percent = rc.fec_min_percent;
+    g_hash_table_replace(lr->peers, rp->id, rp);
+
+    if (rtx || fec) {
+        g_signal_connect_data(branch, "deep-element-added", G_CALLBACK(on_deep_element_added),
+                              recovery_peer_ref(rp), recovery_peer_closure_notify, (GConnectFlags)0);
+    }
+    LOG_INFO("RECOVERY", "Peer %s loss recovery: %s", peer_id, profile);
+}
+
+void loss_recovery_detach(LossRecovery *lr, const char *peer_id) {
+    g_hash_table_remove(lr->peers, peer_id);
+}
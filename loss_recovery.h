@@ -0,0 +1,29 @@
+#ifndef LOSS_RECOVERY_H
+#define LOSS_RECOVERY_H
+
+#include <gst/gst.h>
+
+struct RateControl;
+
+// Захист відео від втрат пакетів ([recovery] у конфігурації).
+// Профіль задається для кожного глядача окремо (поле "recovery" у ready,
+// інакше — з конфігурації):
+//   off     — без захисту
+//   rtx     — NACK і повтор через rtprtxsend; пакети старші за rtx_time_ms
+//             не повторюються, тож повтор не додає більше цієї затримки
+//   fec     — ULPFEC/RED; надлишок підлаштовується під частку втрат з RTCP
+//   rtx-fec — обидва
+// Частку і кількість втрат бере з регулятора бітрейту ([rate] enabled),
+// без нього FEC лишається на fec_min_percent.
+// Свій екземпляр у кожного пристрою; rate — його регулятор або nullptr.
+struct LossRecovery;
+LossRecovery *loss_recovery_new(RateControl *rate);
+void loss_recovery_free(LossRecovery *lr);
+
+// Викликати одразу після створення гілки, до узгодження: профіль
+// визначає, що піде в SDP (rtx, red/ulpfec). profile == nullptr — типовий.
+void loss_recovery_attach(LossRecovery *lr, const char *peer_id, GstElement *branch, GstElement *webrtc,
+                          const char *profile);
+void loss_recovery_detach(LossRecovery *lr, const char *peer_id);
+
+#endif // LOSS_RECOVERY_H
@@ -1,30 +1,86 @@
 #include <gst/gst.h>
 #include <glib.h>
 #include "gpio_control.h"
-#include "pwm_control.h"
 #include "webrtc_pipeline.h"
+#include "config.h"
+#include "motor_thread.h"
+#include "lifecycle.h"
+#include "metrics.h"
+#include "log.h"
+
+static void usage(const char *prog) {
+    g_printerr("Usage: %s <signaling-server-ip> <port> <device-id> [config-file]\n"
+               "       %s <config-file>   (devices from [device:ID] groups)\n", prog, prog);
+}
 
 int main(int argc, char **argv) {
     gst_init(&argc, &argv);
-    GMainLoop *loop = g_main_loop_new(NULL, FALSE);
 
-    if (argc != 4) {
-        g_printerr("Usage: %s <signaling-server-ip> <port> <device-id>\n", argv[0]);
+    // Один пристрій з командного рядка або кілька з [device:ID] у файлі
+    bool from_file = argc == 2;
+    if (!from_file && argc != 4 && argc != 5) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (!config_load(from_file ? argv[1] : argc == 5 ? argv[4] : nullptr)) {
         return 1;
     }
-    const char *sig_ip   = argv[1];
-    const char *sig_port = argv[2];
-    const char *device_id= argv[3];
+    if (!from_file) {
+        config_use_device(argv[3], argv[1], argv[2]);
+    }
+    const AppConfig *cfg = config_get();
+    if (cfg->n_devices == 0) {
+        g_printerr("[CONFIG] No [device:ID] groups in %s\n", argv[1]);
+        config_free();
+        return 1;
+    }
+    log_set_level(log_level_from_string(cfg->log.level));
+    log_start();
+
+    // Машина — у пристроїв з моторами; backend=none — лише камера
+    guint n = cfg->n_devices;
+    Vehicle **vehicles = g_new0(Vehicle*, n);
+    Vehicle **driven = g_new0(Vehicle*, n);
+    guint n_driven = 0;
+    bool ok = true;
+    for (guint i = 0; i < n && ok; i++) {
+        const DeviceConfig &d = cfg->devices[i];
+        if (!g_strcmp0(d.motors.backend, "none")) continue;
+        vehicles[i] = vehicle_new(d.id, &d.motors);
+        ok = vehicles[i] != nullptr;
+        if (ok) driven[n_driven++] = vehicles[i];
+    }
 
-    init_motor_control();
-    init_software_pwm();
-    start_webrtc(sig_ip, sig_port, device_id, loop);
+    int status = 1;
+    if (ok && lifecycle_start() && motor_thread_start(driven, n_driven)) {
+        GMainLoop *loop = g_main_loop_new(NULL, FALSE);
+        metrics_server_start();
+        Device **devices = g_new0(Device*, n);
+        bool started = true;
+        for (guint i = 0; i < n && started; i++) {
+            devices[i] = start_webrtc(&cfg->devices[i], vehicles[i]);
+            started = devices[i] != nullptr;
+        }
 
-    g_main_loop_run(loop);
+        if (started) g_main_loop_run(loop);
+
+        for (guint i = 0; i < n; i++) cleanup_webrtc(devices[i]);
+        g_free(devices);
+        metrics_server_stop();
+        g_main_loop_unref(loop);
+        status = started ? 0 : 1;
+    }
 
-    cleanup_webrtc();
-    cleanup_pwm();
-    cleanup_motor_control();
-    g_main_loop_unref(loop);
-    return 0;
+    // Дочекатися зупинки всіх гілок і ingest
+    lifecycle_stop();
+    // Завершення задач, поставлені вже після виходу з циклу, інакше
+    // не виконаються і втримають свої посилання
+    while (g_main_context_iteration(NULL, FALSE));
+    motor_thread_stop();
+    for (guint i = 0; i < n; i++) vehicle_free(vehicles[i]);
+    g_free(driven);
+    g_free(vehicles);
+    log_stop();
+    config_free();
+    return status;
 }
@@ -0,0 +1,842 @@
+#include "media_ingest.h"
+#include "config.h"
+#include "metrics.h"
+#include "frame_timing.h"
+#include "log.h"
+#include <glib.h>
+#include <gst/video/video.h>
+#include <atomic>
+
+// --- Шари ---
+// Звичайно шар один: джерело → кодер → h264parse → tee. У багатошаровому
+// режимі ([media] layers) сирі кадри камери розходяться через raw_tee на
+// кодер кожного шару, і в кожного шару свій tee, кеш GOP і обмеження
+// запитів ключового кадру. Шари впорядковані за зростанням бітрейту.
+#define INGEST_MAX_LAYERS 4
+
+struct IngestLayer {
+    MediaIngest *owner;
+    VideoSettings settings;     // лише в багатошаровому режимі
+    const char *name;           // набір [preset:NAME]
+    GstElement *tee;            // під gop_lock; nullptr — pipeline відпущено
+
+    // --- Кеш останньої GOP ---
+    // Тримаємо посилання на буфери від останнього IDR (разом з SPS/PPS,
+    // які h264parse вставляє перед кожним IDR), щоб нова гілка не чекала
+    // наступного ключового кадру.
+    GQueue gop_cache;
+    gsize gop_cache_bytes;
+
+    // --- Ключові кадри на вимогу ---
+    // PLI/FIR від глядачів rtpsession перетворює на upstream-подію
+    // force-key-unit; вона проходить гілку і tee до h264parse і кодера.
+    // Проба на вході tee обмежує частоту, щоб кілька глядачів із втратами
+    // не змушували кодер слати IDR щокадру.
+    std::atomic<gint64> keyframe_last_us;     // останній запит, переданий кодеру
+    std::atomic<gint64> keyframe_pending_us;  // перший запит без IDR у відповідь
+};
+
+struct MediaIngest {
+    gatomicrefcount ref;
+    const MediaConfig *mc;
+    GstElement *pipeline;
+
+    // Поточні параметри відео; до першого configure — з [media]
+    VideoSettings video;
+    bool video_configured;
+
+    IngestLayer layers[INGEST_MAX_LAYERS];
+    guint n_layers;                         // 0 — [media] layers ще не розібрано
+    GMutex gop_lock;
+    bool has_encoder;                       // кодер у цьому процесі
+
+    // Для телеметрії пристрою; глобальні метрики — сума всіх пристроїв
+    std::atomic<guint64> frames;
+    std::atomic<guint64> dropped;
+};
+
+static MediaIngest *media_ingest_ref(MediaIngest *mi) {
+    g_atomic_ref_count_inc(&mi->ref);
+    return mi;
+}
+
+void media_ingest_unref(MediaIngest *mi) {
+    if (!mi || !g_atomic_ref_count_dec(&mi->ref)) return;
+    g_mutex_clear(&mi->gop_lock);
+    delete mi;
+}
+
+MediaIngest *media_ingest_new(const MediaConfig *config) {
+    MediaIngest *mi = new MediaIngest();
+    g_atomic_ref_count_init(&mi->ref);
+    mi->mc = config;
+    g_mutex_init(&mi->gop_lock);
+    for (IngestLayer &l : mi->layers) l.owner = mi;
+    return mi;
+}
+
+// Шар, чиї буфери йдуть через цей tee. Відпущений pipeline ще працює,
+// доки робочий потік його не зупинить, і не повинен писати в кеш нового.
+static IngestLayer *layer_for_tee_locked(MediaIngest *mi, GstElement *t) {
+    for (guint i = 0; i < mi->n_layers; i++) {
+        if (t && mi->layers[i].tee == t) return &mi->layers[i];
+    }
+    return nullptr;
+}
+
+static void resolve_layers(MediaIngest *mi) {
+    if (mi->n_layers) return;
+    const MediaConfig &mc = *mi->mc;
+
+    const VideoPreset *found[INGEST_MAX_LAYERS];
+    guint n = 0;
+    gchar **names = g_strsplit(mc.layers, ",", -1);
+    for (gchar **name = names; *name; name++) {
+        g_strstrip(*name);
+        if (!**name) continue;
+        const VideoPreset *p = config_find_preset(*name);
+        if (!p) {
+            LOG_WARN("INGEST", "Unknown layer preset '%s', skipped", *name);
+        } else if (n == INGEST_MAX_LAYERS) {
+            LOG_WARN("INGEST", "At most %d layers, '%s' skipped", INGEST_MAX_LAYERS, *name);
+        } else {
+            // Вставкою за зростанням бітрейту
+            guint i = n++;
+            for (; i > 0 && found[i - 1]->bitrate > p->bitrate; i--) found[i] = found[i - 1];
+            found[i] = p;
+        }
+    }
+    g_strfreev(names);
+
+    if (n > 1 && !g_strcmp0(mc.source, "udp")) {
+        LOG_WARN("INGEST", "Layers need an in-process encoder; source=udp sends a single stream");
+        n = 0;
+    } else if (n == 1) {
+        LOG_WARN("INGEST", "A single layer is the normal mode; use [media] preset instead");
+        n = 0;
+    }
+
+    for (guint i = 0; i < n; i++) {
+        mi->layers[i].name = found[i]->name;
+        mi->layers[i].settings = { found[i]->width, found[i]->height, found[i]->framerate, found[i]->bitrate };
+    }
+    mi->n_layers = MAX(n, 1u);
+}
+
+static bool layered(MediaIngest *mi) {
+    resolve_layers(mi);
+    return mi->n_layers > 1;
+}
+
+static GstPadProbeReturn on_keyframe_request(GstPad*, GstPadProbeInfo *info, gpointer data) {
+    IngestLayer &l = *(IngestLayer*)data;
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+    if (!gst_video_event_is_force_key_unit(event)) return GST_PAD_PROBE_OK;
+
+    if (!l.owner->has_encoder) {
+        // RTP від start_camera.sh: IDR визначає лише --intra
+        metrics_inc(METRIC_KEYFRAME_REQUESTS_UNSUPPORTED);
+        return GST_PAD_PROBE_DROP;
+    }
+
+    gint64 now = g_get_monotonic_time();
+    gint64 last = l.keyframe_last_us.load(std::memory_order_relaxed);
+    gint64 min_interval = (gint64)l.owner->mc->keyframe_min_interval_ms * 1000;
+    if ((last && now - last < min_interval)
+        || !l.keyframe_last_us.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+        metrics_inc(METRIC_KEYFRAME_REQUESTS_THROTTLED);
+        return GST_PAD_PROBE_DROP;
+    }
+
+    gint64 none = 0;
+    l.keyframe_pending_us.compare_exchange_strong(none, now, std::memory_order_relaxed);
+    metrics_inc(METRIC_KEYFRAME_REQUESTS_FORWARDED);
+    return GST_PAD_PROBE_OK;
+}
+
+// Запит від самого ingest (нова гілка без GOP) — тим самим шляхом, що й PLI
+static void request_keyframe(GstPad *tee_src) {
+    GstElement *t = gst_pad_get_parent_element(tee_src);
+    if (!t) return;
+    GstPad *sink = gst_element_get_static_pad(t, "sink");
+    gst_pad_push_event(sink, gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE, 0));
+    gst_object_unref(sink);
+    gst_object_unref(t);
+}
+
+static bool low_latency(const MediaIngest *mi) {
+    return !g_strcmp0(mi->mc->profile, "low-latency");
+}
+
+static void gop_cache_clear_locked(IngestLayer *l) {
+    GstBuffer *buf;
+    while ((buf = (GstBuffer*)g_queue_pop_head(&l->gop_cache))) {
+        gst_buffer_unref(buf);
+    }
+    l->gop_cache_bytes = 0;
+}
+
+static GstPadProbeReturn on_ingest_buffer(GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+    MediaIngest *mi = (MediaIngest*)data;
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+    gsize size = gst_buffer_get_size(buf);
+
+    GstElement *t = gst_pad_get_parent_element(pad);
+    g_mutex_lock(&mi->gop_lock);
+    IngestLayer *l = layer_for_tee_locked(mi, t);
+    if (t) gst_object_unref(t);
+    if (!l) {
+        // Буфер відпущеного pipeline
+        g_mutex_unlock(&mi->gop_lock);
+        return GST_PAD_PROBE_OK;
+    }
+    // Кадри камери — за найякіснішим шаром, а не за сумою шарів
+    if (l == &mi->layers[mi->n_layers - 1]) {
+        metrics_inc(METRIC_FRAMES_INGESTED);
+        mi->frames.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (!GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_DELTA_UNIT)) {
+        gint64 pending = l->keyframe_pending_us.exchange(0, std::memory_order_relaxed);
+        if (pending) metrics_observe(METRIC_KEYFRAME_RECOVERY, g_get_monotonic_time() - pending);
+        gop_cache_clear_locked(l);
+        g_queue_push_tail(&l->gop_cache, gst_buffer_ref(buf));
+        l->gop_cache_bytes = size;
+    } else if (!g_queue_is_empty(&l->gop_cache)) {
+        if (l->gop_cache_bytes + size > mi->mc->gop_cache_max_bytes) {
+            // GOP задовга: неповний кеш марний, чекаємо наступного IDR
+            gop_cache_clear_locked(l);
+        } else {
+            g_queue_push_tail(&l->gop_cache, gst_buffer_ref(buf));
+            l->gop_cache_bytes += size;
+        }
+    }
+    g_mutex_unlock(&mi->gop_lock);
+    return GST_PAD_PROBE_OK;
+}
+
+// Перший буфер нової гілки: якщо це не ключовий кадр, спершу
+// проштовхуємо закешовану GOP до поточного буфера включно
+static GstPadProbeReturn on_branch_first_buffer(GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+    MediaIngest *mi = (MediaIngest*)data;
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (!GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_DELTA_UNIT)) {
+        return GST_PAD_PROBE_REMOVE;
+    }
+
+    // У low-latency кешована GOP — це вже застарілі кадри: лише просимо IDR
+    GQueue burst = G_QUEUE_INIT;
+    GstElement *t = gst_pad_get_parent_element(pad);
+    g_mutex_lock(&mi->gop_lock);
+    IngestLayer *layer = layer_for_tee_locked(mi, t);
+    for (GList *l = layer && !low_latency(mi) ? layer->gop_cache.head : nullptr; l; l = l->next) {
+        // Поточний буфер уже в кеші — його tee віддасть сам
+        if (l->data == buf) break;
+        g_queue_push_tail(&burst, gst_buffer_ref((GstBuffer*)l->data));
+    }
+    g_mutex_unlock(&mi->gop_lock);
+    if (t) gst_object_unref(t);
+
+    if (g_queue_is_empty(&burst)) {
+        // Кешу немає: кадри без опорного IDR декодер не покаже.
+        // Просимо IDR один раз, не чекаючи PLI від глядача.
+        if (!g_object_get_data(G_OBJECT(pad), "keyframe-requested")) {
+            g_object_set_data(G_OBJECT(pad), "keyframe-requested", GINT_TO_POINTER(1));
+            request_keyframe(pad);
+        }
+        return GST_PAD_PROBE_DROP;
+    }
+
+    gst_pad_remove_probe(pad, info->id);
+    LOG_INFO("INGEST", "Priming new branch with %u cached frames", g_queue_get_length(&burst));
+    GstBuffer *cached;
+    while ((cached = (GstBuffer*)g_queue_pop_head(&burst))) {
+        gst_pad_push(pad, cached);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+// --- Обмеження затримки (profile=low-latency) ---
+// Проба на виході черги гілки не пропускає кадри, старші за
+// max_frame_age_ms (вік кадру — див. frame_timing.h). Після відкинутого кадру дельта-кадри марні, тож
+// гілка відкидає все до наступного IDR і просить його. Черга гілки
+// обмежена тим самим часом і відкидає найстаріше; кожне переповнення
+// теж переводить гілку в очікування IDR.
+struct BranchLatency {
+    MediaIngest *mi;            // власне посилання
+    std::atomic<bool> resync;   // черга відкинула кадр — потрібен IDR
+    bool dropping;              // лише в потоці черги
+};
+
+static void count_stale(MediaIngest *mi) {
+    metrics_inc(METRIC_FRAMES_DROPPED_STALE);
+    mi->dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+static GstPadProbeReturn on_branch_frame(GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+    BranchLatency *st = (BranchLatency*)data;
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+    gint64 age = frame_timing_age_us(pad, buf);
+    if (age >= 0) metrics_observe(METRIC_FRAME_AGE, age);
+    if (!low_latency(st->mi)) return GST_PAD_PROBE_OK;
+
+    bool key = !GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_DELTA_UNIT);
+    bool stale = age > (gint64)st->mi->mc->max_frame_age_ms * 1000;
+    if (st->resync.exchange(false, std::memory_order_acquire) && !key) {
+        st->dropping = true;
+        gst_pad_send_event(pad, gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE, 0));
+    }
+    if (st->dropping) {
+        if (key && !stale) {
+            st->dropping = false;
+            return GST_PAD_PROBE_OK;
+        }
+        count_stale(st->mi);
+        return GST_PAD_PROBE_DROP;
+    }
+    if (stale) {
+        st->dropping = true;
+        count_stale(st->mi);
+        gst_pad_send_event(pad, gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE, 0));
+        return GST_PAD_PROBE_DROP;
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+// overrun у leaky-черзі: найстаріший буфер зараз буде відкинуто
+static void on_branch_queue_overrun(GstElement*, gpointer data) {
+    BranchLatency *st = (BranchLatency*)data;
+    count_stale(st->mi);
+    st->resync.store(true, std::memory_order_release);
+}
+
+static void on_raw_queue_overrun(GstElement*, gpointer data) {
+    metrics_inc(METRIC_FRAMES_DROPPED_RAW);
+    ((MediaIngest*)data)->dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void free_branch_latency(gpointer data) {
+    BranchLatency *st = (BranchLatency*)data;
+    media_ingest_unref(st->mi);
+    delete st;
+}
+
+static void watch_branch_latency(MediaIngest *mi, GstElement *branch) {
+    GstElement *queue = gst_bin_get_by_name(GST_BIN(branch), "branchqueue");
+    if (!queue) return;
+    // Стан живе разом із чергою: і проба, і сигнал зникають раніше за неї
+    BranchLatency *st = new BranchLatency();
+    st->mi = media_ingest_ref(mi);
+    g_object_set_data_full(G_OBJECT(queue), "webrccar-latency", st, free_branch_latency);
+    g_signal_connect(queue, "overrun", G_CALLBACK(on_branch_queue_overrun), st);
+    GstPad *src = gst_element_get_static_pad(queue, "src");
+    gst_pad_add_probe(src, GST_PAD_PROBE_TYPE_BUFFER, on_branch_frame, st, NULL);
+    gst_object_unref(src);
+    gst_object_unref(queue);
+}
+
+gchar *media_ingest_branch_queue_description(MediaIngest *mi) {
+    // Багатошаровий режим: кожен шар має свій pad селектора, у гілку йде один
+    const char *selector = layered(mi) ? "input-selector name=layersel sync-streams=false cache-buffers=false ! " : "";
+    if (!low_latency(mi)) return g_strdup_printf("%squeue name=branchqueue", selector);
+    return g_strdup_printf(
+        "%squeue name=branchqueue leaky=downstream max-size-buffers=0 max-size-bytes=0 max-size-time=%" G_GUINT64_FORMAT,
+        selector, (guint64)mi->mc->max_frame_age_ms * GST_MSECOND);
+}
+
+// --- Джерела ---
+// udp:       RTP від start_camera.sh (окремий процес libcamera-vid)
+// libcamera: libcamerasrc → апаратний кодер у цьому ж процесі
+// v4l2:      v4l2src → апаратний кодер у цьому ж процесі
+// test:      videotestsrc → програмний кодер, для розробки без камери
+// У внутрішньопроцесних варіантах кадри камери передаються кодеру як
+// dmabuf, без копіювання, а вихід кодера йде одразу в h264parse.
+// Шари масштабуються з кадрів камери окремо, тож їхні кодери читають
+// звичайні буфери після масштабування.
+
+static bool has_element(const char *factory) {
+    GstElementFactory *f = gst_element_factory_find(factory);
+    if (!f) return false;
+    gst_object_unref(f);
+    return true;
+}
+
+static gchar *build_encoder_description(const MediaConfig &mc, const VideoSettings &v, bool prefer_hardware,
+                                        const char *name, bool dmabuf_input) {
+    const char *encoder = mc.encoder;
+    if (!g_strcmp0(encoder, "auto")) {
+        encoder = prefer_hardware && has_element("v4l2h264enc") ? "v4l2h264enc" : "x264enc";
+    }
+
+    if (!g_strcmp0(encoder, "v4l2h264enc")) {
+        // dmabuf-import: кодер читає буфери камери напряму
+        return g_strdup_printf(
+            "v4l2h264enc name=%s%s "
+            "extra-controls=\"controls,repeat_sequence_header=1,video_bitrate=%u,h264_i_frame_period=%u\" ! "
+            "video/x-h264,level=(string)4,profile=(string)baseline",
+            name, dmabuf_input ? " output-io-mode=dmabuf-import" : "", v.bitrate, mc.keyframe_interval);
+    }
+
+    return g_strdup_printf(
+        "x264enc name=%s tune=zerolatency speed-preset=ultrafast "
+        "bitrate=%u key-int-max=%u ! video/x-h264,profile=(string)constrained-baseline",
+        name, v.bitrate / 1000, mc.keyframe_interval);
+}
+
+// Елемент камери; nullptr — невідоме джерело
+static gchar *build_camera_description(const MediaConfig &mc, bool *prefer_hardware) {
+    *prefer_hardware = true;
+    if (!g_strcmp0(mc.source, "libcamera")) return g_strdup("libcamerasrc");
+    if (!g_strcmp0(mc.source, "v4l2")) return g_strdup_printf("v4l2src device=%s io-mode=dmabuf", mc.device);
+    if (!g_strcmp0(mc.source, "test")) {
+        *prefer_hardware = false;
+        return g_strdup("videotestsrc is-live=true pattern=ball");
+    }
+    LOG_ERROR("INGEST", "Unknown media source '%s'", mc.source);
+    return nullptr;
+}
+
+// low-latency: кодер отримує найновіший кадр, а не чергу застарілих
+static const char *raw_queue_description(const MediaIngest *mi) {
+    return low_latency(mi)
+        ? "queue name=rawqueue leaky=downstream max-size-buffers=2 max-size-bytes=0 max-size-time=0 ! "
+        : "";
+}
+
+static gchar *build_source_description(MediaIngest *mi) {
+    const MediaConfig &mc = *mi->mc;
+    if (!g_strcmp0(mc.source, "udp")) {
+        return g_strdup_printf(
+            "udpsrc port=%u caps=\"application/x-rtp, media=(string)video, clock-rate=(int)90000, encoding-name=(string)H264\" ! "
+            "rtph264depay",
+            mc.udp_port);
+    }
+
+    bool prefer_hardware;
+    gchar *src = build_camera_description(mc, &prefer_hardware);
+    if (!src) return nullptr;
+
+    const VideoSettings &v = *media_ingest_video_settings(mi);
+    gchar *enc = build_encoder_description(mc, v, prefer_hardware, "encoder", true);
+    gchar *desc = g_strdup_printf(
+        "%s ! capsfilter name=rawcaps caps=\"video/x-raw,width=%u,height=%u,framerate=%u/1\" ! %s%s",
+        src, v.width, v.height, v.framerate, raw_queue_description(mi), enc);
+    g_free(enc);
+    g_free(src);
+    return desc;
+}
+
+#define H264_PARSE_DESCRIPTION \
+    "h264parse config-interval=-1 ! video/x-h264,stream-format=byte-stream,alignment=au"
+
+// Камера віддає найбільший з форматів шарів; кожен шар масштабує і
+// проріджує кадри сам. Черга шару відкидає старе, щоб повільний кодер
+// одного шару не гальмував інші.
+static gchar *build_layered_description(MediaIngest *mi) {
+    const MediaConfig &mc = *mi->mc;
+    bool prefer_hardware;
+    gchar *src = build_camera_description(mc, &prefer_hardware);
+    if (!src) return nullptr;
+
+    guint width = 0, height = 0, framerate = 0;
+    for (guint i = 0; i < mi->n_layers; i++) {
+        width = MAX(width, mi->layers[i].settings.width);
+        height = MAX(height, mi->layers[i].settings.height);
+        framerate = MAX(framerate, mi->layers[i].settings.framerate);
+    }
+    const char *scaler = prefer_hardware && has_element("v4l2convert") ? "v4l2convert" : "videoscale";
+
+    GString *desc = g_string_new(NULL);
+    g_string_append_printf(desc,
+        "%s ! capsfilter name=rawcaps caps=\"video/x-raw,width=%u,height=%u,framerate=%u/1\" ! %stee name=raw_tee",
+        src, width, height, framerate, raw_queue_description(mi));
+    for (guint i = 0; i < mi->n_layers; i++) {
+        const VideoSettings &v = mi->layers[i].settings;
+        gchar *name = g_strdup_printf("encoder%u", i);
+        gchar *enc = build_encoder_description(mc, v, prefer_hardware, name, false);
+        g_string_append_printf(desc,
+            " raw_tee. ! queue name=layerqueue%u leaky=downstream max-size-buffers=2 max-size-bytes=0 max-size-time=0 ! "
+            "%s ! videorate drop-only=true ! video/x-raw,width=%u,height=%u,framerate=%u/1 ! %s ! "
+            H264_PARSE_DESCRIPTION " ! tee name=ingest_tee%u allow-not-linked=true",
+            i, scaler, v.width, v.height, v.framerate, enc, i);
+        g_free(enc);
+        g_free(name);
+    }
+    g_free(src);
+    return g_string_free(desc, FALSE);
+}
+
+static void watch_queue_overrun(MediaIngest *mi, GstElement *p, const char *name) {
+    GstElement *queue = gst_bin_get_by_name(GST_BIN(p), name);
+    if (!queue) return;
+    g_signal_connect(queue, "overrun", G_CALLBACK(on_raw_queue_overrun), mi);
+    gst_object_unref(queue);
+}
+
+#define PIPELINE_INGEST_KEY "webrccar-ingest"
+
+GstElement *media_ingest_create(MediaIngest *mi) {
+    if (mi->pipeline) return mi->pipeline;
+
+    gchar *desc;
+    if (layered(mi)) {
+        desc = build_layered_description(mi);
+    } else {
+        gchar *src = build_source_description(mi);
+        desc = src ? g_strdup_printf("%s ! " H264_PARSE_DESCRIPTION " ! tee name=ingest_tee allow-not-linked=true", src)
+                   : nullptr;
+        g_free(src);
+    }
+    if (!desc) return nullptr;
+
+    LOG_INFO("INGEST", "Building ingest pipeline: %s", desc);
+    GError *error = nullptr;
+    GstElement *p = gst_parse_launch(desc, &error);
+    g_free(desc);
+
+    if (!p || error) {
+        LOG_ERROR("INGEST", "Failed to create ingest pipeline: %s", error ? error->message : "Unknown error");
+        if (error) g_error_free(error);
+        if (p) gst_object_unref(p);
+        return nullptr;
+    }
+
+    // Проби і сигнали pipeline звертаються до ingest, доки робочий потік
+    // його не зупинить, тож pipeline тримає власне посилання
+    g_object_set_data_full(G_OBJECT(p), PIPELINE_INGEST_KEY, media_ingest_ref(mi),
+                           (GDestroyNotify)media_ingest_unref);
+
+    GstElement *encoder = gst_bin_get_by_name(GST_BIN(p), layered(mi) ? "encoder0" : "encoder");
+    mi->has_encoder = encoder != nullptr;
+    if (encoder) gst_object_unref(encoder);
+    watch_queue_overrun(mi, p, "rawqueue");
+
+    GstElement *tees[INGEST_MAX_LAYERS];
+    for (guint i = 0; i < mi->n_layers; i++) {
+        gchar *name = layered(mi) ? g_strdup_printf("ingest_tee%u", i) : g_strdup("ingest_tee");
+        tees[i] = gst_bin_get_by_name(GST_BIN(p), name);
+        g_free(name);
+        name = g_strdup_printf("layerqueue%u", i);
+        watch_queue_overrun(mi, p, name);
+        g_free(name);
+
+        GstPad *sink = gst_element_get_static_pad(tees[i], "sink");
+        frame_timing_attach_ingest(sink, mi->mc->capture_timestamps);
+        gst_pad_add_probe(sink, GST_PAD_PROBE_TYPE_BUFFER, on_ingest_buffer, mi, NULL);
+        gst_pad_add_probe(sink, GST_PAD_PROBE_TYPE_EVENT_UPSTREAM, on_keyframe_request, &mi->layers[i], NULL);
+        gst_object_unref(sink);
+    }
+
+    g_mutex_lock(&mi->gop_lock);
+    for (guint i = 0; i < mi->n_layers; i++) mi->layers[i].tee = tees[i];
+    g_mutex_unlock(&mi->gop_lock);
+
+    mi->pipeline = p;
+    return p;
+}
+
+bool media_ingest_play(GstElement *p) {
+    if (gst_element_set_state(p, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        LOG_ERROR("INGEST", "Failed to start ingest pipeline");
+        gst_element_set_state(p, GST_STATE_NULL);
+        return false;
+    }
+    LOG_INFO("INGEST", "Ingest pipeline is PLAYING");
+    return true;
+}
+
+GstElement *media_ingest_release(MediaIngest *mi) {
+    if (!mi->pipeline) return nullptr;
+
+    GstElement *p = mi->pipeline;
+    GstElement *tees[INGEST_MAX_LAYERS];
+    g_mutex_lock(&mi->gop_lock);
+    for (guint i = 0; i < mi->n_layers; i++) {
+        gop_cache_clear_locked(&mi->layers[i]);
+        tees[i] = mi->layers[i].tee;
+        mi->layers[i].tee = nullptr;
+    }
+    g_mutex_unlock(&mi->gop_lock);
+    for (guint i = 0; i < mi->n_layers; i++) gst_object_unref(tees[i]);
+    mi->pipeline = nullptr;
+
+    LOG_INFO("INGEST", "Ingest pipeline released");
+    return p;
+}
+
+bool media_ingest_is_running(MediaIngest *mi) {
+    return mi->pipeline != nullptr;
+}
+
+void media_ingest_frame_counts(MediaIngest *mi, guint64 *frames, guint64 *dropped) {
+    *frames = mi->frames.load(std::memory_order_relaxed);
+    *dropped = mi->dropped.load(std::memory_order_relaxed);
+}
+
+// --- Під'єднання гілок ---
+// Гілка отримує pad на tee кожного шару. У багатошаровому режимі всі
+// вони йдуть у input-selector гілки, який пропускає лише активний шар,
+// а кадри інших відкидає без очікування. Новий шар стає активним на
+// своєму IDR, тож до того глядач бачить попередній без розриву.
+struct BranchLink;
+
+struct LayerSwitch {
+    BranchLink *link;
+    guint layer;
+};
+
+struct BranchLink {
+    MediaIngest *mi;                        // власне посилання
+    GstElement *selector;                   // nullptr — один шар
+    GstPad *tee_pads[INGEST_MAX_LAYERS];
+    GstPad *sel_pads[INGEST_MAX_LAYERS];
+    LayerSwitch switches[INGEST_MAX_LAYERS];
+    guint n;
+    std::atomic<guint> active;              // шар, що йде в гілку
+    std::atomic<guint> pending;             // шар, якого чекаємо; == active — перемикання немає
+    std::atomic<gint64> switch_requested_us;
+    bool detached;
+};
+
+#define BRANCH_LINK_KEY  "webrccar-ingest-link"
+#define BRANCH_LAYER_KEY "webrccar-layer"     // шар, вибраний до під'єднання, +1
+
+static void free_branch_link(gpointer data) {
+    BranchLink *link = (BranchLink*)data;
+    for (guint i = 0; i < link->n; i++) {
+        if (link->tee_pads[i]) gst_object_unref(link->tee_pads[i]);
+        if (link->sel_pads[i]) gst_object_unref(link->sel_pads[i]);
+    }
+    if (link->selector) gst_object_unref(link->selector);
+    media_ingest_unref(link->mi);
+    delete link;
+}
+
+static GstPadProbeReturn on_layer_switch(GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+    LayerSwitch *sw = (LayerSwitch*)data;
+    BranchLink *link = sw->link;
+    // Перемикання скасоване або замінене іншим
+    if (link->pending.load(std::memory_order_acquire) != sw->layer) return GST_PAD_PROBE_REMOVE;
+
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_DELTA_UNIT)) {
+        // Запит міг бути відкинутий обмеженням частоти — повторюємо
+        gint64 now = g_get_monotonic_time();
+        gint64 requested = link->switch_requested_us.load(std::memory_order_relaxed);
+        if (now - requested >= (gint64)link->mi->mc->keyframe_min_interval_ms * 1000 &&
+            link->switch_requested_us.compare_exchange_strong(requested, now, std::memory_order_relaxed)) {
+            request_keyframe(pad);
+        }
+        return GST_PAD_PROBE_OK;
+    }
+
+    g_object_set(link->selector, "active-pad", link->sel_pads[sw->layer], NULL);
+    link->active.store(sw->layer, std::memory_order_release);
+    const IngestLayer &l = link->mi->layers[sw->layer];
+    // Потік стримінгу: без синхронного stdout
+    LOG_INFO("INGEST", "Branch switched to layer %s (%ux%u@%u)", l.name,
+             l.settings.width, l.settings.height, l.settings.framerate);
+    return GST_PAD_PROBE_REMOVE;
+}
+
+static void release_tee_pads(BranchLink *link) {
+    for (guint i = 0; i < link->n; i++) {
+        if (!link->tee_pads[i]) continue;
+        // tee сам від'єднує pad і безпечно перестає в нього писати
+        GstElement *t = gst_pad_get_parent_element(link->tee_pads[i]);
+        if (t) {
+            if (link->mi->pipeline) gst_element_release_request_pad(t, link->tee_pads[i]);
+            gst_object_unref(t);
+        }
+    }
+}
+
+static bool link_layer(GstElement *branch, BranchLink *link, guint i, GstElement *t) {
+    GstPad *sink;
+    if (link->selector) {
+        link->sel_pads[i] = gst_element_request_pad_simple(link->selector, "sink_%u");
+        sink = gst_ghost_pad_new(NULL, link->sel_pads[i]);
+        gst_pad_set_active(sink, TRUE);
+        gst_element_add_pad(branch, sink);
+        gst_object_ref(sink);
+    } else {
+        sink = gst_element_get_static_pad(branch, "sink");
+    }
+    link->tee_pads[i] = gst_element_request_pad_simple(t, "src_%u");
+    link->switches[i] = { link, i };
+
+    GstPadLinkReturn ret = gst_pad_link(link->tee_pads[i], sink);
+    gst_object_unref(sink);
+    if (ret != GST_PAD_LINK_OK) {
+        LOG_ERROR("INGEST", "Failed to link branch to ingest tee: %d", ret);
+        return false;
+    }
+    return true;
+}
+
+bool media_ingest_attach(MediaIngest *mi, GstElement *branch) {
+    if (!mi->pipeline) return false;
+
+    guint n_layers = mi->n_layers;
+    BranchLink *link = new BranchLink();
+    link->mi = media_ingest_ref(mi);
+    link->n = n_layers;
+    if (layered(mi)) link->selector = gst_bin_get_by_name(GST_BIN(branch), "layersel");
+    // Без вибору — найякісніший шар; гілка без селектора (dashcam) — лише він
+    guint chosen = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(branch), BRANCH_LAYER_KEY));
+    guint initial = link->selector && chosen ? MIN(chosen, n_layers) - 1 : n_layers - 1;
+    guint first = link->selector ? 0 : initial;
+    link->active = initial;
+    link->pending = initial;
+    g_object_set_data_full(G_OBJECT(branch), BRANCH_LINK_KEY, link, free_branch_link);
+
+    watch_branch_latency(mi, branch);
+    bool ok = true;
+    // Активний pad — до першого буфера, решту селектор відкидає
+    for (guint i = first; i < n_layers && ok; i++) {
+        ok = link_layer(branch, link, i, mi->layers[i].tee);
+        if (ok && i == initial) {
+            if (link->selector) g_object_set(link->selector, "active-pad", link->sel_pads[i], NULL);
+            gst_pad_add_probe(link->tee_pads[i], GST_PAD_PROBE_TYPE_BUFFER, on_branch_first_buffer, mi, NULL);
+        }
+    }
+    if (!ok) media_ingest_detach(branch);
+    return ok;
+}
+
+// Стан лишається на гілці до її знищення: проби на щойно звільнених
+// pad tee ще можуть завершуватися в потоках шарів
+void media_ingest_detach(GstElement *branch) {
+    BranchLink *link = (BranchLink*)g_object_get_data(G_OBJECT(branch), BRANCH_LINK_KEY);
+    if (!link || link->detached) return;
+    link->detached = true;
+    // Незавершене перемикання не повинно спрацювати на від'єднаній гілці
+    link->pending.store(G_MAXUINT, std::memory_order_release);
+    release_tee_pads(link);
+}
+
+guint media_ingest_layer_count(MediaIngest *mi) {
+    resolve_layers(mi);
+    return mi->n_layers;
+}
+
+const VideoSettings *media_ingest_layer_settings(MediaIngest *mi, guint layer) {
+    if (!layered(mi)) return media_ingest_video_settings(mi);
+    return &mi->layers[MIN(layer, mi->n_layers - 1)].settings;
+}
+
+void media_ingest_select_layer(MediaIngest *mi, GstElement *branch, guint layer) {
+    if (!layered(mi)) return;
+    layer = MIN(layer, mi->n_layers - 1);
+    BranchLink *link = (BranchLink*)g_object_get_data(G_OBJECT(branch), BRANCH_LINK_KEY);
+    if (!link) {
+        g_object_set_data(G_OBJECT(branch), BRANCH_LAYER_KEY, GUINT_TO_POINTER(layer + 1));
+        return;
+    }
+    if (link->detached || !link->selector) return;
+
+    if (link->pending.exchange(layer, std::memory_order_acq_rel) == layer) return;
+    // Повернення до активного шару лише скасовує очікування
+    if (link->active.load(std::memory_order_acquire) == layer) return;
+    link->switch_requested_us.store(g_get_monotonic_time(), std::memory_order_relaxed);
+    gst_pad_add_probe(link->tee_pads[layer], GST_PAD_PROBE_TYPE_BUFFER, on_layer_switch,
+                      &link->switches[layer], NULL);
+    request_keyframe(link->tee_pads[layer]);
+}
+
+// --- Керування кодером ---
+static GstElement *get_ingest_element(MediaIngest *mi, const char *name) {
+    return mi->pipeline ? gst_bin_get_by_name(GST_BIN(mi->pipeline), name) : nullptr;
+}
+
+bool media_ingest_has_encoder(MediaIngest *mi) {
+    GstElement *encoder = get_ingest_element(mi, layered(mi) ? "encoder0" : "encoder");
+    if (!encoder) return false;
+    gst_object_unref(encoder);
+    return true;
+}
+
+bool media_ingest_set_bitrate(MediaIngest *mi, guint bitrate) {
+    GstElement *encoder = get_ingest_element(mi, "encoder");
+    if (!encoder) return false;
+
+    bool ok = true;
+    GstElementFactory *factory = gst_element_get_factory(encoder);
+    const gchar *name = factory ? gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory)) : "";
+    if (!g_strcmp0(name, "x264enc")) {
+        g_object_set(encoder, "bitrate", bitrate / 1000, NULL);
+    } else if (!g_strcmp0(name, "v4l2h264enc")) {
+        // V4L2-контроли застосовуються до відкритого пристрою одразу
+        GstStructure *controls = gst_structure_new("controls",
+            "repeat_sequence_header", G_TYPE_INT, 1,
+            "video_bitrate", G_TYPE_INT, (gint)bitrate,
+            "h264_i_frame_period", G_TYPE_INT, (gint)mi->mc->keyframe_interval,
+            NULL);
+        g_object_set(encoder, "extra-controls", controls, NULL);
+        gst_structure_free(controls);
+    } else {
+        ok = false;
+    }
+    gst_object_unref(encoder);
+    return ok;
+}
+
+bool media_ingest_set_video_format(MediaIngest *mi, guint width, guint height, guint framerate) {
+    // Формати шарів задані наборами; rawcaps там — лише вхід масштабування
+    if (layered(mi)) return false;
+    GstElement *rawcaps = get_ingest_element(mi, "rawcaps");
+    if (!rawcaps) return false;
+
+    // Нові caps спричиняють переузгодження між джерелом і кодером.
+    // Формат, якого не дає камера або не приймає кодер, зупинив би
+    // ingest помилкою not-negotiated, тож його відхиляємо заздалегідь.
+    GstCaps *caps = gst_caps_new_simple("video/x-raw",
+        "width", G_TYPE_INT, (gint)width,
+        "height", G_TYPE_INT, (gint)height,
+        "framerate", GST_TYPE_FRACTION, (gint)framerate, 1,
+        NULL);
+    GstPad *sink = gst_element_get_static_pad(rawcaps, "sink");
+    GstPad *src = gst_element_get_static_pad(rawcaps, "src");
+    bool ok = gst_pad_peer_query_accept_caps(sink, caps) && gst_pad_peer_query_accept_caps(src, caps);
+    gst_object_unref(sink);
+    gst_object_unref(src);
+
+    if (ok) {
+        g_object_set(rawcaps, "caps", caps, NULL);
+    } else {
+        LOG_WARN("INGEST", "Video format %ux%u@%u not supported by source or encoder",
+                 width, height, framerate);
+    }
+    gst_caps_unref(caps);
+    gst_object_unref(rawcaps);
+    return ok;
+}
+
+const VideoSettings *media_ingest_video_settings(MediaIngest *mi) {
+    if (layered(mi)) return &mi->layers[mi->n_layers - 1].settings;
+    if (!mi->video_configured) {
+        const MediaConfig &mc = *mi->mc;
+        mi->video.width = mc.width;
+        mi->video.height = mc.height;
+        mi->video.framerate = mc.framerate;
+        mi->video.bitrate = mc.bitrate;
+    }
+    return &mi->video;
+}
+
+bool media_ingest_configure(MediaIngest *mi, const VideoSettings *settings) {
+    // RTP від start_camera.sh: параметри задає libcamera-vid;
+    // у багатошаровому режимі — набори шарів
+    if (!g_strcmp0(mi->mc->source, "udp") || layered(mi)) return false;
+
+    if (mi->pipeline && !media_ingest_set_video_format(mi, settings->width, settings->height, settings->framerate)) {
+        return false;
+    }
+    mi->video = *settings;
+    mi->video_configured = true;
+    media_ingest_set_bitrate(mi, settings->bitrate);
+
+    LOG_INFO("INGEST", "Video configured: %ux%u@%u, %u bps%s",
+             mi->video.width, mi->video.height, mi->video.framerate, mi->video.bitrate,
+             mi->pipeline ? "" : " (applied on next start)");
+    return true;
+}
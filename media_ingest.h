@@ -0,0 +1,80 @@
+#ifndef MEDIA_INGEST_H
+#define MEDIA_INGEST_H
+
+#include <gst/gst.h>
+
+// Постійна частина конвеєра пристрою: джерело H.264 → h264parse → tee.
+// Джерело — RTP з start_camera.sh або камера з кодером у цьому процесі
+// (див. [media] source у файлі конфігурації).
+// Гілки сесій (webrtcbin) під'єднуються до tee і від'єднуються від нього,
+// не зупиняючи ingest.
+struct MediaIngest;
+struct MediaConfig;
+struct VideoSettings;
+
+// Ingest одного пристрою з його [media]; конфігурація живе довше за нього.
+// Pipeline і гілки, які ще зупиняє робочий потік, тримають власні
+// посилання, тож unref можна викликати одразу після release.
+MediaIngest *media_ingest_new(const MediaConfig *config);
+void media_ingest_unref(MediaIngest *mi);
+
+// Створює pipeline у стані NULL; повертає позичений вказівник.
+// Запуск і зупинка можуть тривати секунди (відкриття камери, завершення
+// потоків), тому їх виконує робочий потік lifecycle, а не головний цикл.
+GstElement *media_ingest_create(MediaIngest *mi);
+// Переводить pipeline у PLAYING; при невдачі повертає його в NULL
+bool media_ingest_play(GstElement *pipeline);
+// Від'єднує pipeline від ingest і повертає посилання на нього;
+// викликач має зупинити і звільнити його (lifecycle_dispose)
+GstElement *media_ingest_release(MediaIngest *mi);
+bool media_ingest_is_running(MediaIngest *mi);
+
+// Під'єднує гілку до tee (у багатошаровому режимі — до tee кожного шару).
+// Новій гілці спершу віддається закешована GOP (SPS/PPS/IDR і наступні
+// кадри), тож декодер стартує одразу, а не чекає наступного ключового кадру.
+// У profile=low-latency закешована GOP не віддається, а гілка не
+// пропускає кадри, старші за max_frame_age_ms.
+bool media_ingest_attach(MediaIngest *mi, GstElement *branch);
+void media_ingest_detach(GstElement *branch);
+
+// Опис початку гілки для поточного профілю: вибір шару (name=layersel)
+// у багатошаровому режимі і черга name=branchqueue; звільнити через g_free
+gchar *media_ingest_branch_queue_description(MediaIngest *mi);
+
+// Керування кодером на ходу; false, якщо джерело без власного кодера (udp)
+bool media_ingest_has_encoder(MediaIngest *mi);
+bool media_ingest_set_bitrate(MediaIngest *mi, guint bitrate);
+// false також, якщо камера або кодер не приймають такий формат
+bool media_ingest_set_video_format(MediaIngest *mi, guint width, guint height, guint framerate);
+
+// Кадри на вході tee і відкинуті (сирі й застарілі) від створення ingest;
+// для телеметрії пристрою, з будь-якого потоку
+void media_ingest_frame_counts(MediaIngest *mi, guint64 *frames, guint64 *dropped);
+
+// Базові параметри відео: з [media] до першого configure, у
+// багатошаровому режимі — найякіснішого шару. Регулятор бітрейту знижує
+// якість відносно них і повертається до них.
+struct VideoSettings {
+    guint width;
+    guint height;
+    guint framerate;
+    guint bitrate;      // біт/с
+};
+
+const VideoSettings *media_ingest_video_settings(MediaIngest *mi);
+// Застосовує параметри до працюючого кодера без перезапуску ingest
+// (нові caps і властивості кодера) і зберігає їх для наступних запусків.
+// false — джерело без власного кодера (udp), багатошаровий режим або
+// формат не підтримується.
+bool media_ingest_configure(MediaIngest *mi, const VideoSettings *settings);
+
+// Багатошаровий режим ([media] layers): кожен набір кодується один раз,
+// а гілка отримує один шар. Кількість шарів (1 — звичайний режим) і їхні
+// параметри за зростанням бітрейту.
+guint media_ingest_layer_count(MediaIngest *mi);
+const VideoSettings *media_ingest_layer_settings(MediaIngest *mi, guint layer);
+// Шар для гілки; можна викликати до attach. Гілка переходить на новий шар
+// на його найближчому IDR (запитується одразу), до того — отримує попередній.
+void media_ingest_select_layer(MediaIngest *mi, GstElement *branch, guint layer);
+
+#endif // MEDIA_INGEST_H
@@ -0,0 +1,188 @@
+#include "metrics.h"
+#include "config.h"
+#include "log.h"
+#include <libsoup/soup.h>
+#include <atomic>
+#include <cstring>
+
+// Межі кошиків у мікросекундах; останній кошик — +Inf
+static const gint64 bucket_bounds_us[] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000,
+    50000, 100000, 250000, 500000, 1000000, 2500000, 5000000
+};
+#define BUCKET_COUNT (G_N_ELEMENTS(bucket_bounds_us) + 1)
+
+struct MetricDesc {
+    const char *name;
+    const char *labels;   // готовий фрагмент без дужок, nullptr — без міток
+    const char *help;
+};
+
+// HELP задано лише для першої метрики родини
+static const MetricDesc counter_desc[METRIC_COUNTER_COUNT] = {
+    { "webrccar_commands_received_total", "source=\"websocket\"", "Motor commands received" },
+    { "webrccar_commands_received_total", "source=\"datachannel\"", nullptr },
+    { "webrccar_commands_coalesced_total", nullptr, "Commands superseded by a newer one within a control tick" },
+    { "webrccar_commands_dropped_total", "reason=\"queue_full\"", "Commands dropped before reaching the motors" },
+    { "webrccar_commands_dropped_total", "reason=\"stale\"", nullptr },
+    { "webrccar_commands_applied_total", nullptr, "Drive commands applied to the motors" },
+    { "webrccar_stops_applied_total", nullptr, "Stops applied to the motors" },
+    { "webrccar_ice_restarts_total", nullptr, "ICE restarts offered after connectivity loss" },
+    { "webrccar_peers_lost_total", nullptr, "Peers removed after connectivity did not recover in time" },
+    { "webrccar_keyframe_requests_total", "result=\"forwarded\"", "Keyframe requests (PLI/FIR, new branches) seen by the ingest" },
+    { "webrccar_keyframe_requests_total", "result=\"throttled\"", nullptr },
+    { "webrccar_keyframe_requests_total", "result=\"unsupported\"", nullptr },
+    { "webrccar_frames_dropped_total", "reason=\"raw_queue\"", "Video frames dropped to bound latency" },
+    { "webrccar_frames_dropped_total", "reason=\"stale\"", nullptr },
+    { "webrccar_frames_dropped_total", "reason=\"dashcam_queue\"", nullptr },
+    { "webrccar_dashcam_segments_total", nullptr, "Dashcam segments opened" },
+    { "webrccar_frames_ingested_total", nullptr, "Encoded video frames entering the ingest tee" },
+    { "webrccar_telemetry_packets_total", "result=\"sent\"", "Telemetry packets for viewers" },
+    { "webrccar_telemetry_packets_total", "result=\"dropped\"", nullptr },
+    { "webrccar_rtx_packets_total", "result=\"requested\"", "Video packets viewers asked to retransmit (NACK)" },
+    { "webrccar_rtx_packets_total", "result=\"retransmitted\"", nullptr },
+    { "webrccar_fec_packets_total", nullptr, "ULPFEC packets sent to viewers" },
+    { "webrccar_packets_unrecovered_total", nullptr, "Video packets viewers reported lost after RTX/FEC recovery" },
+};
+
+static const MetricDesc histogram_desc[METRIC_HISTOGRAM_COUNT] = {
+    { "webrccar_command_latency_seconds", "source=\"websocket\"", "Command receipt to last motor output write" },
+    { "webrccar_command_latency_seconds", "source=\"datachannel\"", nullptr },
+    { "webrccar_command_queue_wait_seconds", nullptr, "Command receipt to dequeue by the control thread" },
+    { "webrccar_actuation_seconds", nullptr, "Time spent writing GPIO and PWM for one command" },
+    { "webrccar_pipeline_start_seconds", "stage=\"ingest\"", "Time to bring up a pipeline part" },
+    { "webrccar_pipeline_stop_seconds", "stage=\"ingest\"", "Time to tear down a pipeline part" },
+    { "webrccar_pipeline_start_seconds", "stage=\"peer\"", nullptr },
+    { "webrccar_pipeline_stop_seconds", "stage=\"peer\"", nullptr },
+    { "webrccar_pipeline_stop_seconds", "stage=\"dashcam\"", nullptr },
+    { "webrccar_ice_recovery_seconds", nullptr, "Connectivity loss to ICE connected again" },
+    { "webrccar_keyframe_recovery_seconds", nullptr, "Forwarded keyframe request to the next IDR at the ingest tee" },
+    { "webrccar_frame_age_seconds", nullptr, "Frame age (running time since capture) leaving a peer branch queue" },
+    { "webrccar_frame_stage_seconds", "stage=\"ingest\"", "Frame age (running time since capture) leaving a pipeline stage" },
+    { "webrccar_frame_stage_seconds", "stage=\"payload\"", nullptr },
+    { "webrccar_frame_stage_seconds", "stage=\"send\"", nullptr },
+    { "webrccar_glass_to_glass_seconds", nullptr, "Capture to display latency reported by viewers" },
+};
+
+struct Histogram {
+    std::atomic<guint64> buckets[BUCKET_COUNT];
+    std::atomic<guint64> sum_us;
+};
+
+static std::atomic<guint64> counters[METRIC_COUNTER_COUNT];
+static Histogram histograms[METRIC_HISTOGRAM_COUNT];
+static SoupServer *server = nullptr;
+
+void metrics_inc(MetricCounter counter, guint64 n) {
+    counters[counter].fetch_add(n, std::memory_order_relaxed);
+}
+
+guint64 metrics_counter_value(MetricCounter counter) {
+    return counters[counter].load(std::memory_order_relaxed);
+}
+
+void metrics_observe(MetricHistogram histogram, gint64 duration_us) {
+    if (duration_us < 0) duration_us = 0;
+    gsize i = 0;
+    while (i < G_N_ELEMENTS(bucket_bounds_us) && duration_us > bucket_bounds_us[i]) i++;
+
+    Histogram &h = histograms[histogram];
+    h.buckets[i].fetch_add(1, std::memory_order_relaxed);
+    h.sum_us.fetch_add((guint64)duration_us, std::memory_order_relaxed);
+}
+
+// HELP/TYPE лише для першої метрики родини
+static void render_header(GString *out, const MetricDesc &d, const char *type) {
+    if (!d.help) return;
+    g_string_append_printf(out, "# HELP %s %s\n# TYPE %s %s\n", d.name, d.help, d.name, type);
+}
+
+static void render_histogram(GString *out, const MetricDesc &d, const Histogram &h) {
+    render_header(out, d, "histogram");
+    const char *sep = d.labels ? "," : "";
+    const char *labels = d.labels ? d.labels : "";
+
+    // Кошики в Prometheus кумулятивні
+    guint64 cumulative = 0;
+    for (gsize i = 0; i < BUCKET_COUNT; i++) {
+        cumulative += h.buckets[i].load(std::memory_order_relaxed);
+        if (i < G_N_ELEMENTS(bucket_bounds_us)) {
+            g_string_append_printf(out, "%s_bucket{%s%sle=\"%g\"} %" G_GUINT64_FORMAT "\n",
+                                   d.name, labels, sep, bucket_bounds_us[i] / 1e6, cumulative);
+        } else {
+            g_string_append_printf(out, "%s_bucket{%s%sle=\"+Inf\"} %" G_GUINT64_FORMAT "\n",
+                                   d.name, labels, sep, cumulative);
+        }
+    }
+
+    gdouble sum = h.sum_us.load(std::memory_order_relaxed) / 1e6;
+    if (d.labels) {
+        g_string_append_printf(out, "%s_sum{%s} %g\n%s_count{%s} %" G_GUINT64_FORMAT "\n",
+                               d.name, labels, sum, d.name, labels, cumulative);
+    } else {
+        g_string_append_printf(out, "%s_sum %g\n%s_count %" G_GUINT64_FORMAT "\n",
+                               d.name, sum, d.name, cumulative);
+    }
+}
+
+gchar *metrics_render() {
+    GString *out = g_string_sized_new(8192);
+
+    for (int i = 0; i < METRIC_COUNTER_COUNT; i++) {
+        const MetricDesc &d = counter_desc[i];
+        render_header(out, d, "counter");
+        guint64 v = counters[i].load(std::memory_order_relaxed);
+        if (d.labels) {
+            g_string_append_printf(out, "%s{%s} %" G_GUINT64_FORMAT "\n", d.name, d.labels, v);
+        } else {
+            g_string_append_printf(out, "%s %" G_GUINT64_FORMAT "\n", d.name, v);
+        }
+    }
+
+    // Родини гістограм у таблиці перемежовані, тож виводимо їх по родинах
+    for (int i = 0; i < METRIC_HISTOGRAM_COUNT; i++) {
+        if (!histogram_desc[i].help) continue;
+        for (int j = i; j < METRIC_HISTOGRAM_COUNT; j++) {
+            if (!g_strcmp0(histogram_desc[j].name, histogram_desc[i].name)) {
+                render_histogram(out, histogram_desc[j], histograms[j]);
+            }
+        }
+    }
+
+    return g_string_free(out, FALSE);
+}
+
+static void on_metrics_request(SoupServer*, SoupServerMessage *msg, const char*, GHashTable*, gpointer) {
+    if (g_strcmp0(soup_server_message_get_method(msg), "GET")) {
+        soup_server_message_set_status(msg, SOUP_STATUS_METHOD_NOT_ALLOWED, NULL);
+        return;
+    }
+    gchar *body = metrics_render();
+    soup_server_message_set_status(msg, SOUP_STATUS_OK, NULL);
+    soup_server_message_set_response(msg, "text/plain; version=0.0.4", SOUP_MEMORY_TAKE, body, strlen(body));
+}
+
+bool metrics_server_start() {
+    const MetricsConfig &mc = config_get()->metrics;
+    if (!mc.enabled || server) return true;
+
+    server = soup_server_new(NULL, NULL);
+    soup_server_add_handler(server, "/metrics", on_metrics_request, NULL, NULL);
+
+    // Лише loopback: метрики не повинні бути видимі з мережі
+    GError *err = nullptr;
+    if (!soup_server_listen_local(server, mc.port, SOUP_SERVER_LISTEN_IPV4_ONLY, &err)) {
+        LOG_ERROR("METRICS", "Cannot listen on 127.0.0.1:%u: %s", mc.port, err->message);
+        g_error_free(err);
+        g_clear_object(&server);
+        return false;
+    }
+    LOG_INFO("METRICS", "Serving http://127.0.0.1:%u/metrics", mc.port);
+    return true;
+}
+
+void metrics_server_stop() {
+    if (!server) return;
+    soup_server_disconnect(server);
+    g_clear_object(&server);
+}
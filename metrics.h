@@ -0,0 +1,68 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <glib.h>
+
+// Лічильники ([metrics] у конфігурації). Оновлення — атомарні, без блокувань,
+// тож їх можна викликати з потоку керування, SCTP і головного циклу.
+enum MetricCounter {
+    METRIC_COMMANDS_RECEIVED_WS,
+    METRIC_COMMANDS_RECEIVED_DC,
+    METRIC_COMMANDS_COALESCED,         // вичитані, але перекриті новішою за такт
+    METRIC_COMMANDS_DROPPED_QUEUE,     // черга потоку керування переповнена
+    METRIC_COMMANDS_DROPPED_STALE,     // застарілий seq у data channel
+    METRIC_COMMANDS_APPLIED,
+    METRIC_STOPS_APPLIED,
+    METRIC_ICE_RESTARTS,
+    METRIC_PEERS_LOST,                 // зв'язок не відновився до тайм-ауту
+    METRIC_KEYFRAME_REQUESTS_FORWARDED,  // PLI/FIR передано кодеру
+    METRIC_KEYFRAME_REQUESTS_THROTTLED,  // відкинуто: попередній запит надто недавно
+    METRIC_KEYFRAME_REQUESTS_UNSUPPORTED, // відкинуто: кодер в іншому процесі (udp)
+    METRIC_FRAMES_DROPPED_RAW,         // low-latency: сирий кадр витіснено з черги перед кодером
+    METRIC_FRAMES_DROPPED_STALE,       // low-latency: кадр гілки старший за max_frame_age_ms
+    METRIC_FRAMES_DROPPED_DASHCAM,     // черга запису переповнена (повільний диск)
+    METRIC_DASHCAM_SEGMENTS,
+    METRIC_FRAMES_INGESTED,            // закодовані кадри на вході tee
+    METRIC_TELEMETRY_PACKETS_SENT,
+    METRIC_TELEMETRY_PACKETS_DROPPED,  // канал телеметрії не встигає відправляти
+    METRIC_RTX_REQUESTED,              // пакети, які глядачі просили повторити (NACK)
+    METRIC_RTX_RETRANSMITTED,          // повторені в межах rtx_time_ms
+    METRIC_FEC_PACKETS,                // надіслані пакети ULPFEC
+    METRIC_PACKETS_UNRECOVERED,        // втрачені попри RTX/FEC, за RTCP глядачів
+    METRIC_COUNTER_COUNT
+};
+
+// Гістограми тривалостей у мікросекундах
+enum MetricHistogram {
+    METRIC_COMMAND_LATENCY_WS,         // прийом у on_ws_message → останній запис виходу
+    METRIC_COMMAND_LATENCY_DC,         // прийом у data channel → останній запис виходу
+    METRIC_COMMAND_QUEUE_WAIT,         // прийом → вичитування потоком керування
+    METRIC_ACTUATION,                  // drive_vehicle/stop_vehicle
+    METRIC_INGEST_START,
+    METRIC_INGEST_STOP,
+    METRIC_PEER_START,
+    METRIC_PEER_STOP,
+    METRIC_DASHCAM_STOP,
+    METRIC_ICE_RECOVERY,               // втрата зв'язку ICE → знову CONNECTED
+    METRIC_KEYFRAME_RECOVERY,          // переданий запит ключового кадру → IDR на tee
+    METRIC_FRAME_AGE,                  // вік кадру на виході черги гілки глядача
+    METRIC_STAGE_INGEST,               // вік кадру на вході tee: захоплення, кодування, h264parse
+    METRIC_STAGE_PAYLOAD,              // вік кадру на виході rtph264pay (останній RTP-пакет кадру)
+    METRIC_STAGE_SEND,                 // вік кадру в nicesink webrtcbin (останній пакет кадру)
+    METRIC_GLASS_TO_GLASS,             // захоплення → показ, за звітами глядачів
+    METRIC_HISTOGRAM_COUNT
+};
+
+void metrics_inc(MetricCounter counter, guint64 n = 1);
+void metrics_observe(MetricHistogram histogram, gint64 duration_us);
+// Поточне значення лічильника (для телеметрії)
+guint64 metrics_counter_value(MetricCounter counter);
+
+// Текст у форматі Prometheus; звільнити через g_free
+gchar *metrics_render();
+
+// HTTP-ендпоінт /metrics на локальній адресі; false, якщо не вдалося слухати порт
+bool metrics_server_start();
+void metrics_server_stop();
+
+#endif // METRICS_H
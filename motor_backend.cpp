@@ -0,0 +1,19 @@
+#include "motor_backend.h"
+
+static const MotorBackend *backends[] = {
+#ifdef HAVE_HW_BACKEND
+    &motor_backend_hw,
+#endif
+    &motor_backend_sim,
+};
+
+const char *motor_backend_default_name() {
+    return backends[0]->name;
+}
+
+const MotorBackend *motor_backend_find(const char *name) {
+    for (const MotorBackend *b : backends) {
+        if (!g_strcmp0(b->name, name)) return b;
+    }
+    return nullptr;
+}
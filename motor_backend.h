@@ -0,0 +1,86 @@
+#ifndef MOTOR_BACKEND_H
+#define MOTOR_BACKEND_H
+
+#include <glib.h>
+#include <cstdint>
+
+// Логічні виходи H-моста L298N
+enum MotorPin {
+    MOTOR_PIN_IN1_BACK,
+    MOTOR_PIN_IN2_FWD,
+    MOTOR_PIN_IN3_LEFT,
+    MOTOR_PIN_IN4_RIGHT,
+    MOTOR_PIN_COUNT
+};
+
+enum MotorPwm {
+    MOTOR_PWM_A,    // вперед/назад
+    MOTOR_PWM_B,    // поворот
+    MOTOR_PWM_COUNT
+};
+
+// Номери BCM GPIO одного моста ([control] pins і pwm_pins)
+struct MotorPins {
+    guint in[MOTOR_PIN_COUNT];
+    guint pwm[MOTOR_PWM_COUNT];
+};
+
+struct MotorBackend;
+
+// Відкритий міст; кожен бекенд розширює його власним станом
+struct MotorBridge {
+    const MotorBackend *backend;
+};
+
+// Реалізація виходів. gpio_control працює лише через цю таблицю, тож той
+// самий шлях команд можна запускати без Raspberry Pi. Кожна машина
+// відкриває свій міст; мости одного бекенда незалежні.
+struct MotorBackend {
+    const char *name;
+    // Запитує лінії з нульовим рівнем і готує PWM; nullptr — помилка
+    MotorBridge *(*open)(const MotorPins *pins);
+    void (*close)(MotorBridge *bridge);
+    // Усі чотири входи H-моста одним записом, щоб міст не бачив проміжних станів
+    bool (*set_pins)(MotorBridge *bridge, const int values[MOTOR_PIN_COUNT]);
+    bool (*set_duty)(MotorBridge *bridge, MotorPwm channel, int percent);
+};
+
+// Вибір за назвою ([control] backend); nullptr — назва невідома
+// або бекенд не зібрано
+const MotorBackend *motor_backend_find(const char *name);
+
+// Назва бекенда за замовчуванням для цієї збірки
+const char *motor_backend_default_name();
+
+extern const MotorBackend motor_backend_sim;
+#ifdef HAVE_HW_BACKEND
+extern const MotorBackend motor_backend_hw;   // libgpiod + pigpio
+#endif
+
+// --- Журнал симулятора ---
+// Функції нижче приймають лише мости motor_backend_sim
+enum MotorTransitionKind : uint8_t {
+    MOTOR_TRANSITION_PIN,
+    MOTOR_TRANSITION_DUTY
+};
+
+struct MotorTransition {
+    gint64  time_us;        // g_get_monotonic_time()
+    uint8_t kind;           // MotorTransitionKind
+    uint8_t index;          // MotorPin або MotorPwm
+    int16_t value;          // рівень виходу або заповнення, %
+};
+
+// Журнал кільцевий: зберігаються останні MOTOR_SIM_LOG_CAPACITY переходів
+#define MOTOR_SIM_LOG_CAPACITY 65536
+
+// Копіює до max останніх переходів у хронологічному порядку
+gsize motor_sim_transitions(const MotorBridge *bridge, MotorTransition *out, gsize max);
+// Кількість переходів від останнього скидання, включно з перезаписаними
+guint64 motor_sim_transition_count(const MotorBridge *bridge);
+void motor_sim_reset(MotorBridge *bridge);
+// Поточний стан симульованих виходів
+int motor_sim_pin(const MotorBridge *bridge, MotorPin pin);
+int motor_sim_duty(const MotorBridge *bridge, MotorPwm channel);
+
+#endif // MOTOR_BACKEND_H
@@ -0,0 +1,151 @@
+#include "motor_backend.h"
+#include "log.h"
+#include <gpiod.h>
+#include <pigpio.h>
+
+#define PWM_FREQUENCY 1000  // 1 kHz
+#define PWM_RANGE     100   // програмний PWM: заповнення прямо у відсотках
+
+struct HwBridge : MotorBridge {
+    struct gpiod_chip *chip;
+    struct gpiod_line_bulk lines;   // порядок збігається з MotorPin
+    bool lines_requested;
+    bool pigpio;                    // тримає ініціалізацію pigpio
+    guint64 gpios;                  // біт n — GPIOn належить цьому мосту
+    guint pwm_gpios[MOTOR_PWM_COUNT];
+    int hardware_channel[MOTOR_PWM_COUNT];   // -1 — програмний PWM
+};
+
+// Спільне для всіх мостів процесу; відкриття і закриття — лише головний потік
+static guint pigpio_users = 0;
+static guint64 gpios_in_use = 0;
+static guint hardware_channels = 0;     // біт n — апаратний канал n зайнятий
+
+static const char *CONSUMER = "vehicle_control";
+
+// Апаратний PWM є лише на GPIO12/18 (канал 0) і GPIO13/19 (канал 1).
+// Виходу, чий канал уже зайнятий іншим мостом, дістається програмний
+// PWM pigpio (DMA), який працює на будь-якому GPIO.
+static int hardware_pwm_channel(guint gpio) {
+    switch (gpio) {
+        case 12: case 18: return 0;
+        case 13: case 19: return 1;
+        default: return -1;
+    }
+}
+
+static guint64 gpio_bit(guint gpio) {
+    return G_GUINT64_CONSTANT(1) << gpio;
+}
+
+static void hw_close(MotorBridge *bridge) {
+    HwBridge *hb = (HwBridge*)bridge;
+    if (hb->pigpio) {
+        // Зупинити PWM
+        for (int ch = 0; ch < MOTOR_PWM_COUNT; ch++) {
+            if (hb->hardware_channel[ch] >= 0) {
+                gpioHardwarePWM(hb->pwm_gpios[ch], 0, 0);
+                hardware_channels &= ~(1u << hb->hardware_channel[ch]);
+            } else {
+                gpioPWM(hb->pwm_gpios[ch], 0);
+            }
+        }
+        if (--pigpio_users == 0) gpioTerminate();
+    }
+    if (hb->lines_requested) gpiod_line_release_bulk(&hb->lines);
+    if (hb->chip) gpiod_chip_close(hb->chip);
+    gpios_in_use &= ~hb->gpios;
+    g_free(hb);
+}
+
+static bool open_lines(HwBridge *hb, const MotorPins *pins) {
+    hb->chip = gpiod_chip_open_by_name("gpiochip0");
+    if (!hb->chip) {
+        LOG_ERROR("GPIO", "Cannot open gpiochip0");
+        return false;
+    }
+    unsigned int offsets[MOTOR_PIN_COUNT];
+    for (int i = 0; i < MOTOR_PIN_COUNT; i++) offsets[i] = pins->in[i];
+    if (gpiod_chip_get_lines(hb->chip, offsets, MOTOR_PIN_COUNT, &hb->lines) < 0) {
+        LOG_ERROR("GPIO", "Cannot get GPIO lines");
+        return false;
+    }
+    static const int initial[MOTOR_PIN_COUNT] = {};
+    if (gpiod_line_request_bulk_output(&hb->lines, CONSUMER, initial) < 0) {
+        LOG_ERROR("GPIO", "Failed to request GPIO lines as output");
+        return false;
+    }
+    hb->lines_requested = true;
+    return true;
+}
+
+static bool open_pwm(HwBridge *hb, const MotorPins *pins) {
+    if (pigpio_users == 0 && gpioInitialise() < 0) {
+        LOG_ERROR("GPIO", "pigpio initialization failed");
+        return false;
+    }
+    pigpio_users++;
+    hb->pigpio = true;
+
+    for (int ch = 0; ch < MOTOR_PWM_COUNT; ch++) {
+        guint gpio = pins->pwm[ch];
+        hb->pwm_gpios[ch] = gpio;
+        gpioSetMode(gpio, PI_OUTPUT);
+        int hw = hardware_pwm_channel(gpio);
+        if (hw >= 0 && !(hardware_channels & (1u << hw))) {
+            hardware_channels |= 1u << hw;
+            hb->hardware_channel[ch] = hw;
+        } else {
+            hb->hardware_channel[ch] = -1;
+            gpioSetPWMfrequency(gpio, PWM_FREQUENCY);
+            gpioSetPWMrange(gpio, PWM_RANGE);
+            LOG_INFO("GPIO", "GPIO%u uses software PWM (no free hardware PWM channel)", gpio);
+        }
+    }
+    return true;
+}
+
+static MotorBridge *hw_open(const MotorPins *pins) {
+    guint64 gpios = 0;
+    for (guint gpio : pins->in) gpios |= gpio < 64 ? gpio_bit(gpio) : 0;
+    for (guint gpio : pins->pwm) gpios |= gpio < 64 ? gpio_bit(gpio) : 0;
+    if (__builtin_popcountll(gpios) != MOTOR_PIN_COUNT + MOTOR_PWM_COUNT) {
+        LOG_ERROR("GPIO", "Motor GPIOs must be six distinct numbers below 64");
+        return nullptr;
+    }
+    if (gpios & gpios_in_use) {
+        LOG_ERROR("GPIO", "Motor GPIOs overlap with another vehicle");
+        return nullptr;
+    }
+
+    HwBridge *hb = g_new0(HwBridge, 1);
+    hb->backend = &motor_backend_hw;
+    hb->gpios = gpios;
+    gpios_in_use |= gpios;
+    if (!open_lines(hb, pins) || !open_pwm(hb, pins)) {
+        hw_close(hb);
+        return nullptr;
+    }
+    return hb;
+}
+
+static bool hw_set_pins(MotorBridge *bridge, const int values[MOTOR_PIN_COUNT]) {
+    // Один GPIOHANDLE_SET_LINE_VALUES_IOCTL на всі лінії
+    return gpiod_line_set_value_bulk(&((HwBridge*)bridge)->lines, (int*)values) >= 0;
+}
+
+static bool hw_set_duty(MotorBridge *bridge, MotorPwm channel, int percent) {
+    HwBridge *hb = (HwBridge*)bridge;
+    guint gpio = hb->pwm_gpios[channel];
+    // dutycycle апаратного PWM у pigpio: 0-1e6
+    if (hb->hardware_channel[channel] >= 0) return gpioHardwarePWM(gpio, PWM_FREQUENCY, percent * 10000) == 0;
+    return gpioPWM(gpio, percent) == 0;
+}
+
+const MotorBackend motor_backend_hw = {
+    "hw",
+    hw_open,
+    hw_close,
+    hw_set_pins,
+    hw_set_duty,
+};
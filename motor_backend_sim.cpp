@@ -0,0 +1,115 @@
+#include "motor_backend.h"
+
+// Симулятор: виходи існують лише в пам'яті, кожен перехід потрапляє
+// в кільцевий журнал свого моста з монотонною міткою часу
+struct SimBridge : MotorBridge {
+    MotorTransition *log;     // MOTOR_SIM_LOG_CAPACITY записів
+    guint64 count;
+    int pins[MOTOR_PIN_COUNT];
+    int duty[MOTOR_PWM_COUNT];
+    GMutex lock;
+};
+
+static SimBridge *sim_bridge(const MotorBridge *bridge) {
+    g_return_val_if_fail(bridge && bridge->backend == &motor_backend_sim, nullptr);
+    return (SimBridge*)bridge;
+}
+
+static void record_locked(SimBridge *sb, gint64 now, MotorTransitionKind kind, int index, int value) {
+    MotorTransition &t = sb->log[sb->count % MOTOR_SIM_LOG_CAPACITY];
+    t.time_us = now;
+    t.kind = kind;
+    t.index = (uint8_t)index;
+    t.value = (int16_t)value;
+    sb->count++;
+}
+
+static MotorBridge *sim_open(const MotorPins*) {
+    SimBridge *sb = g_new0(SimBridge, 1);
+    sb->backend = &motor_backend_sim;
+    sb->log = g_new(MotorTransition, MOTOR_SIM_LOG_CAPACITY);
+    g_mutex_init(&sb->lock);
+    return sb;
+}
+
+static void sim_close(MotorBridge *bridge) {
+    SimBridge *sb = (SimBridge*)bridge;
+    g_mutex_clear(&sb->lock);
+    g_free(sb->log);
+    g_free(sb);
+}
+
+static bool sim_set_pins(MotorBridge *bridge, const int values[MOTOR_PIN_COUNT]) {
+    SimBridge *sb = (SimBridge*)bridge;
+    // Один запис — одна мітка часу для всіх ліній, як в одному ioctl.
+    // Журнал містить лише лінії, рівень яких змінився.
+    gint64 now = g_get_monotonic_time();
+    g_mutex_lock(&sb->lock);
+    for (int i = 0; i < MOTOR_PIN_COUNT; i++) {
+        if (sb->pins[i] != values[i]) {
+            sb->pins[i] = values[i];
+            record_locked(sb, now, MOTOR_TRANSITION_PIN, i, values[i]);
+        }
+    }
+    g_mutex_unlock(&sb->lock);
+    return true;
+}
+
+static bool sim_set_duty(MotorBridge *bridge, MotorPwm channel, int percent) {
+    SimBridge *sb = (SimBridge*)bridge;
+    gint64 now = g_get_monotonic_time();
+    g_mutex_lock(&sb->lock);
+    sb->duty[channel] = percent;
+    record_locked(sb, now, MOTOR_TRANSITION_DUTY, channel, percent);
+    g_mutex_unlock(&sb->lock);
+    return true;
+}
+
+const MotorBackend motor_backend_sim = {
+    "sim",
+    sim_open,
+    sim_close,
+    sim_set_pins,
+    sim_set_duty,
+};
+
+gsize motor_sim_transitions(const MotorBridge *bridge, MotorTransition *out, gsize max) {
+    SimBridge *sb = sim_bridge(bridge);
+    if (!sb) return 0;
+    g_mutex_lock(&sb->lock);
+    guint64 available = MIN(sb->count, (guint64)MOTOR_SIM_LOG_CAPACITY);
+    gsize n = (gsize)MIN((guint64)max, available);
+    guint64 first = sb->count - n;
+    for (gsize i = 0; i < n; i++) {
+        out[i] = sb->log[(first + i) % MOTOR_SIM_LOG_CAPACITY];
+    }
+    g_mutex_unlock(&sb->lock);
+    return n;
+}
+
+guint64 motor_sim_transition_count(const MotorBridge *bridge) {
+    SimBridge *sb = sim_bridge(bridge);
+    if (!sb) return 0;
+    g_mutex_lock(&sb->lock);
+    guint64 n = sb->count;
+    g_mutex_unlock(&sb->lock);
+    return n;
+}
+
+void motor_sim_reset(MotorBridge *bridge) {
+    SimBridge *sb = sim_bridge(bridge);
+    if (!sb) return;
+    g_mutex_lock(&sb->lock);
+    sb->count = 0;
+    g_mutex_unlock(&sb->lock);
+}
+
+int motor_sim_pin(const MotorBridge *bridge, MotorPin pin) {
+    SimBridge *sb = sim_bridge(bridge);
+    return sb ? sb->pins[pin] : 0;
+}
+
+int motor_sim_duty(const MotorBridge *bridge, MotorPwm channel) {
+    SimBridge *sb = sim_bridge(bridge);
+    return sb ? sb->duty[channel] : 0;
+}
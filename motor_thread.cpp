@@ -0,0 +1,308 @@
+#include "motor_thread.h"
+#include "gpio_control.h"
+#include "config.h"
+#include "metrics.h"
+#include "log.h"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#define MOTOR_QUEUE_CAPACITY  64   // степінь двійки
+#define MOTOR_MAX_PRODUCERS   (MOTOR_MAX_VEHICLES * MOTOR_QUEUES_PER_VEHICLE)
+
+// --- Кільцевий буфер без блокувань для одного виробника і одного споживача ---
+struct MotorQueue {
+    MotorCommand slots[MOTOR_QUEUE_CAPACITY];
+    alignas(64) std::atomic<uint32_t> head;   // пише лише споживач
+    alignas(64) std::atomic<uint32_t> tail;   // пише лише виробник
+    std::atomic<bool> released;
+    std::atomic<uint64_t> dropped;
+    guint target;                             // індекс у targets
+    char name[32];
+};
+
+// Машина, якою керує потік. Масив заповнюється до запуску потоку і
+// не змінюється, доки той працює.
+struct MotorTarget {
+    Vehicle *vehicle;
+    std::atomic<gint64> stop_request_us;
+    // Для телеметрії: коли застосовано останню команду і скільки вона йшла від прийому
+    std::atomic<gint64> last_applied_us;
+    std::atomic<gint64> last_latency_us;
+    gint64 handled_stop_us;                   // лише потік керування
+};
+
+static MotorTarget targets[MOTOR_MAX_VEHICLES];
+static guint n_targets = 0;
+static std::atomic<MotorQueue*> producers[MOTOR_MAX_PRODUCERS];
+static std::atomic<bool> running{false};
+static GThread *motor_thread = nullptr;
+
+static MotorTarget *find_target(const Vehicle *vehicle) {
+    for (guint i = 0; vehicle && i < n_targets; i++) {
+        if (targets[i].vehicle == vehicle) return &targets[i];
+    }
+    return nullptr;
+}
+
+bool motor_queue_push(MotorQueue *q, const MotorCommand *cmd) {
+    uint32_t tail = q->tail.load(std::memory_order_relaxed);
+    uint32_t head = q->head.load(std::memory_order_acquire);
+    if (tail - head >= MOTOR_QUEUE_CAPACITY) {
+        q->dropped.fetch_add(1, std::memory_order_relaxed);
+        metrics_inc(METRIC_COMMANDS_DROPPED_QUEUE);
+        return false;
+    }
+    q->slots[tail & (MOTOR_QUEUE_CAPACITY - 1)] = *cmd;
+    q->tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+static bool motor_queue_pop(MotorQueue *q, MotorCommand *out) {
+    uint32_t head = q->head.load(std::memory_order_relaxed);
+    uint32_t tail = q->tail.load(std::memory_order_acquire);
+    if (head == tail) return false;
+    *out = q->slots[head & (MOTOR_QUEUE_CAPACITY - 1)];
+    q->head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+MotorQueue *motor_queue_new(Vehicle *vehicle, const char *name) {
+    MotorTarget *t = find_target(vehicle);
+    if (!t) {
+        LOG_WARN("CONTROL", "Control thread does not drive the vehicle for %s", name);
+        return nullptr;
+    }
+    MotorQueue *q = new MotorQueue();
+    q->target = (guint)(t - targets);
+    g_strlcpy(q->name, name, sizeof(q->name));
+
+    for (auto &slot : producers) {
+        MotorQueue *expected = nullptr;
+        if (slot.compare_exchange_strong(expected, q, std::memory_order_acq_rel)) {
+            return q;
+        }
+    }
+    LOG_ERROR("CONTROL", "No free command queue slot for %s", name);
+    delete q;
+    return nullptr;
+}
+
+void motor_queue_release(MotorQueue *q) {
+    if (q) q->released.store(true, std::memory_order_release);
+}
+
+void motor_thread_request_stop(Vehicle *vehicle) {
+    MotorTarget *t = find_target(vehicle);
+    if (!t) return;
+    // Беремо найпізніший запит; порядок з командами визначає час прийому
+    gint64 now = g_get_monotonic_time();
+    gint64 prev = t->stop_request_us.load(std::memory_order_relaxed);
+    while (prev < now && !t->stop_request_us.compare_exchange_weak(prev, now, std::memory_order_release)) {
+    }
+}
+
+// --- Потік керування ---
+static void setup_realtime(const ControlConfig &cc) {
+    if (cc.realtime) {
+        struct sched_param sp = {};
+        sp.sched_priority = cc.priority;
+        int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+        if (err != 0) {
+            LOG_WARN("CONTROL", "SCHED_FIFO priority %d unavailable: %s", cc.priority, strerror(err));
+        } else {
+            LOG_INFO("CONTROL", "Running with SCHED_FIFO priority %d", cc.priority);
+        }
+    }
+    if (cc.cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cc.cpu, &set);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err != 0) {
+            LOG_WARN("CONTROL", "Cannot pin control thread to CPU %d: %s", cc.cpu, strerror(err));
+        }
+    }
+}
+
+static void timespec_add_us(struct timespec *ts, guint us) {
+    ts->tv_nsec += (long)us * 1000;
+    while (ts->tv_nsec >= 1000000000L) {
+        ts->tv_nsec -= 1000000000L;
+        ts->tv_sec++;
+    }
+}
+
+// Найновіша команда кожної машини за такт
+struct TickCommand {
+    MotorCommand latest;
+    bool found;
+    guint drained;
+};
+
+// Вичитує всі черги, розкладаючи команди за машинами
+static void collect_latest(TickCommand *tick) {
+    for (guint i = 0; i < n_targets; i++) {
+        tick[i].found = false;
+        tick[i].drained = 0;
+    }
+    gint64 now = g_get_monotonic_time();
+
+    for (auto &slot : producers) {
+        MotorQueue *q = slot.load(std::memory_order_acquire);
+        if (!q) continue;
+
+        // Прапор читаємо до вичитування, щоб не загубити останні команди
+        bool released = q->released.load(std::memory_order_acquire);
+        TickCommand &t = tick[q->target];
+        MotorCommand cmd;
+        while (motor_queue_pop(q, &cmd)) {
+            t.drained++;
+            metrics_observe(METRIC_COMMAND_QUEUE_WAIT, now - cmd.received_us);
+            if (!t.found || cmd.received_us >= t.latest.received_us) {
+                t.latest = cmd;
+                t.found = true;
+            }
+        }
+        if (released) {
+            slot.store(nullptr, std::memory_order_release);
+            delete q;
+        }
+    }
+}
+
+// queued == false — синтетична зупинка з motor_thread_request_stop()
+static void apply_command(MotorTarget *t, const MotorCommand &cmd, bool queued) {
+    gint64 start = g_get_monotonic_time();
+    if (cmd.stop) {
+        stop_vehicle(t->vehicle);
+        metrics_inc(METRIC_STOPS_APPLIED);
+    } else {
+        drive_vehicle(t->vehicle, cmd.direction, cmd.turn, cmd.speed);
+        metrics_inc(METRIC_COMMANDS_APPLIED);
+    }
+    gint64 end = g_get_monotonic_time();
+
+    metrics_observe(METRIC_ACTUATION, end - start);
+    t->last_latency_us.store(end - cmd.received_us, std::memory_order_relaxed);
+    t->last_applied_us.store(end, std::memory_order_relaxed);
+    if (queued) {
+        metrics_observe(cmd.source == MOTOR_SOURCE_DATACHANNEL ? METRIC_COMMAND_LATENCY_DC
+                                                               : METRIC_COMMAND_LATENCY_WS,
+                        end - cmd.received_us);
+    }
+}
+
+// Запит зупинки новіший за будь-яку команду перемагає
+static void apply_tick(MotorTarget *t, TickCommand &tick) {
+    MotorCommand &latest = tick.latest;
+    bool found = tick.found;
+    bool queued = found;
+
+    gint64 stop_us = t->stop_request_us.load(std::memory_order_acquire);
+    if (stop_us > t->handled_stop_us) {
+        t->handled_stop_us = stop_us;
+        if (!found || stop_us >= latest.received_us) {
+            latest = {};
+            latest.stop = true;
+            latest.received_us = stop_us;
+            found = true;
+            queued = false;
+        }
+    }
+
+    // Застосовується одна команда за такт, решта вичитаних перекрита
+    guint coalesced = queued ? tick.drained - 1 : tick.drained;
+    if (coalesced > 0) {
+        metrics_inc(METRIC_COMMANDS_COALESCED, coalesced);
+    }
+
+    if (found) {
+        apply_command(t, latest, queued);
+    }
+}
+
+static gpointer motor_thread_main(gpointer) {
+    const ControlConfig &cc = config_get()->control;
+    setup_realtime(cc);
+
+    for (guint i = 0; i < n_targets; i++) {
+        targets[i].handled_stop_us = targets[i].stop_request_us.load(std::memory_order_acquire);
+    }
+    TickCommand tick[MOTOR_MAX_VEHICLES];
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (running.load(std::memory_order_acquire)) {
+        timespec_add_us(&next, cc.tick_us);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+        collect_latest(tick);
+        for (guint i = 0; i < n_targets; i++) {
+            apply_tick(&targets[i], tick[i]);
+        }
+
+        // Якщо такт перевищено, не доганяємо пропущені, а стартуємо від «зараз»
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > next.tv_sec || (now.tv_sec == next.tv_sec && now.tv_nsec > next.tv_nsec)) {
+            next = now;
+        }
+    }
+    return nullptr;
+}
+
+bool motor_thread_start(Vehicle *const *vehicles, guint n_vehicles) {
+    if (motor_thread) return true;
+    // Кожній машині мають лишатися її черги з спільного пулу
+    if (n_vehicles > MOTOR_MAX_VEHICLES || n_vehicles * MOTOR_QUEUES_PER_VEHICLE > MOTOR_MAX_PRODUCERS) {
+        LOG_ERROR("CONTROL", "At most %d vehicles per process", MOTOR_MAX_VEHICLES);
+        return false;
+    }
+
+    for (guint i = 0; i < n_vehicles; i++) {
+        MotorTarget &t = targets[i];
+        t.vehicle = vehicles[i];
+        t.stop_request_us.store(0, std::memory_order_relaxed);
+        t.last_applied_us.store(0, std::memory_order_relaxed);
+        t.last_latency_us.store(0, std::memory_order_relaxed);
+    }
+    n_targets = n_vehicles;
+    running.store(true, std::memory_order_release);
+    GError *err = nullptr;
+    motor_thread = g_thread_try_new("motor-control", motor_thread_main, NULL, &err);
+    if (!motor_thread) {
+        LOG_ERROR("CONTROL", "Cannot start control thread: %s", err->message);
+        g_error_free(err);
+        running.store(false, std::memory_order_release);
+        return false;
+    }
+    LOG_INFO("CONTROL", "Control thread started for %u vehicle(s), tick %u us",
+             n_targets, config_get()->control.tick_us);
+    return true;
+}
+
+void motor_thread_stop() {
+    if (!motor_thread) return;
+
+    running.store(false, std::memory_order_release);
+    g_thread_join(motor_thread);
+    motor_thread = nullptr;
+
+    // Виробників уже немає: звільняємо все, що лишилося. Машини лишаються
+    // в targets: запізнілий запит зупинки лише нічого не змінить.
+    for (auto &slot : producers) {
+        MotorQueue *q = slot.exchange(nullptr, std::memory_order_acq_rel);
+        delete q;
+    }
+    LOG_INFO("CONTROL", "Control thread stopped");
+}
+
+void motor_thread_last_command(const Vehicle *vehicle, gint64 *applied_us, gint64 *latency_us) {
+    MotorTarget *t = find_target(vehicle);
+    *applied_us = t ? t->last_applied_us.load(std::memory_order_relaxed) : 0;
+    *latency_us = t ? t->last_latency_us.load(std::memory_order_relaxed) : 0;
+}
@@ -0,0 +1,55 @@
+#ifndef MOTOR_THREAD_H
+#define MOTOR_THREAD_H
+
+#include <glib.h>
+#include <cstdint>
+
+enum MotorCommandSource : uint8_t {
+    MOTOR_SOURCE_WEBSOCKET,
+    MOTOR_SOURCE_DATACHANNEL
+};
+
+// Команда для потоку керування
+struct MotorCommand {
+    int8_t  direction;    // 1 вперед, -1 назад, 0 немає
+    int8_t  turn;         // 1 вправо, -1 вліво, 0 прямо
+    uint8_t speed;        // 0–100 %
+    bool    stop;
+    uint8_t source;       // MotorCommandSource, для метрик затримки
+    gint64  received_us;  // g_get_monotonic_time() у момент прийому
+};
+
+// Черга одного виробника (один потік пише, потік керування читає).
+// Кожне джерело команд — WebSocket, кожен data channel — має власну.
+struct MotorQueue;
+struct Vehicle;
+
+// Окремий потік застосовує команди до GPIO/PWM з фіксованим тактом
+// ([control] у конфігурації, за бажанням SCHED_FIFO). За такт він
+// вичитує всі черги й застосовує лише найновішу команду, тож затримка
+// від прийому до керування не залежить від головного циклу GStreamer.
+// Один потік обслуговує всі машини процесу: кожна отримує найновішу
+// команду зі своїх черг. Машини не змінюються, доки потік працює.
+#define MOTOR_MAX_VEHICLES 8
+// Черги на машину: WebSocket, канали керування від машини й від браузера
+// і ще одна — канал водія, якого webrtcbin ще не звільнив
+#define MOTOR_QUEUES_PER_VEHICLE 4
+bool motor_thread_start(Vehicle *const *vehicles, guint n_vehicles);
+void motor_thread_stop();
+
+// Реєструє нове джерело команд для машини; nullptr, якщо всі слоти
+// зайняті або потік не керує цією машиною
+MotorQueue *motor_queue_new(Vehicle *vehicle, const char *name);
+// Виробник більше не пише; чергу звільнить потік керування
+void motor_queue_release(MotorQueue *queue);
+// Неблокуючий запис; false, якщо черга переповнена
+bool motor_queue_push(MotorQueue *queue, const MotorCommand *cmd);
+
+// Зупинка з будь-якого потоку (закриття каналу, відключення водія)
+void motor_thread_request_stop(Vehicle *vehicle);
+
+// Час застосування останньої команди чи зупинки машини (0 — ще не було)
+// і її затримка від прийому до запису виходів; з будь-якого потоку
+void motor_thread_last_command(const Vehicle *vehicle, gint64 *applied_us, gint64 *latency_us);
+
+#endif // MOTOR_THREAD_H
@@ -0,0 +1,417 @@
+#include "rate_control.h"
+#include "media_ingest.h"
+#include "config.h"
+#include "log.h"
+#include <gst/webrtc/webrtc.h>
+#include <gst/rtp/rtp.h>
+#include <glib.h>
+
+#define TWCC_EXTENSION_URI "http://www.ietf.org/id/draft-holmer-rmcat-transport-wide-cc-extensions-01"
+#define RTP_EXT_ID_TWCC    1
+
+// Стан регулятора для одного глядача. Відповіді get-stats і оцінки
+// rtpgccbwe приходять з потоків webrtcbin, тому замикання тримають посилання.
+struct RateControl;
+
+struct RatePeer {
+    RateControl *rc;          // не використовується після removed
+    gchar *id;
+    GstElement *branch;
+    GstElement *webrtc;
+    bool removed;
+    gint gcc_estimate;        // атомарно, біт/с від rtpgccbwe
+
+    // Далі — лише головний цикл
+    LinkStats stats;
+    guint64 last_bytes_sent;
+    gint64 last_sample_us;
+    gint64 last_decrease_us;
+    double min_rtt_ms;
+};
+
+// Один знімок get-stats, переданий у головний цикл
+struct StatsSample {
+    RatePeer *peer;
+    bool have_remote;
+    double fraction_lost;
+    double rtt_ms;
+    guint64 packets_lost;
+    guint64 bytes_sent;
+};
+
+struct RateControl {
+    MediaIngest *ingest;
+    GHashTable *peers;                     // id → RatePeer*
+    guint timer_id;
+    guint current_bitrate;
+    int degrade_level;                     // 0 — повна якість, 1 — знижена
+};
+
+static void rate_peer_clear(RatePeer *rp) {
+    gst_object_unref(rp->branch);
+    gst_object_unref(rp->webrtc);
+    g_free(rp->id);
+}
+
+static RatePeer *rate_peer_ref(RatePeer *rp) {
+    return (RatePeer*)g_rc_box_acquire(rp);
+}
+
+static void rate_peer_unref(RatePeer *rp) {
+    g_rc_box_release_full(rp, (GDestroyNotify)rate_peer_clear);
+}
+
+static void rate_peer_closure_notify(gpointer data, GClosure*) {
+    rate_peer_unref((RatePeer*)data);
+}
+
+static void free_sample(gpointer data) {
+    StatsSample *sample = (StatsSample*)data;
+    rate_peer_unref(sample->peer);
+    g_free(sample);
+}
+
+static guint max_bitrate(RateControl *r) {
+    const RateConfig &rc = config_get()->rate;
+    return rc.max_bitrate ? rc.max_bitrate : media_ingest_video_settings(r->ingest)->bitrate;
+}
+
+// --- Зниження роздільності/частоти при дуже низькому бітрейті ---
+static void update_degradation(RateControl *r, guint bitrate) {
+    const RateConfig &rc = config_get()->rate;
+    const VideoSettings &v = *media_ingest_video_settings(r->ingest);
+    if (!rc.adapt_resolution && !rc.adapt_framerate) return;
+
+    // Гістерезис: повертаємо якість лише з запасом у півтора раза
+    int level = r->degrade_level;
+    if (bitrate < rc.degrade_bitrate) {
+        level = 1;
+    } else if (bitrate > rc.degrade_bitrate * 3 / 2) {
+        level = 0;
+    }
+    if (level == r->degrade_level) return;
+    r->degrade_level = level;
+
+    guint width = v.width, height = v.height, framerate = v.framerate;
+    if (level > 0) {
+        if (rc.adapt_resolution) {
+            width = (width / 2) & ~1u;
+            height = (height / 2) & ~1u;
+        }
+        if (rc.adapt_framerate) {
+            framerate = MAX(framerate / 2, rc.min_framerate);
+        }
+    }
+
+    if (media_ingest_set_video_format(r->ingest, width, height, framerate)) {
+        LOG_INFO("RATE", "Video format -> %ux%u@%u (bitrate %u bps, level %d)",
+                 width, height, framerate, bitrate, r->degrade_level);
+    }
+}
+
+// --- Застосування цілі до кодера: найслабший глядач визначає бітрейт ---
+static void update_encoder(RateControl *r) {
+    guint target = G_MAXUINT;
+    double worst_loss = 0, worst_rtt = 0;
+
+    GHashTableIter it;
+    gpointer value;
+    g_hash_table_iter_init(&it, r->peers);
+    while (g_hash_table_iter_next(&it, NULL, &value)) {
+        const LinkStats &ls = ((RatePeer*)value)->stats;
+        if (ls.target_bps == 0) continue;
+        target = MIN(target, ls.target_bps);
+        worst_loss = MAX(worst_loss, ls.fraction_lost);
+        worst_rtt = MAX(worst_rtt, ls.rtt_ms);
+    }
+    if (target == G_MAXUINT) return;
+
+    // Дрібні коливання не варті переналаштування кодера
+    guint diff = target > r->current_bitrate ? target - r->current_bitrate : r->current_bitrate - target;
+    if (diff < r->current_bitrate / 32) return;
+
+    guint old = r->current_bitrate;
+    r->current_bitrate = target;
+    if (media_ingest_set_bitrate(r->ingest, target)) {
+        LOG_INFO("RATE", "Encoder bitrate %u -> %u bps (peers=%u, loss=%.1f%%, rtt=%.0f ms)",
+                 old, target, g_hash_table_size(r->peers), worst_loss * 100, worst_rtt);
+    } else {
+        LOG_INFO("RATE", "Target bitrate %u -> %u bps not applied: source has no encoder", old, target);
+    }
+    update_degradation(r, target);
+}
+
+// --- Багатошаровий режим: кожен глядач — на своєму шарі ---
+// Вгору — коли ціль досягла бітрейту вищого шару, вниз — коли ціль
+// впала нижче поточного на 10 %. Ціль зростає лише через increase_delay_ms
+// після зниження, тож глядач на межі не перемикається щотакту.
+static void update_layer(RatePeer *rp) {
+    MediaIngest *mi = rp->rc->ingest;
+    LinkStats &ls = rp->stats;
+    guint n = media_ingest_layer_count(mi);
+    guint layer = ls.layer;
+    while (layer + 1 < n && ls.target_bps >= media_ingest_layer_settings(mi, layer + 1)->bitrate) layer++;
+    while (layer > 0 && ls.target_bps < media_ingest_layer_settings(mi, layer)->bitrate * 9 / 10) layer--;
+    if (layer == ls.layer) return;
+
+    const VideoSettings &v = *media_ingest_layer_settings(mi, layer);
+    LOG_INFO("RATE", "Peer %s layer %u -> %u (%ux%u@%u, %u bps; target %u bps)",
+             rp->id, ls.layer, layer, v.width, v.height, v.framerate, v.bitrate, ls.target_bps);
+    ls.layer = layer;
+    media_ingest_select_layer(mi, rp->branch, layer);
+}
+
+// Швидко вниз, повільно вгору
+static guint next_target(RatePeer *rp, bool fresh_report, gint64 now) {
+    const RateConfig &rc = config_get()->rate;
+    const LinkStats &ls = rp->stats;
+    double target = ls.target_bps ? ls.target_bps : rp->rc->current_bitrate;
+
+    if (ls.rtt_ms > 0 && (rp->min_rtt_ms == 0 || ls.rtt_ms < rp->min_rtt_ms)) {
+        rp->min_rtt_ms = ls.rtt_ms;
+    }
+
+    if (ls.estimate_bps > 0) {
+        // Оцінка GCC уже враховує і затримку, і втрати
+        target = ls.estimate_bps;
+    } else if (fresh_report && ls.fraction_lost > rc.loss_high) {
+        target *= 1.0 - 0.5 * ls.fraction_lost;
+        rp->last_decrease_us = now;
+    } else if (fresh_report && rp->min_rtt_ms > 0 && ls.rtt_ms > 2 * rp->min_rtt_ms + 50) {
+        // Черга в мережі росте ще до появи втрат
+        target *= 0.85;
+        rp->last_decrease_us = now;
+    } else if (ls.fraction_lost < rc.loss_low &&
+               now - rp->last_decrease_us >= (gint64)rc.increase_delay_ms * 1000) {
+        target *= 1.0 + rc.increase_percent / 100.0;
+    }
+
+    return (guint)CLAMP(target, (double)rc.min_bitrate, (double)max_bitrate(rp->rc));
+}
+
+static gboolean apply_sample(gpointer data) {
+    StatsSample *sample = (StatsSample*)data;
+    RatePeer *rp = sample->peer;
+    if (rp->removed) return G_SOURCE_REMOVE;
+
+    gint64 now = g_get_monotonic_time();
+    LinkStats &ls = rp->stats;
+
+    if (rp->last_sample_us && sample->bytes_sent >= rp->last_bytes_sent) {
+        double dt = (now - rp->last_sample_us) / 1e6;
+        if (dt > 0) ls.send_bps = (sample->bytes_sent - rp->last_bytes_sent) * 8.0 / dt;
+    }
+    rp->last_bytes_sent = sample->bytes_sent;
+    rp->last_sample_us = now;
+
+    // RTCP RR приходить рідше, ніж ми опитуємо: реагуємо лише на новий звіт
+    bool fresh = sample->have_remote &&
+                 (sample->packets_lost != ls.packets_lost ||
+                  sample->rtt_ms != ls.rtt_ms ||
+                  sample->fraction_lost != ls.fraction_lost);
+    if (sample->have_remote) {
+        ls.fraction_lost = sample->fraction_lost;
+        ls.rtt_ms = sample->rtt_ms;
+        ls.packets_lost = sample->packets_lost;
+    }
+    ls.estimate_bps = g_atomic_int_get(&rp->gcc_estimate);
+    ls.target_bps = next_target(rp, fresh, now);
+
+    if (media_ingest_layer_count(rp->rc->ingest) > 1) {
+        update_layer(rp);
+    } else {
+        update_encoder(rp->rc);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean parse_stat(GQuark, const GValue *value, gpointer user_data) {
+    if (!GST_VALUE_HOLDS_STRUCTURE(value)) return TRUE;
+    const GstStructure *s = gst_value_get_structure(value);
+    StatsSample *sample = (StatsSample*)user_data;
+
+    gint type;
+    if (!gst_structure_get_enum(s, "type", GST_TYPE_WEBRTC_STATS_TYPE, &type)) return TRUE;
+
+    if (type == GST_WEBRTC_STATS_REMOTE_INBOUND_RTP) {
+        sample->have_remote = true;
+        gst_structure_get_double(s, "fraction-lost", &sample->fraction_lost);
+        double rtt;
+        if (gst_structure_get_double(s, "round-trip-time", &rtt)) sample->rtt_ms = rtt * 1000;
+        gint64 lost;
+        if (gst_structure_get_int64(s, "packets-lost", &lost) && lost > 0) sample->packets_lost = lost;
+    } else if (type == GST_WEBRTC_STATS_OUTBOUND_RTP) {
+        guint64 bytes;
+        if (gst_structure_get_uint64(s, "bytes-sent", &bytes)) sample->bytes_sent += bytes;
+    }
+    return TRUE;
+}
+
+// Відповідь get-stats приходить з потоку webrtcbin
+static void on_stats(GstPromise *promise, gpointer user_data) {
+    RatePeer *rp = (RatePeer*)user_data;
+    const GstStructure *reply = gst_promise_get_reply(promise);
+    if (reply) {
+        StatsSample *sample = g_new0(StatsSample, 1);
+        sample->peer = rate_peer_ref(rp);
+        gst_structure_foreach(reply, parse_stat, sample);
+        g_main_context_invoke_full(NULL, G_PRIORITY_DEFAULT, apply_sample, sample, free_sample);
+    }
+    gst_promise_unref(promise);
+}
+
+static gboolean rate_tick(gpointer data) {
+    GHashTableIter it;
+    gpointer value;
+    g_hash_table_iter_init(&it, ((RateControl*)data)->peers);
+    while (g_hash_table_iter_next(&it, NULL, &value)) {
+        RatePeer *rp = (RatePeer*)value;
+        GstPromise *p = gst_promise_new_with_change_func(on_stats, rate_peer_ref(rp), (GDestroyNotify)rate_peer_unref);
+        g_signal_emit_by_name(rp->webrtc, "get-stats", NULL, p);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+// --- TWCC: оцінка пропускної здатності від rtpgccbwe (gst-plugins-rs) ---
+static void on_estimated_bitrate(GObject *bwe, GParamSpec*, gpointer user_data) {
+    guint estimate = 0;
+    g_object_get(bwe, "estimated-bitrate", &estimate, NULL);
+    g_atomic_int_set(&((RatePeer*)user_data)->gcc_estimate, (gint)estimate);
+}
+
+static GstElement *on_request_aux_sender(GstElement*, GObject*, gpointer user_data) {
+    RatePeer *rp = (RatePeer*)user_data;
+    GstElement *bwe = gst_element_factory_make("rtpgccbwe", NULL);
+    if (!bwe) return nullptr;
+
+    g_object_set(bwe,
+        "min-bitrate", config_get()->rate.min_bitrate,
+        "max-bitrate", max_bitrate(rp->rc),
+        "estimated-bitrate", rp->rc->current_bitrate,
+        NULL);
+    g_signal_connect_data(bwe, "notify::estimated-bitrate", G_CALLBACK(on_estimated_bitrate),
+                          rate_peer_ref(rp), rate_peer_closure_notify, (GConnectFlags)0);
+    return bwe;
+}
+
+static void enable_twcc(RatePeer *rp, GstElement *payloader) {
+    GstElementFactory *f = gst_element_factory_find("rtpgccbwe");
+    if (!f) {
+        LOG_INFO("RATE", "rtpgccbwe not available, using loss/RTT feedback only");
+        return;
+    }
+    gst_object_unref(f);
+
+    GstRTPHeaderExtension *ext = gst_rtp_header_extension_create_from_uri(TWCC_EXTENSION_URI);
+    if (!ext) return;
+    gst_rtp_header_extension_set_id(ext, RTP_EXT_ID_TWCC);
+    g_signal_emit_by_name(payloader, "add-extension", ext);
+    gst_object_unref(ext);
+
+    g_signal_connect_data(rp->webrtc, "request-aux-sender", G_CALLBACK(on_request_aux_sender),
+                          rate_peer_ref(rp), rate_peer_closure_notify, (GConnectFlags)0);
+}
+
+void rate_control_add_peer(RateControl *r, const char *peer_id, GstElement *branch, GstElement *webrtc,
+                           GstElement *payloader) {
+    if (!r) return;
+
+    MediaIngest *mi = r->ingest;
+    bool layered = media_ingest_layer_count(mi) > 1;
+    if (g_hash_table_size(r->peers) == 0 && !layered) {
+        // Новий перший глядач починає з повної якості
+        r->current_bitrate = max_bitrate(r);
+        media_ingest_set_bitrate(mi, r->current_bitrate);
+        if (r->degrade_level > 0) {
+            const VideoSettings &v = *media_ingest_video_settings(mi);
+            r->degrade_level = 0;
+            media_ingest_set_video_format(mi, v.width, v.height, v.framerate);
+        }
+    }
+
+    RatePeer *rp = g_rc_box_new0(RatePeer);
+    rp->rc = r;
+    rp->id = g_strdup(peer_id);
+    rp->branch = (GstElement*)gst_object_ref(branch);
+    rp->webrtc = (GstElement*)gst_object_ref(webrtc);
+    rp->stats.target_bps = r->current_bitrate;
+    // Як і з одним кодером, новий глядач починає з повної якості
+    if (layered) {
+        rp->stats.layer = media_ingest_layer_count(mi) - 1;
+        media_ingest_select_layer(mi, branch, rp->stats.layer);
+    }
+    g_hash_table_replace(r->peers, rp->id, rp);
+
+    if (config_get()->rate.twcc) {
+        enable_twcc(rp, payloader);
+    }
+}
+
+// Відповіді get-stats, що ще в дорозі, не торкаються знятого глядача
+static void detach_peer(RatePeer *rp) {
+    rp->removed = true;
+    g_signal_handlers_disconnect_by_data(rp->webrtc, rp);
+}
+
+void rate_control_remove_peer(RateControl *r, const char *peer_id) {
+    if (!r) return;
+    RatePeer *rp = (RatePeer*)g_hash_table_lookup(r->peers, peer_id);
+    if (!rp) return;
+
+    detach_peer(rp);
+    g_hash_table_remove(r->peers, peer_id);
+
+    // Слабкий глядач пішов — решта може отримати більше
+    if (media_ingest_layer_count(r->ingest) == 1) update_encoder(r);
+}
+
+void rate_control_video_changed(RateControl *r) {
+    if (!r) return;
+
+    // Кодер уже отримав нові параметри повністю: регулятор починає з них,
+    // а не тягне бітрейт назад до цілей, виміряних для старого формату
+    const RateConfig &rc = config_get()->rate;
+    r->degrade_level = 0;
+    r->current_bitrate = CLAMP(media_ingest_video_settings(r->ingest)->bitrate, rc.min_bitrate, max_bitrate(r));
+    media_ingest_set_bitrate(r->ingest, r->current_bitrate);
+
+    GHashTableIter it;
+    gpointer value;
+    g_hash_table_iter_init(&it, r->peers);
+    while (g_hash_table_iter_next(&it, NULL, &value)) {
+        ((RatePeer*)value)->stats.target_bps = r->current_bitrate;
+    }
+    update_degradation(r, r->current_bitrate);
+}
+
+bool rate_control_get_link_stats(RateControl *r, const char *peer_id, LinkStats *out) {
+    RatePeer *rp = r ? (RatePeer*)g_hash_table_lookup(r->peers, peer_id) : nullptr;
+    if (!rp) return false;
+    *out = rp->stats;
+    return true;
+}
+
+RateControl *rate_control_new(MediaIngest *ingest) {
+    const RateConfig &rc = config_get()->rate;
+    if (!rc.enabled) return nullptr;
+
+    RateControl *r = g_new0(RateControl, 1);
+    r->ingest = ingest;
+    r->peers = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)rate_peer_unref);
+    r->current_bitrate = max_bitrate(r);
+    r->timer_id = g_timeout_add(rc.interval_ms, rate_tick, r);
+    LOG_INFO("RATE", "Rate control started: %u..%u bps, poll every %u ms",
+             rc.min_bitrate, max_bitrate(r), rc.interval_ms);
+    return r;
+}
+
+void rate_control_free(RateControl *r) {
+    if (!r) return;
+    g_source_remove(r->timer_id);
+    GHashTableIter it;
+    gpointer value;
+    g_hash_table_iter_init(&it, r->peers);
+    while (g_hash_table_iter_next(&it, NULL, &value)) detach_peer((RatePeer*)value);
+    g_hash_table_unref(r->peers);
+    g_free(r);
+}
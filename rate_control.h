@@ -0,0 +1,43 @@
+#ifndef RATE_CONTROL_H
+#define RATE_CONTROL_H
+
+#include <gst/gst.h>
+
+struct MediaIngest;
+
+// Останні виміряні характеристики лінку одного глядача
+struct LinkStats {
+    double  fraction_lost;   // 0..1 з останнього RTCP RR
+    double  rtt_ms;
+    double  send_bps;        // фактична швидкість відправки
+    double  estimate_bps;    // оцінка TWCC (rtpgccbwe), 0 — немає
+    guint64 packets_lost;
+    guint   target_bps;      // ціль контролера для цього глядача
+    guint   layer;           // багатошаровий режим: шар для глядача
+};
+
+// Регулятор бітрейту кодера за статистикою webrtcbin ([rate] у конфігурації).
+// Опитує get-stats кожного глядача, швидко знижує бітрейт при втратах і
+// зростанні RTT та повільно підіймає, коли лінк чистий. При кількох
+// глядачах кодер налаштовується під найслабшого. У багатошаровому режимі
+// ([media] layers) бітрейти кодерів не змінюються: кожен глядач отримує
+// найякісніший шар, що вміщається в його ціль.
+// Регулятор свій у кожного пристрою; nullptr, якщо [rate] вимкнено —
+// решта функцій тоді нічого не робить.
+struct RateControl;
+RateControl *rate_control_new(MediaIngest *ingest);
+void rate_control_free(RateControl *rc);
+
+// Викликати до переходу webrtcbin у READY: підключає rtpgccbwe через
+// request-aux-sender і додає розширення TWCC на payloader, якщо можливо.
+// branch — гілка глядача для вибору шару.
+void rate_control_add_peer(RateControl *rc, const char *peer_id, GstElement *branch, GstElement *webrtc,
+                           GstElement *payloader);
+void rate_control_remove_peer(RateControl *rc, const char *peer_id);
+
+// Базові параметри відео змінено (configure): регулятор починає з нових
+void rate_control_video_changed(RateControl *rc);
+
+bool rate_control_get_link_stats(RateControl *rc, const char *peer_id, LinkStats *out);
+
+#endif // RATE_CONTROL_H
@@ -0,0 +1,774 @@
+#include "signaling_codec.h"
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+
+// Найбільше поле — SDP відповіді, кілька кілобайт
+#define DECODE_ARENA_BYTES (64 * 1024)
+#define MSGPACK_MAX_DEPTH  8
+#define JSON_MAX_DEPTH     16
+
+enum Field {
+    FIELD_NONE,
+    FIELD_ACTION,
+    FIELD_TYPE,
+    FIELD_DEVICE,
+    FIELD_PEER,
+    FIELD_ROLE,
+    FIELD_DIRECTION,
+    FIELD_TURN,
+    FIELD_SPEED,
+    FIELD_SDP,
+    FIELD_CANDIDATE,
+    FIELD_MLINE,
+    FIELD_CODECS,
+    FIELD_SESSION,
+    FIELD_SECONDS,
+    FIELD_PRESET,
+    FIELD_WIDTH,
+    FIELD_HEIGHT,
+    FIELD_FRAMERATE,
+    FIELD_BITRATE,
+    FIELD_LATENCY,
+    FIELD_RECOVERY
+};
+
+struct NameEntry {
+    const char *name;
+    gsize len;
+    int value;
+};
+
+#define NAME(s, v) { s, sizeof(s) - 1, v }
+
+static const NameEntry field_names[] = {
+    NAME("action", FIELD_ACTION),
+    NAME("type", FIELD_TYPE),
+    NAME("device", FIELD_DEVICE),
+    NAME("peer", FIELD_PEER),
+    NAME("role", FIELD_ROLE),
+    NAME("direction", FIELD_DIRECTION),
+    NAME("turn", FIELD_TURN),
+    NAME("speed", FIELD_SPEED),
+    NAME("sdp", FIELD_SDP),
+    NAME("candidate", FIELD_CANDIDATE),
+    NAME("sdpMLineIndex", FIELD_MLINE),
+    NAME("codecs", FIELD_CODECS),
+    NAME("session", FIELD_SESSION),
+    NAME("seconds", FIELD_SECONDS),
+    NAME("preset", FIELD_PRESET),
+    NAME("width", FIELD_WIDTH),
+    NAME("height", FIELD_HEIGHT),
+    NAME("framerate", FIELD_FRAMERATE),
+    NAME("bitrate", FIELD_BITRATE),
+    NAME("latency_us", FIELD_LATENCY),
+    NAME("recovery", FIELD_RECOVERY),
+};
+
+static const NameEntry action_names[] = {
+    NAME("ready", SIGNALING_READY),
+    NAME("control", SIGNALING_CONTROL),
+    NAME("stop", SIGNALING_STOP),
+    NAME("disconnect", SIGNALING_DISCONNECT),
+    NAME("lock", SIGNALING_LOCK),
+    NAME("configure", SIGNALING_CONFIGURE),
+    NAME("latency", SIGNALING_LATENCY),
+};
+
+static const NameEntry codec_names[] = {
+    NAME("json", SIGNALING_CODEC_JSON),
+    NAME("msgpack", SIGNALING_CODEC_MSGPACK),
+};
+
+#undef NAME
+
+static int lookup(const NameEntry *table, gsize n, const char *s, gsize len, int fallback) {
+    for (gsize i = 0; i < n; i++) {
+        if (table[i].len == len && memcmp(table[i].name, s, len) == 0) return table[i].value;
+    }
+    return fallback;
+}
+
+const char *signaling_codec_name(SignalingCodec codec) {
+    return codec_names[codec].name;
+}
+
+SignalingCodec signaling_codec_pick(guint remote_codecs) {
+    if (remote_codecs & SIGNALING_CODEC_BIT(SIGNALING_CODEC_MSGPACK)) return SIGNALING_CODEC_MSGPACK;
+    return SIGNALING_CODEC_JSON;
+}
+
+// Поля, з яких визначається тип, збираються окремо: порядок ключів довільний
+struct DecodeState {
+    const char *action;
+    gsize action_len;
+    const char *type;
+    gsize type_len;
+};
+
+static void reset_message(SignalingMessage *out) {
+    memset(out, 0, sizeof(*out));
+    out->speed = -1;
+    out->sdp_mline_index = -1;
+    out->seconds = -1;
+    out->width = -1;
+    out->height = -1;
+    out->framerate = -1;
+    out->bitrate = -1;
+    out->latency_us = -1;
+}
+
+static void set_string_field(SignalingMessage *out, DecodeState *st, Field field, const char *s, gsize len) {
+    switch (field) {
+        case FIELD_ACTION:    st->action = s; st->action_len = len; break;
+        case FIELD_TYPE:      st->type = s; st->type_len = len; break;
+        case FIELD_DEVICE:    out->device = s; break;
+        case FIELD_PEER:      out->peer = s; break;
+        case FIELD_ROLE:      out->role = s; break;
+        case FIELD_DIRECTION: out->direction = s; break;
+        case FIELD_TURN:      out->turn = s; break;
+        case FIELD_SDP:       out->sdp = s; break;
+        case FIELD_CANDIDATE: out->candidate = s; break;
+        case FIELD_SESSION:   out->session = s; break;
+        case FIELD_PRESET:    out->preset = s; break;
+        case FIELD_RECOVERY:  out->recovery = s; break;
+        default: break;
+    }
+}
+
+static void set_int_field(SignalingMessage *out, Field field, gint64 v) {
+    if (field == FIELD_SPEED) out->speed = v;
+    else if (field == FIELD_MLINE) out->sdp_mline_index = v;
+    else if (field == FIELD_SECONDS) out->seconds = v;
+    else if (field == FIELD_WIDTH) out->width = v;
+    else if (field == FIELD_HEIGHT) out->height = v;
+    else if (field == FIELD_FRAMERATE) out->framerate = v;
+    else if (field == FIELD_BITRATE) out->bitrate = v;
+    else if (field == FIELD_LATENCY) out->latency_us = v;
+}
+
+// Дробове число з повідомлення в gint64. Глядач може прислати NaN,
+// нескінченність чи 1e300: такі відкидаємо, завеликі обмежуємо
+static bool double_to_int(double d, gint64 *out) {
+    if (!std::isfinite(d)) return false;
+    const double limit = 9223372036854775808.0;   // 2^63
+    if (d >= limit) *out = G_MAXINT64;
+    else if (d <= -limit) *out = G_MININT64;
+    else *out = (gint64)d;
+    return true;
+}
+
+static void add_codec(SignalingMessage *out, const char *s, gsize len) {
+    int codec = lookup(codec_names, G_N_ELEMENTS(codec_names), s, len, -1);
+    if (codec >= 0) out->codecs |= SIGNALING_CODEC_BIT(codec);
+}
+
+static bool is_int_field(Field f) {
+    return f == FIELD_SPEED || f == FIELD_MLINE || f == FIELD_SECONDS ||
+           f == FIELD_WIDTH || f == FIELD_HEIGHT || f == FIELD_FRAMERATE || f == FIELD_BITRATE ||
+           f == FIELD_LATENCY;
+}
+
+static bool is_string_field(Field f) {
+    return f != FIELD_NONE && f != FIELD_CODECS && !is_int_field(f);
+}
+
+static void classify(SignalingMessage *out, const DecodeState &st) {
+    if (st.action) {
+        out->type = (SignalingType)lookup(action_names, G_N_ELEMENTS(action_names),
+                                          st.action, st.action_len, SIGNALING_UNKNOWN);
+    } else if (st.type && st.type_len == 6 && memcmp(st.type, "answer", 6) == 0) {
+        out->type = SIGNALING_ANSWER;
+    } else if (out->candidate) {
+        out->type = SIGNALING_CANDIDATE;
+    } else {
+        out->type = SIGNALING_UNKNOWN;
+    }
+}
+
+// Рядки з буфера кадру переносяться сюди з нулем у кінці: у MessagePack
+// вони не завершені нулем, у JSON — ще й з escape-послідовностями
+static char decode_arena[DECODE_ARENA_BYTES];
+
+// --- JSON: розбір на місці, без дерева і без виділення пам'яті ---
+// Читаються лише поля верхнього рівня; вкладені значення
+// перевіряються на коректність і пропускаються.
+struct JsonReader {
+    const char *p;
+    const char *end;
+    char  *arena;
+    gsize  arena_used;
+};
+
+static void js_space(JsonReader *r) {
+    while (r->p < r->end && (*r->p == ' ' || *r->p == '\t' || *r->p == '\n' || *r->p == '\r')) r->p++;
+}
+
+static bool js_char(JsonReader *r, char c) {
+    js_space(r);
+    if (r->p >= r->end || *r->p != c) return false;
+    r->p++;
+    return true;
+}
+
+static bool js_peek(JsonReader *r, char c) {
+    js_space(r);
+    return r->p < r->end && *r->p == c;
+}
+
+static bool js_hex4(JsonReader *r, guint32 *out) {
+    if (r->end - r->p < 4) return false;
+    guint32 v = 0;
+    for (int i = 0; i < 4; i++) {
+        int d = g_ascii_xdigit_value(r->p[i]);
+        if (d < 0) return false;
+        v = (v << 4) | (guint32)d;
+    }
+    r->p += 4;
+    *out = v;
+    return true;
+}
+
+static bool js_put(JsonReader *r, const char *s, gsize n) {
+    if (r->arena_used + n + 1 > DECODE_ARENA_BYTES) return false;
+    memcpy(r->arena + r->arena_used, s, n);
+    r->arena_used += n;
+    return true;
+}
+
+// \uXXXX, у тому числі сурогатна пара, у UTF-8
+static bool js_unicode(JsonReader *r) {
+    guint32 cp;
+    if (!js_hex4(r, &cp)) return false;
+    if (cp >= 0xd800 && cp <= 0xdbff) {
+        guint32 lo;
+        if (r->end - r->p < 2 || r->p[0] != '\\' || r->p[1] != 'u') return false;
+        r->p += 2;
+        if (!js_hex4(r, &lo) || lo < 0xdc00 || lo > 0xdfff) return false;
+        cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+    } else if (cp >= 0xdc00 && cp <= 0xdfff) {
+        return false;
+    }
+    char utf8[6];
+    return js_put(r, utf8, g_unichar_to_utf8(cp, utf8));
+}
+
+// Рядок після відкривної лапки. out != nullptr — розкодувати в арену
+static bool js_string(JsonReader *r, const char **out, gsize *len) {
+    if (!js_char(r, '"')) return false;
+    gsize start = r->arena_used;
+    for (;;) {
+        // Ділянку без escape копіюємо одним шматком
+        const char *run = r->p;
+        while (r->p < r->end && *r->p != '"' && *r->p != '\\' && (guchar)*r->p >= 0x20) r->p++;
+        if (out && !js_put(r, run, r->p - run)) return false;
+        if (r->p >= r->end || (guchar)*r->p < 0x20) return false;
+        if (*r->p++ == '"') break;
+
+        if (r->p >= r->end) return false;
+        char c = *r->p++;
+        const char *esc = nullptr;
+        switch (c) {
+            case '"':  esc = "\""; break;
+            case '\\': esc = "\\"; break;
+            case '/':  esc = "/"; break;
+            case 'b':  esc = "\b"; break;
+            case 'f':  esc = "\f"; break;
+            case 'n':  esc = "\n"; break;
+            case 'r':  esc = "\r"; break;
+            case 't':  esc = "\t"; break;
+            case 'u': {
+                if (out) {
+                    if (!js_unicode(r)) return false;
+                } else {
+                    guint32 unused;
+                    if (!js_hex4(r, &unused)) return false;
+                }
+                continue;
+            }
+            default: return false;
+        }
+        if (out && !js_put(r, esc, 1)) return false;
+    }
+    if (out) {
+        r->arena[r->arena_used++] = '\0';
+        *out = r->arena + start;
+        *len = r->arena_used - start - 1;
+    }
+    return true;
+}
+
+static bool js_literal(JsonReader *r, const char *word, gsize n) {
+    if ((gsize)(r->end - r->p) < n || memcmp(r->p, word, n) != 0) return false;
+    r->p += n;
+    return true;
+}
+
+// Число за граматикою JSON; ціле в межах gint64 — без втрати точності
+static bool js_number(JsonReader *r, gint64 *out, bool *valid) {
+    js_space(r);
+    const char *start = r->p;
+    bool integer = true;
+    if (r->p < r->end && *r->p == '-') r->p++;
+    if (r->p >= r->end || !g_ascii_isdigit(*r->p)) return false;
+    if (*r->p == '0') r->p++;
+    else while (r->p < r->end && g_ascii_isdigit(*r->p)) r->p++;
+    if (r->p < r->end && *r->p == '.') {
+        integer = false;
+        r->p++;
+        if (r->p >= r->end || !g_ascii_isdigit(*r->p)) return false;
+        while (r->p < r->end && g_ascii_isdigit(*r->p)) r->p++;
+    }
+    if (r->p < r->end && (*r->p == 'e' || *r->p == 'E')) {
+        integer = false;
+        r->p++;
+        if (r->p < r->end && (*r->p == '+' || *r->p == '-')) r->p++;
+        if (r->p >= r->end || !g_ascii_isdigit(*r->p)) return false;
+        while (r->p < r->end && g_ascii_isdigit(*r->p)) r->p++;
+    }
+
+    // strtod і strtoll потребують нуля в кінці; довші числа — не наші поля
+    char buf[64];
+    gsize n = r->p - start;
+    if (n >= sizeof(buf)) {
+        *valid = false;
+        return true;
+    }
+    memcpy(buf, start, n);
+    buf[n] = '\0';
+    if (integer) {
+        errno = 0;
+        gint64 v = g_ascii_strtoll(buf, nullptr, 10);
+        if (errno == 0) {
+            *out = v;
+            *valid = true;
+            return true;
+        }
+    }
+    *valid = double_to_int(g_ascii_strtod(buf, nullptr), out);
+    return true;
+}
+
+static bool js_skip(JsonReader *r, int depth) {
+    js_space(r);
+    if (r->p >= r->end) return false;
+    switch (*r->p) {
+        case '"': return js_string(r, nullptr, nullptr);
+        case 't': return js_literal(r, "true", 4);
+        case 'f': return js_literal(r, "false", 5);
+        case 'n': return js_literal(r, "null", 4);
+        case '{':
+        case '[': {
+            if (depth >= JSON_MAX_DEPTH) return false;
+            bool is_object = *r->p++ == '{';
+            char close = is_object ? '}' : ']';
+            if (js_char(r, close)) return true;
+            do {
+                if (is_object && (!js_string(r, nullptr, nullptr) || !js_char(r, ':'))) return false;
+                if (!js_skip(r, depth + 1)) return false;
+            } while (js_char(r, ','));
+            return js_char(r, close);
+        }
+        default: {
+            gint64 unused;
+            bool valid;
+            return js_number(r, &unused, &valid);
+        }
+    }
+}
+
+static bool decode_json(const guint8 *data, gsize size, SignalingMessage *out) {
+    JsonReader r = { (const char*)data, (const char*)data + size, decode_arena, 0 };
+    if (!js_char(&r, '{')) return false;
+
+    DecodeState st = {};
+    if (!js_char(&r, '}')) {
+        do {
+            // Ключ потрібен лише для пошуку поля: місце в арені звільняємо
+            gsize mark = r.arena_used;
+            const char *key;
+            gsize key_len;
+            if (!js_string(&r, &key, &key_len) || !js_char(&r, ':')) return false;
+            Field field = (Field)lookup(field_names, G_N_ELEMENTS(field_names), key, key_len, FIELD_NONE);
+            r.arena_used = mark;
+
+            if (field == FIELD_CODECS && js_peek(&r, '[')) {
+                r.p++;
+                if (js_char(&r, ']')) continue;
+                do {
+                    if (js_peek(&r, '"')) {
+                        const char *s;
+                        gsize len;
+                        if (!js_string(&r, &s, &len)) return false;
+                        add_codec(out, s, len);
+                        r.arena_used = mark;
+                    } else if (!js_skip(&r, 2)) {
+                        return false;
+                    }
+                } while (js_char(&r, ','));
+                if (!js_char(&r, ']')) return false;
+            } else if (is_string_field(field) && js_peek(&r, '"')) {
+                const char *s;
+                gsize len;
+                if (!js_string(&r, &s, &len)) return false;
+                set_string_field(out, &st, field, s, len);
+            } else if (is_int_field(field) && (js_peek(&r, '-') || (r.p < r.end && g_ascii_isdigit(*r.p)))) {
+                gint64 v;
+                bool valid;
+                if (!js_number(&r, &v, &valid)) return false;
+                if (valid) set_int_field(out, field, v);
+            } else if (!js_skip(&r, 1)) {
+                return false;
+            }
+        } while (js_char(&r, ','));
+        if (!js_char(&r, '}')) return false;
+    }
+
+    // Після об'єкта — лише пробіли і, можливо, завершальний нуль
+    js_space(&r);
+    while (r.p < r.end && *r.p == '\0') r.p++;
+    if (r.p != r.end) return false;
+    classify(out, st);
+    return true;
+}
+
+// --- MessagePack: розбір без виділення пам'яті ---
+struct MsgpackReader {
+    const guint8 *p;
+    const guint8 *end;
+    char  *arena;
+    gsize  arena_used;
+};
+
+
+static bool mp_take(MsgpackReader *r, gsize n, const guint8 **out) {
+    if ((gsize)(r->end - r->p) < n) return false;
+    *out = r->p;
+    r->p += n;
+    return true;
+}
+
+static guint64 mp_be(const guint8 *b, gsize n) {
+    guint64 v = 0;
+    for (gsize i = 0; i < n; i++) v = (v << 8) | b[i];
+    return v;
+}
+
+static bool mp_read_be(MsgpackReader *r, gsize n, guint64 *v) {
+    const guint8 *b;
+    if (!mp_take(r, n, &b)) return false;
+    *v = mp_be(b, n);
+    return true;
+}
+
+// Розмір рядка за заголовком; false — наступне значення не рядок
+static bool mp_str_header(MsgpackReader *r, guint8 tag, guint64 *len) {
+    if ((tag & 0xe0) == 0xa0) { *len = tag & 0x1f; return true; }
+    switch (tag) {
+        case 0xd9: return mp_read_be(r, 1, len);
+        case 0xda: return mp_read_be(r, 2, len);
+        case 0xdb: return mp_read_be(r, 4, len);
+        default:   return false;
+    }
+}
+
+static bool mp_container_header(MsgpackReader *r, guint8 tag, bool *is_map, guint64 *n) {
+    if ((tag & 0xf0) == 0x80) { *is_map = true;  *n = tag & 0x0f; return true; }
+    if ((tag & 0xf0) == 0x90) { *is_map = false; *n = tag & 0x0f; return true; }
+    switch (tag) {
+        case 0xdc: *is_map = false; return mp_read_be(r, 2, n);
+        case 0xdd: *is_map = false; return mp_read_be(r, 4, n);
+        case 0xde: *is_map = true;  return mp_read_be(r, 2, n);
+        case 0xdf: *is_map = true;  return mp_read_be(r, 4, n);
+        default:   return false;
+    }
+}
+
+static bool mp_skip(MsgpackReader *r, int depth);
+
+static bool mp_skip_value(MsgpackReader *r, guint8 tag, int depth) {
+    const guint8 *b;
+    guint64 n;
+    bool is_map;
+
+    if (tag <= 0x7f || tag >= 0xe0 || tag == 0xc0 || tag == 0xc2 || tag == 0xc3) return true;
+    if (mp_str_header(r, tag, &n)) return mp_take(r, n, &b);
+    if (mp_container_header(r, tag, &is_map, &n)) {
+        if (depth >= MSGPACK_MAX_DEPTH) return false;
+        guint64 items = is_map ? n * 2 : n;
+        for (guint64 i = 0; i < items; i++) {
+            if (!mp_skip(r, depth + 1)) return false;
+        }
+        return true;
+    }
+    switch (tag) {
+        case 0xc4: return mp_read_be(r, 1, &n) && mp_take(r, n, &b);       // bin 8
+        case 0xc5: return mp_read_be(r, 2, &n) && mp_take(r, n, &b);       // bin 16
+        case 0xc6: return mp_read_be(r, 4, &n) && mp_take(r, n, &b);       // bin 32
+        case 0xc7: return mp_read_be(r, 1, &n) && mp_take(r, n + 1, &b);   // ext 8
+        case 0xc8: return mp_read_be(r, 2, &n) && mp_take(r, n + 1, &b);   // ext 16
+        case 0xc9: return mp_read_be(r, 4, &n) && mp_take(r, n + 1, &b);   // ext 32
+        case 0xca: case 0xce: case 0xd2: return mp_take(r, 4, &b);
+        case 0xcb: case 0xcf: case 0xd3: return mp_take(r, 8, &b);
+        case 0xcc: case 0xd0: return mp_take(r, 1, &b);
+        case 0xcd: case 0xd1: return mp_take(r, 2, &b);
+        case 0xd4: return mp_take(r, 2, &b);                               // fixext 1
+        case 0xd5: return mp_take(r, 3, &b);
+        case 0xd6: return mp_take(r, 5, &b);
+        case 0xd7: return mp_take(r, 9, &b);
+        case 0xd8: return mp_take(r, 17, &b);
+        default:   return false;
+    }
+}
+
+static bool mp_skip(MsgpackReader *r, int depth) {
+    const guint8 *tag;
+    return mp_take(r, 1, &tag) && mp_skip_value(r, *tag, depth);
+}
+
+// Числа будь-якого цілого або дробового типу зводимо до gint64.
+// *is_number — значення прочитане; *valid — його можна використати
+static bool mp_number(MsgpackReader *r, guint8 tag, gint64 *out, bool *is_number, bool *valid) {
+    guint64 v;
+    *is_number = true;
+    *valid = true;
+    if (tag <= 0x7f) { *out = tag; return true; }
+    if (tag >= 0xe0) { *out = (gint8)tag; return true; }
+    switch (tag) {
+        case 0xcc: if (!mp_read_be(r, 1, &v)) return false; *out = (gint64)v; return true;
+        case 0xcd: if (!mp_read_be(r, 2, &v)) return false; *out = (gint64)v; return true;
+        case 0xce: if (!mp_read_be(r, 4, &v)) return false; *out = (gint64)v; return true;
+        case 0xcf: if (!mp_read_be(r, 8, &v)) return false; *out = (gint64)v; return true;
+        case 0xd0: if (!mp_read_be(r, 1, &v)) return false; *out = (gint8)v; return true;
+        case 0xd1: if (!mp_read_be(r, 2, &v)) return false; *out = (gint16)v; return true;
+        case 0xd2: if (!mp_read_be(r, 4, &v)) return false; *out = (gint32)v; return true;
+        case 0xd3: if (!mp_read_be(r, 8, &v)) return false; *out = (gint64)v; return true;
+        case 0xca: {
+            if (!mp_read_be(r, 4, &v)) return false;
+            guint32 bits = (guint32)v;
+            float f;
+            memcpy(&f, &bits, sizeof(f));
+            *valid = double_to_int(f, out);
+            return true;
+        }
+        case 0xcb: {
+            if (!mp_read_be(r, 8, &v)) return false;
+            double d;
+            memcpy(&d, &v, sizeof(d));
+            *valid = double_to_int(d, out);
+            return true;
+        }
+        default:
+            *is_number = false;
+            return true;
+    }
+}
+
+// Рядок з вхідного буфера у вигляді з нулем у кінці
+static bool mp_string(MsgpackReader *r, guint64 len, const char **out) {
+    const guint8 *b;
+    if (!mp_take(r, len, &b)) return false;
+    if (r->arena_used + len + 1 > DECODE_ARENA_BYTES) return false;
+    char *dst = r->arena + r->arena_used;
+    memcpy(dst, b, len);
+    dst[len] = '\0';
+    r->arena_used += len + 1;
+    *out = dst;
+    return true;
+}
+
+static bool decode_msgpack(const guint8 *data, gsize size, SignalingMessage *out) {
+    MsgpackReader r = { data, data + size, decode_arena, 0 };
+    const guint8 *tag;
+    bool is_map;
+    guint64 entries;
+
+    if (!mp_take(&r, 1, &tag) || !mp_container_header(&r, *tag, &is_map, &entries) || !is_map) {
+        return false;
+    }
+
+    DecodeState st = {};
+    for (guint64 i = 0; i < entries; i++) {
+        guint64 key_len;
+        const guint8 *key;
+        if (!mp_take(&r, 1, &tag)) return false;
+        if (!mp_str_header(&r, *tag, &key_len)) {
+            // Нерядковий ключ: пропускаємо пару
+            if (!mp_skip_value(&r, *tag, 1) || !mp_skip(&r, 1)) return false;
+            continue;
+        }
+        if (!mp_take(&r, key_len, &key)) return false;
+        Field field = (Field)lookup(field_names, G_N_ELEMENTS(field_names), (const char*)key, key_len, FIELD_NONE);
+
+        if (!mp_take(&r, 1, &tag)) return false;
+        guint64 len;
+
+        if (field == FIELD_CODECS) {
+            guint64 n;
+            if (!mp_container_header(&r, *tag, &is_map, &n) || is_map) {
+                if (!mp_skip_value(&r, *tag, 1)) return false;
+                continue;
+            }
+            for (guint64 j = 0; j < n; j++) {
+                const guint8 *el;
+                if (!mp_take(&r, 1, &el)) return false;
+                if (mp_str_header(&r, *el, &len)) {
+                    const guint8 *s;
+                    if (!mp_take(&r, len, &s)) return false;
+                    add_codec(out, (const char*)s, len);
+                } else if (!mp_skip_value(&r, *el, 2)) {
+                    return false;
+                }
+            }
+        } else if (is_string_field(field) && mp_str_header(&r, *tag, &len)) {
+            const char *s;
+            if (!mp_string(&r, len, &s)) return false;
+            set_string_field(out, &st, field, s, len);
+        } else if (is_int_field(field)) {
+            gint64 v;
+            bool is_number, valid;
+            if (!mp_number(&r, *tag, &v, &is_number, &valid)) return false;
+            if (is_number) {
+                if (valid) set_int_field(out, field, v);
+            } else if (!mp_skip_value(&r, *tag, 1)) {
+                return false;
+            }
+        } else if (!mp_skip_value(&r, *tag, 1)) {
+            return false;
+        }
+    }
+    classify(out, st);
+    return true;
+}
+
+bool signaling_decode(SignalingCodec codec, const guint8 *data, gsize size, SignalingMessage *out) {
+    reset_message(out);
+    if (codec == SIGNALING_CODEC_MSGPACK) return decode_msgpack(data, size, out);
+    return decode_json(data, size, out);
+}
+
+// --- Кодування ---
+static void json_append_escaped(GString *buf, const char *s) {
+    g_string_append_c(buf, '"');
+    for (const char *p = s; *p; p++) {
+        guchar c = (guchar)*p;
+        switch (c) {
+            case '"':  g_string_append(buf, "\\\""); break;
+            case '\\': g_string_append(buf, "\\\\"); break;
+            case '\n': g_string_append(buf, "\\n"); break;
+            case '\r': g_string_append(buf, "\\r"); break;
+            case '\t': g_string_append(buf, "\\t"); break;
+            default:
+                if (c < 0x20) g_string_append_printf(buf, "\\u%04x", c);
+                else g_string_append_c(buf, (gchar)c);
+        }
+    }
+    g_string_append_c(buf, '"');
+}
+
+static void mp_append_be(GString *buf, guint64 v, gsize n) {
+    for (gsize i = 0; i < n; i++) {
+        g_string_append_c(buf, (gchar)(v >> (8 * (n - 1 - i))));
+    }
+}
+
+static void mp_append_str(GString *buf, const char *s) {
+    gsize len = strlen(s);
+    if (len < 32) {
+        g_string_append_c(buf, (gchar)(0xa0 | len));
+    } else if (len < 0x100) {
+        g_string_append_c(buf, (gchar)0xd9);
+        mp_append_be(buf, len, 1);
+    } else if (len < 0x10000) {
+        g_string_append_c(buf, (gchar)0xda);
+        mp_append_be(buf, len, 2);
+    } else {
+        g_string_append_c(buf, (gchar)0xdb);
+        mp_append_be(buf, len, 4);
+    }
+    g_string_append_len(buf, s, len);
+}
+
+static void begin_field(SignalingWriter *w, const char *key) {
+    if (w->codec == SIGNALING_CODEC_MSGPACK) {
+        mp_append_str(w->buf, key);
+    } else {
+        if (w->fields > 0) g_string_append_c(w->buf, ',');
+        json_append_escaped(w->buf, key);
+        g_string_append_c(w->buf, ':');
+    }
+    w->fields++;
+}
+
+void signaling_writer_begin(SignalingWriter *w, SignalingCodec codec) {
+    signaling_writer_begin_in(w, codec, g_string_sized_new(256));
+}
+
+void signaling_writer_begin_in(SignalingWriter *w, SignalingCodec codec, GString *buf) {
+    w->codec = codec;
+    w->buf = g_string_truncate(buf, 0);
+    w->fields = 0;
+    if (codec == SIGNALING_CODEC_MSGPACK) {
+        // map 16; кількість полів дописується у finish
+        g_string_append_len(w->buf, "\xde\0\0", 3);
+    } else {
+        g_string_append_c(w->buf, '{');
+    }
+}
+
+void signaling_writer_string(SignalingWriter *w, const char *key, const char *value) {
+    begin_field(w, key);
+    if (w->codec == SIGNALING_CODEC_MSGPACK) mp_append_str(w->buf, value);
+    else json_append_escaped(w->buf, value);
+}
+
+void signaling_writer_int(SignalingWriter *w, const char *key, gint64 value) {
+    begin_field(w, key);
+    if (w->codec != SIGNALING_CODEC_MSGPACK) {
+        g_string_append_printf(w->buf, "%" G_GINT64_FORMAT, value);
+    } else if (value >= 0 && value < 0x80) {
+        g_string_append_c(w->buf, (gchar)value);
+    } else if (value < 0 && value >= -32) {
+        g_string_append_c(w->buf, (gchar)(0xe0 | (value & 0x1f)));
+    } else {
+        g_string_append_c(w->buf, (gchar)0xd3);
+        mp_append_be(w->buf, (guint64)value, 8);
+    }
+}
+
+void signaling_writer_string_array(SignalingWriter *w, const char *key, const char *const *values, guint n) {
+    begin_field(w, key);
+    if (w->codec == SIGNALING_CODEC_MSGPACK) {
+        if (n < 16) {
+            g_string_append_c(w->buf, (gchar)(0x90 | n));
+        } else {
+            g_string_append_c(w->buf, (gchar)0xdc);
+            mp_append_be(w->buf, n, 2);
+        }
+        for (guint i = 0; i < n; i++) mp_append_str(w->buf, values[i]);
+    } else {
+        g_string_append_c(w->buf, '[');
+        for (guint i = 0; i < n; i++) {
+            if (i > 0) g_string_append_c(w->buf, ',');
+            json_append_escaped(w->buf, values[i]);
+        }
+        g_string_append_c(w->buf, ']');
+    }
+}
+
+void signaling_writer_end(SignalingWriter *w) {
+    if (w->codec == SIGNALING_CODEC_MSGPACK) {
+        w->buf->str[1] = (gchar)(w->fields >> 8);
+        w->buf->str[2] = (gchar)(w->fields & 0xff);
+    } else {
+        g_string_append_c(w->buf, '}');
+    }
+}
+
+GBytes *signaling_writer_finish(SignalingWriter *w) {
+    signaling_writer_end(w);
+    gsize len = w->buf->len;
+    GBytes *bytes = g_bytes_new_take(g_string_free(w->buf, FALSE), len);
+    w->buf = nullptr;
+    return bytes;
+}
@@ -0,0 +1,86 @@
+#ifndef SIGNALING_CODEC_H
+#define SIGNALING_CODEC_H
+
+#include <glib.h>
+
+// Кодування повідомлень signaling. JSON — текстові кадри WebSocket,
+// MessagePack — бінарні; глядач оголошує підтримувані в "codecs" у ready.
+enum SignalingCodec {
+    SIGNALING_CODEC_JSON,
+    SIGNALING_CODEC_MSGPACK,
+    SIGNALING_CODEC_COUNT
+};
+
+#define SIGNALING_CODEC_BIT(c) (1u << (c))
+
+// Тип повідомлення визначається під час розбору, обробник обирається
+// за ним з таблиці без порівняння рядків
+enum SignalingType {
+    SIGNALING_UNKNOWN,
+    SIGNALING_READY,
+    SIGNALING_CONTROL,
+    SIGNALING_STOP,
+    SIGNALING_DISCONNECT,
+    SIGNALING_ANSWER,
+    SIGNALING_CANDIDATE,
+    SIGNALING_LOCK,
+    SIGNALING_CONFIGURE,
+    SIGNALING_LATENCY,
+    SIGNALING_TYPE_COUNT
+};
+
+// Розібране повідомлення. Рядки вказують у внутрішній буфер декодера
+// і дійсні до наступного signaling_decode(); nullptr — поля немає.
+struct SignalingMessage {
+    SignalingType type;
+    const char *device;
+    const char *peer;
+    const char *role;
+    const char *direction;
+    const char *turn;
+    const char *sdp;
+    const char *candidate;
+    const char *session;          // маркер сесії машини для відновлення в ready
+    const char *recovery;         // ready: профіль захисту від втрат, див. loss_recovery.h
+    gint64      speed;            // -1 — не задано
+    gint64      sdp_mline_index;  // -1 — не задано
+    gint64      seconds;          // lock: скільки останніх секунд зберегти, -1 — не задано
+    const char *preset;           // configure: назва набору [preset:NAME]
+    gint64      width;            // configure: поверх набору, -1 — не задано
+    gint64      height;
+    gint64      framerate;
+    gint64      bitrate;          // біт/с
+    gint64      latency_us;       // latency: захоплення → показ, -1 — не задано
+    guint       codecs;           // SIGNALING_CODEC_BIT(...), 0 — лише JSON
+};
+
+// Розбір одного кадру на місці, без виділення пам'яті в обох кодуваннях.
+// Стан декодера спільний, тож виклики лише з головного циклу;
+// false — кадр пошкоджений або не є об'єктом.
+bool signaling_decode(SignalingCodec codec, const guint8 *data, gsize size, SignalingMessage *out);
+
+const char *signaling_codec_name(SignalingCodec codec);
+// Найкомпактніше кодування з тих, що підтримують обидві сторони
+SignalingCodec signaling_codec_pick(guint remote_codecs);
+
+// Пряме кодування одного об'єкта в буфер без проміжного дерева.
+// Можна використовувати з будь-якого потоку: стан лише на стеку
+// або в буфері, яким володіє викликач.
+struct SignalingWriter {
+    SignalingCodec codec;
+    GString *buf;
+    guint    fields;
+};
+
+void signaling_writer_begin(SignalingWriter *w, SignalingCodec codec);
+// Пише в чужий буфер, попередній вміст відкидається; після
+// signaling_writer_end кадр лежить у buf, buf лишається викликачу
+void signaling_writer_begin_in(SignalingWriter *w, SignalingCodec codec, GString *buf);
+void signaling_writer_string(SignalingWriter *w, const char *key, const char *value);
+void signaling_writer_int(SignalingWriter *w, const char *key, gint64 value);
+void signaling_writer_string_array(SignalingWriter *w, const char *key, const char *const *values, guint n);
+void signaling_writer_end(SignalingWriter *w);
+// Готовий кадр; JSON завершується нулем поза межами GBytes
+GBytes *signaling_writer_finish(SignalingWriter *w);
+
+#endif // SIGNALING_CODEC_H
@@ -1,9 +1,20 @@
 #!/bin/bash
 # Цей скрипт запускає камеру і транслює потік на локальний порт 5001
+# Використання: start_camera.sh [low-latency] — профіль має збігатися з [media] profile
 
 LIBCAM_CMD="libcamera-vid -t 0 --inline -n -o - --width 640 --height 480 --framerate 25 --codec h264 --profile baseline --intra 25 --bitrate 1500000"
+UDPSINK="udpsink host=127.0.0.1 port=5001"
 
-GST_CMD="gst-launch-1.0 -v fdsrc ! queue ! h264parse ! rtph264pay ! udpsink host=127.0.0.1 port=5001"
+# Закодовані кадри тут не відкидаються: без IDR після пропуску картинка
+# псувалася б до наступного --intra. Для low-latency затримку обмежуємо
+# до кодера: libcamera-vid віддає кожен кадр одразу (--flush), а udpsink
+# не синхронізується з годинником
+if [ "$1" = "low-latency" ]; then
+    LIBCAM_CMD="$LIBCAM_CMD --flush"
+    UDPSINK="$UDPSINK sync=false"
+fi
+
+GST_CMD="gst-launch-1.0 -v fdsrc ! queue ! h264parse ! rtph264pay ! $UDPSINK"
 
 echo "Starting camera stream to localhost:5001..."
 $LIBCAM_CMD | $GST_CMD
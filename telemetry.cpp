@@ -0,0 +1,279 @@
+#include "telemetry.h"
+#include "gpio_control.h"
+#include "motor_thread.h"
+#include "rate_control.h"
+#include "media_ingest.h"
+#include "metrics.h"
+#include "config.h"
+#include "log.h"
+#include <gst/webrtc/webrtc.h>
+#include <glib.h>
+#include <cstdio>
+#include <cstring>
+
+// Пакети, що не пішли в SCTP, застарівають: понад цей обсяг у буфері
+// каналу нову вибірку відкидаємо замість нарощування черги
+#define TELEMETRY_MAX_BUFFERED 8192
+
+#define TELEMETRY_PACKET_MAX (TELEMETRY_HEADER_SIZE + TELEMETRY_MAX_SAMPLES * TELEMETRY_SAMPLE_SIZE)
+
+// Канал одного глядача з пакетом, що накопичується
+struct TelemetryChannel {
+    gchar *peer_id;
+    GstWebRTCDataChannel *channel;
+    guint32 seq;
+    guint count;
+    gint64 first_us;
+    guint8 packet[TELEMETRY_PACKET_MAX];
+};
+
+// Спільна для всіх глядачів частина вибірки
+struct SystemSample {
+    guint8 cpu_load;
+    gint16 cpu_temp;
+    guint8 fps;
+    guint8 frames_dropped;
+};
+
+struct Telemetry {
+    Vehicle *vehicle;          // nullptr — пристрій без моторів
+    RateControl *rate;
+    MediaIngest *ingest;
+    GHashTable *channels;      // peer_id → TelemetryChannel*
+    guint tick_id;
+    guint interval_ms;         // фактичний період таймера, не менше 10 мс
+    guint samples_per_packet;
+
+    // Попередні значення для різниць між вибірками
+    guint64 frames_prev, dropped_prev;
+    gint64 sample_prev_us;
+};
+
+static void free_channel(gpointer data) {
+    TelemetryChannel *tc = (TelemetryChannel*)data;
+    g_object_unref(tc->channel);
+    g_free(tc->peer_id);
+    g_free(tc);
+}
+
+static void put_u16(guint8 *p, guint v) {
+    v = MIN(v, G_MAXUINT16);
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+}
+
+static void put_u32(guint8 *p, guint32 v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = v >> 24;
+}
+
+// --- Стан системи ---
+// Спільний для всіх пристроїв процесу: /proc/stat і датчик температури
+// читаються раз на такт, хоч би скільки пристроїв мали глядачів.
+// Лише головний цикл.
+static struct {
+    gint64  sampled_us;       // 0 — ще не читали
+    guint64 busy_prev, total_prev;
+    guint8  cpu_load;
+    gint16  cpu_temp;
+} system_state;
+
+static guint8 read_cpu_load(bool first) {
+    FILE *f = fopen("/proc/stat", "r");
+    if (!f) return 0;
+    guint64 user = 0, nice = 0, system = 0, idle = 0, iowait = 0, irq = 0, softirq = 0, steal = 0;
+    int n = fscanf(f, "cpu %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT
+                   " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT,
+                   &user, &nice, &system, &idle, &iowait, &irq, &softirq, &steal);
+    fclose(f);
+    if (n < 4) return 0;
+
+    guint64 busy = user + nice + system + irq + softirq + steal;
+    guint64 total = busy + idle + iowait;
+    guint64 d_busy = busy - system_state.busy_prev, d_total = total - system_state.total_prev;
+    system_state.busy_prev = busy;
+    system_state.total_prev = total;
+    if (first || d_total == 0) return 0;
+    return (guint8)(d_busy * 100 / d_total);
+}
+
+static gint16 read_cpu_temp() {
+    gchar *text = nullptr;
+    if (!g_file_get_contents(config_get()->telemetry.thermal_zone, &text, NULL, NULL)) return G_MININT16;
+    gint64 millideg = g_ascii_strtoll(text, NULL, 10);
+    g_free(text);
+    return (gint16)CLAMP(millideg / 100, G_MININT16 + 1, G_MAXINT16);
+}
+
+// Повторне читання в межах половини такту віддає збережене значення.
+// Після перерви довше за два такти різниця CPU рахується заново.
+static void sample_cpu(SystemSample *s, gint64 now, guint interval_ms) {
+    gint64 age = now - system_state.sampled_us;
+    if (!system_state.sampled_us || age >= (gint64)interval_ms * 500) {
+        bool first = !system_state.sampled_us || age > (gint64)interval_ms * 2000;
+        system_state.cpu_load = read_cpu_load(first);
+        system_state.cpu_temp = read_cpu_temp();
+        system_state.sampled_us = now;
+    }
+    s->cpu_load = system_state.cpu_load;
+    s->cpu_temp = system_state.cpu_temp;
+}
+
+// Кадри — лише цього пристрою; метрики процесу сумують усі пристрої
+static void sample_system(Telemetry *t, SystemSample *s, gint64 now) {
+    sample_cpu(s, now, t->interval_ms);
+
+    guint64 frames, dropped;
+    media_ingest_frame_counts(t->ingest, &frames, &dropped);
+    gint64 dt = t->sample_prev_us ? now - t->sample_prev_us : 0;
+    s->fps = dt > 0 ? (guint8)MIN((frames - t->frames_prev) * G_USEC_PER_SEC / dt, G_MAXUINT8) : 0;
+    s->frames_dropped = (guint8)MIN(dropped - t->dropped_prev, G_MAXUINT8);
+    t->frames_prev = frames;
+    t->dropped_prev = dropped;
+    t->sample_prev_us = now;
+}
+
+static guint8 speed_byte(int8_t speed) {
+    return speed < 0 ? 255 : (guint8)speed;
+}
+
+// --- Пакет ---
+static void append_sample(Telemetry *t, TelemetryChannel *tc, const SystemSample &sys, const MotorOutputs &out,
+                          gint64 applied_us, gint64 latency_us, gint64 now) {
+    if (tc->count == 0) tc->first_us = now;
+    guint8 *p = tc->packet + TELEMETRY_HEADER_SIZE + tc->count * TELEMETRY_SAMPLE_SIZE;
+    memset(p, 0, TELEMETRY_SAMPLE_SIZE);
+
+    p[0] = (guint8)out.direction;
+    p[1] = (guint8)out.turn;
+    p[2] = speed_byte(out.speed_a);
+    p[3] = speed_byte(out.speed_b);
+    put_u16(p + 4, applied_us ? (guint)MIN((now - applied_us) / 1000, G_MAXUINT16) : G_MAXUINT16);
+    put_u16(p + 6, (guint)CLAMP(latency_us, 0, G_MAXUINT16));
+
+    LinkStats ls;
+    if (rate_control_get_link_stats(t->rate, tc->peer_id, &ls)) {
+        put_u16(p + 8, (guint)ls.rtt_ms);
+        p[10] = (guint8)CLAMP(ls.fraction_lost * 255, 0, 255);
+        put_u16(p + 12, (guint)MIN(ls.send_bps / 1000, (double)G_MAXUINT16));
+        put_u16(p + 14, ls.target_bps / 1000);
+    }
+    p[11] = sys.cpu_load;
+    put_u16(p + 16, (guint16)sys.cpu_temp);
+    p[18] = sys.fps;
+    p[19] = sys.frames_dropped;
+    tc->count++;
+}
+
+static void flush_packet(Telemetry *t, TelemetryChannel *tc) {
+    guint count = tc->count;
+    tc->count = 0;
+
+    GstWebRTCDataChannelState state;
+    guint64 buffered = 0;
+    g_object_get(tc->channel, "ready-state", &state, "buffered-amount", &buffered, NULL);
+    if (state != GST_WEBRTC_DATA_CHANNEL_STATE_OPEN) return;
+    if (buffered > TELEMETRY_MAX_BUFFERED) {
+        metrics_inc(METRIC_TELEMETRY_PACKETS_DROPPED);
+        return;
+    }
+
+    guint8 *h = tc->packet;
+    put_u32(h, tc->seq++);
+    put_u32(h + 4, (guint32)(tc->first_us / 1000));
+    h[8] = TELEMETRY_VERSION;
+    h[9] = (guint8)count;
+    put_u16(h + 10, (guint16)t->interval_ms);
+
+    GBytes *bytes = g_bytes_new(tc->packet, TELEMETRY_HEADER_SIZE + count * TELEMETRY_SAMPLE_SIZE);
+    g_signal_emit_by_name(tc->channel, "send-data", bytes);
+    g_bytes_unref(bytes);
+    metrics_inc(METRIC_TELEMETRY_PACKETS_SENT);
+}
+
+static gboolean telemetry_tick(gpointer data) {
+    Telemetry *t = (Telemetry*)data;
+    // Без глядачів нічого не читаємо: цикл декодує ще й команди
+    if (g_hash_table_size(t->channels) == 0) return G_SOURCE_CONTINUE;
+    gint64 now = g_get_monotonic_time();
+    SystemSample sys;
+    sample_system(t, &sys, now);
+
+    // Застосований стан виходів, а не остання прийнята команда
+    MotorOutputs out = { 0, 0, -1, -1 };
+    gint64 applied_us = 0, latency_us = 0;
+    if (t->vehicle) {
+        motor_outputs_get(t->vehicle, &out);
+        motor_thread_last_command(t->vehicle, &applied_us, &latency_us);
+    }
+
+    GHashTableIter it;
+    gpointer value;
+    g_hash_table_iter_init(&it, t->channels);
+    while (g_hash_table_iter_next(&it, NULL, &value)) {
+        TelemetryChannel *tc = (TelemetryChannel*)value;
+        append_sample(t, tc, sys, out, applied_us, latency_us, now);
+        if (tc->count >= t->samples_per_packet) flush_packet(t, tc);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+Telemetry *telemetry_new(Vehicle *vehicle, RateControl *rate, MediaIngest *ingest) {
+    const TelemetryConfig &tc = config_get()->telemetry;
+    if (!tc.enabled) return nullptr;
+
+    Telemetry *t = g_new0(Telemetry, 1);
+    t->vehicle = vehicle;
+    t->rate = rate;
+    t->ingest = ingest;
+    // Заголовок пакета передає крок у 16 бітах
+    t->interval_ms = CLAMP(tc.sample_interval_ms, 10u, (guint)G_MAXUINT16);
+    t->samples_per_packet = CLAMP(tc.send_interval_ms / t->interval_ms, 1u, (guint)TELEMETRY_MAX_SAMPLES);
+    t->channels = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, free_channel);
+    t->tick_id = g_timeout_add(t->interval_ms, telemetry_tick, t);
+    LOG_INFO("TELEMETRY", "Telemetry started: sample every %u ms, %u sample(s) per packet",
+             t->interval_ms, t->samples_per_packet);
+    return t;
+}
+
+void telemetry_free(Telemetry *t) {
+    if (!t) return;
+    g_source_remove(t->tick_id);
+    g_hash_table_destroy(t->channels);
+    g_free(t);
+}
+
+void telemetry_attach(Telemetry *t, const char *peer_id, GstElement *webrtc) {
+    if (!t) return;
+
+    // Як і керування: загублена вибірка однаково застаріла б до повтору
+    GstStructure *opts = gst_structure_new("application/data-channel",
+        "ordered", G_TYPE_BOOLEAN, FALSE,
+        "max-retransmits", G_TYPE_INT, 0,
+        NULL);
+    GstWebRTCDataChannel *channel = nullptr;
+    g_signal_emit_by_name(webrtc, "create-data-channel", TELEMETRY_CHANNEL_LABEL, opts, &channel);
+    gst_structure_free(opts);
+
+    if (!channel) {
+        LOG_WARN("TELEMETRY", "Failed to create telemetry channel for %s", peer_id);
+        return;
+    }
+
+    // Перший глядач: лічильники кадрів могли накопичитися без вибірок
+    if (g_hash_table_size(t->channels) == 0) {
+        media_ingest_frame_counts(t->ingest, &t->frames_prev, &t->dropped_prev);
+        t->sample_prev_us = 0;
+    }
+
+    TelemetryChannel *tc = g_new0(TelemetryChannel, 1);
+    tc->peer_id = g_strdup(peer_id);
+    tc->channel = channel;    // посилання від create-data-channel
+    g_hash_table_replace(t->channels, tc->peer_id, tc);
+}
+
+void telemetry_detach(Telemetry *t, const char *peer_id) {
+    if (t) g_hash_table_remove(t->channels, peer_id);
+}
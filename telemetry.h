@@ -0,0 +1,59 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <gst/gst.h>
+
+// Телеметрія машини для глядача через окремий WebRTC data channel
+// "telemetry" (неупорядкований, без повторних передач). Вибірки стану
+// накопичуються і відправляються пакетом раз на send_interval_ms
+// ([telemetry] у конфігурації).
+//
+// Пакет, little-endian:
+//   0..3   seq           — лічильник пакетів цього каналу
+//   4..7   timestamp_ms  — монотонний час машини першої вибірки
+//   8      version       — TELEMETRY_VERSION
+//   9      count         — кількість вибірок
+//   10..11 interval_ms   — фактичний крок між вибірками (не менше 10 мс)
+//   далі count вибірок по TELEMETRY_SAMPLE_SIZE байт:
+//   0      direction     — застосований: -1 назад, 0 немає, 1 вперед
+//   1      turn          — застосований: -1 вліво, 0 прямо, 1 вправо
+//   2      speed_a       — заповнення PWM мотора руху, %, 255 — невідоме
+//   3      speed_b       — заповнення PWM мотора повороту, %, 255 — невідоме
+//   4..5   command_age_ms     — від застосування останньої команди, 65535 — немає
+//   6..7   command_latency_us — прийом → запис виходів останньої команди
+//   8..9   rtt_ms        — RTT до глядача з RTCP, 0 — невідомо
+//   10     loss          — частка втрат * 255
+//   11     cpu_load      — завантаження CPU, %
+//   12..13 send_kbps     — фактична швидкість відправки глядачу
+//   14..15 target_kbps   — ціль регулятора бітрейту
+//   16..17 cpu_temp      — 0.1 °C, -32768 — невідомо
+//   18     fps           — закодованих кадрів пристрою за секунду на вході tee
+//   19     frames_dropped — відкинуто кадрів пристрою з попередньої вибірки
+// Значення, що не вміщаються, обрізаються до максимуму поля.
+#define TELEMETRY_CHANNEL_LABEL "telemetry"
+#define TELEMETRY_VERSION       1
+#define TELEMETRY_HEADER_SIZE   12
+#define TELEMETRY_SAMPLE_SIZE   20
+#define TELEMETRY_MAX_SAMPLES   32
+
+struct Telemetry;
+struct Vehicle;
+struct RateControl;
+struct MediaIngest;
+
+// Таймер вибірки в головному циклі; потік керування лише публікує
+// застосований стан атомарними записами і не чекає на телеметрію.
+// Без глядачів таймер нічого не читає; CPU і температура читаються
+// раз на такт на весь процес.
+// Свій екземпляр у кожного пристрою; vehicle == nullptr — без моторів
+// (напрямок і поворот 0, заповнення невідоме). nullptr, якщо
+// [telemetry] вимкнено — решта функцій тоді нічого не робить.
+Telemetry *telemetry_new(Vehicle *vehicle, RateControl *rate, MediaIngest *ingest);
+void telemetry_free(Telemetry *t);
+
+// Створює канал телеметрії для глядача. Як і control_channel_attach —
+// коли webrtcbin уже в READY, але до PLAYING.
+void telemetry_attach(Telemetry *t, const char *peer_id, GstElement *webrtc);
+void telemetry_detach(Telemetry *t, const char *peer_id);
+
+#endif // TELEMETRY_H
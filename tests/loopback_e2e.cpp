@@ -0,0 +1,491 @@
+// Наскрізна перевірка машини без мережі, сервера на Node і браузера.
+// В одному процесі працюють:
+//   - машина: start_webrtc() з source=test (videotestsrc → x264enc) і
+//     симулятором моторів;
+//   - заглушка сервера сигналізації: SoupServer на 127.0.0.1, /ws;
+//   - глядач: webrtcbin без вікна, кадри рахує fakesink після rtph264depay.
+// Сценарій: ready → offer/answer → перший кадр, кілька примусових розривів
+// WebSocket з відновленням сесії ("resumed"), далі безперервний прийом
+// протягом --soak секунд. Результат — JSON; код 77 — немає потрібних
+// елементів GStreamer (CTest вважає тест пропущеним).
+#include "webrtc_pipeline.h"
+#include "gpio_control.h"
+#include "motor_thread.h"
+#include "lifecycle.h"
+#include "signaling_codec.h"
+#include "config.h"
+#include "log.h"
+#include "bench/report.h"
+#include <gst/gst.h>
+#include <gst/webrtc/webrtc.h>
+#include <gst/sdp/sdp.h>
+#include <libsoup/soup.h>
+#include <json-glib/json-glib.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <vector>
+
+#define EXIT_SKIP          77
+#define DEVICE_ID          "loopback"
+#define VIEWER_ID          "viewer"
+#define TEST_FRAMERATE     25
+#define PHASE_TIMEOUT_US   (30 * G_USEC_PER_SEC)
+#define DROP_SETTLE_US     G_USEC_PER_SEC    // пауза між етапами
+
+enum Phase {
+    PHASE_CONNECT,      // до першого кадру в глядача
+    PHASE_DROPS,        // примусові розриви WebSocket
+    PHASE_SOAK,         // безперервний прийом
+    PHASE_DONE
+};
+
+struct Harness {
+    GMainLoop *loop;
+    SoupServer *server;
+    SoupWebsocketConnection *car;     // поточне з'єднання машини
+    GstElement *viewer;
+    GstElement *webrtc;
+    gchar *session;                   // маркер з ready машини
+    Phase phase;
+    gint64 phase_start_us;
+    const char *failure;
+
+    gint64 ready_sent_us;
+    std::atomic<gint64> connected_us{0};
+    std::atomic<gint64> first_frame_us{0};
+    std::atomic<gint64> last_frame_us{0};
+    std::atomic<gint64> max_gap_us{0};
+    std::atomic<guint64> frames{0};
+
+    guint drops_wanted;
+    guint drops_done;
+    bool waiting_resume;
+    gint64 drop_us;
+    gint64 next_action_us;
+    guint64 frames_at_drop;
+    guint64 frames_during_drops;
+    std::vector<double> reconnect_ms;
+
+    guint soak_seconds;
+    guint64 soak_frames_start;
+    double soak_fps;
+    double soak_max_gap_ms;
+};
+
+static Harness H;
+
+static void fail(const char *reason) {
+    if (!H.failure) H.failure = reason;
+    H.phase = PHASE_DONE;
+    g_main_loop_quit(H.loop);
+}
+
+static void enter_phase(Phase phase) {
+    H.phase = phase;
+    H.phase_start_us = g_get_monotonic_time();
+}
+
+// --- Повідомлення машині від імені глядача ---
+static gboolean send_to_car_cb(gpointer data) {
+    if (H.car && soup_websocket_connection_get_state(H.car) == SOUP_WEBSOCKET_STATE_OPEN) {
+        soup_websocket_connection_send_message(H.car, SOUP_WEBSOCKET_DATA_TEXT, (GBytes*)data);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+// Викликається і з потоків webrtcbin глядача
+static void send_to_car(SignalingWriter *w) {
+    GBytes *frame = signaling_writer_finish(w);
+    g_main_context_invoke_full(NULL, G_PRIORITY_DEFAULT, send_to_car_cb, frame, (GDestroyNotify)g_bytes_unref);
+}
+
+static void begin_viewer_message(SignalingWriter *w) {
+    signaling_writer_begin(w, SIGNALING_CODEC_JSON);
+    signaling_writer_string(w, "device", DEVICE_ID);
+    signaling_writer_string(w, "peer", VIEWER_ID);
+}
+
+static void send_viewer_ready(const char *session) {
+    static const char *const codecs[] = { "json" };
+    SignalingWriter w;
+    begin_viewer_message(&w);
+    signaling_writer_string(&w, "action", "ready");
+    signaling_writer_string(&w, "role", "driver");
+    signaling_writer_string_array(&w, "codecs", codecs, G_N_ELEMENTS(codecs));
+    if (session) signaling_writer_string(&w, "session", session);
+    send_to_car(&w);
+}
+
+// --- Глядач ---
+static void on_frame(GstElement*, GstBuffer*, GstPad*, gpointer) {
+    gint64 now = g_get_monotonic_time();
+    H.frames.fetch_add(1, std::memory_order_relaxed);
+    gint64 none = 0;
+    H.first_frame_us.compare_exchange_strong(none, now, std::memory_order_relaxed);
+    gint64 last = H.last_frame_us.exchange(now, std::memory_order_relaxed);
+    if (last) {
+        gint64 gap = now - last;
+        gint64 max = H.max_gap_us.load(std::memory_order_relaxed);
+        while (gap > max && !H.max_gap_us.compare_exchange_weak(max, gap, std::memory_order_relaxed)) {
+        }
+    }
+}
+
+static void on_viewer_pad(GstElement*, GstPad *pad, gpointer) {
+    if (GST_PAD_DIRECTION(pad) != GST_PAD_SRC) return;
+
+    GstElement *bin = gst_parse_bin_from_description(
+        "queue ! rtph264depay ! fakesink name=framesink sync=false signal-handoffs=true", TRUE, NULL);
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(bin), "framesink");
+    g_signal_connect(sink, "handoff", G_CALLBACK(on_frame), NULL);
+    gst_object_unref(sink);
+
+    gst_bin_add(GST_BIN(H.viewer), bin);
+    gst_element_sync_state_with_parent(bin);
+    GstPad *sinkpad = gst_element_get_static_pad(bin, "sink");
+    gst_pad_link(pad, sinkpad);
+    gst_object_unref(sinkpad);
+}
+
+static void on_viewer_state(GstElement *webrtc, GParamSpec*, gpointer) {
+    GstWebRTCPeerConnectionState state;
+    g_object_get(webrtc, "connection-state", &state, NULL);
+    gint64 none = 0;
+    if (state == GST_WEBRTC_PEER_CONNECTION_STATE_CONNECTED) {
+        H.connected_us.compare_exchange_strong(none, g_get_monotonic_time(), std::memory_order_relaxed);
+    }
+}
+
+static void on_viewer_candidate(GstElement*, guint mline, gchar *candidate, gpointer) {
+    if (!candidate) return;
+    SignalingWriter w;
+    begin_viewer_message(&w);
+    signaling_writer_string(&w, "candidate", candidate);
+    signaling_writer_int(&w, "sdpMLineIndex", mline);
+    send_to_car(&w);
+}
+
+static void on_answer_created(GstPromise *promise, gpointer) {
+    GstWebRTCSessionDescription *answer = nullptr;
+    const GstStructure *reply = gst_promise_get_reply(promise);
+    if (reply) gst_structure_get(reply, "answer", GST_TYPE_WEBRTC_SESSION_DESCRIPTION, &answer, NULL);
+    gst_promise_unref(promise);
+    if (!answer) return;
+
+    g_signal_emit_by_name(H.webrtc, "set-local-description", answer, NULL);
+    SignalingWriter w;
+    begin_viewer_message(&w);
+    signaling_writer_string(&w, "type", "answer");
+    gchar *sdp = gst_sdp_message_as_text(answer->sdp);
+    signaling_writer_string(&w, "sdp", sdp);
+    g_free(sdp);
+    send_to_car(&w);
+    gst_webrtc_session_description_free(answer);
+}
+
+static void on_offer_set(GstPromise *promise, gpointer) {
+    gst_promise_unref(promise);
+    GstPromise *p = gst_promise_new_with_change_func(on_answer_created, NULL, NULL);
+    g_signal_emit_by_name(H.webrtc, "create-answer", NULL, p);
+}
+
+static void viewer_handle_offer(const char *text) {
+    GstSDPMessage *sdp = nullptr;
+    if (gst_sdp_message_new_from_text(text, &sdp) != GST_SDP_OK) {
+        fail("car sent an unparsable offer");
+        return;
+    }
+    GstWebRTCSessionDescription *offer = gst_webrtc_session_description_new(GST_WEBRTC_SDP_TYPE_OFFER, sdp);
+    GstPromise *p = gst_promise_new_with_change_func(on_offer_set, NULL, NULL);
+    g_signal_emit_by_name(H.webrtc, "set-remote-description", offer, p);
+    gst_webrtc_session_description_free(offer);
+}
+
+static bool viewer_start() {
+    H.viewer = gst_pipeline_new("viewer");
+    H.webrtc = gst_element_factory_make("webrtcbin", "viewer-webrtc");
+    if (!H.webrtc) return false;
+    gst_bin_add(GST_BIN(H.viewer), H.webrtc);
+    g_signal_connect(H.webrtc, "on-ice-candidate", G_CALLBACK(on_viewer_candidate), NULL);
+    g_signal_connect(H.webrtc, "pad-added", G_CALLBACK(on_viewer_pad), NULL);
+    g_signal_connect(H.webrtc, "notify::connection-state", G_CALLBACK(on_viewer_state), NULL);
+    return gst_element_set_state(H.viewer, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE;
+}
+
+// --- Заглушка сервера сигналізації ---
+static void on_car_message(SoupWebsocketConnection*, SoupWebsocketDataType, GBytes *frame, gpointer) {
+    gsize size;
+    const gchar *data = (const gchar*)g_bytes_get_data(frame, &size);
+    JsonParser *parser = json_parser_new();
+    if (!json_parser_load_from_data(parser, data, size, NULL) ||
+        !JSON_NODE_HOLDS_OBJECT(json_parser_get_root(parser))) {
+        g_object_unref(parser);
+        fail("car sent a malformed signaling frame");
+        return;
+    }
+    JsonObject *obj = json_node_get_object(json_parser_get_root(parser));
+    const char *action = json_object_get_string_member_with_default(obj, "action", nullptr);
+    const char *type = json_object_get_string_member_with_default(obj, "type", nullptr);
+    const char *candidate = json_object_get_string_member_with_default(obj, "candidate", nullptr);
+
+    if (!g_strcmp0(action, "ready")) {
+        g_free(H.session);
+        H.session = g_strdup(json_object_get_string_member_with_default(obj, "session", nullptr));
+        if (!H.viewer) {
+            if (!viewer_start()) fail("viewer webrtcbin did not start");
+            H.ready_sent_us = g_get_monotonic_time();
+            send_viewer_ready(nullptr);
+        } else {
+            // Глядач повертається в ту саму сесію
+            send_viewer_ready(H.session);
+        }
+    } else if (!g_strcmp0(type, "offer")) {
+        viewer_handle_offer(json_object_get_string_member_with_default(obj, "sdp", ""));
+    } else if (candidate) {
+        guint mline = (guint)json_object_get_int_member_with_default(obj, "sdpMLineIndex", 0);
+        g_signal_emit_by_name(H.webrtc, "add-ice-candidate", mline, candidate);
+    } else if (!g_strcmp0(action, "resumed") && H.waiting_resume) {
+        gint64 now = g_get_monotonic_time();
+        H.reconnect_ms.push_back((now - H.drop_us) / 1000.0);
+        H.frames_during_drops += H.frames.load(std::memory_order_relaxed) - H.frames_at_drop;
+        H.waiting_resume = false;
+        H.drops_done++;
+        H.next_action_us = now + DROP_SETTLE_US;
+    } else if (!g_strcmp0(action, "busy")) {
+        fail("car rejected the viewer as busy");
+    }
+    g_object_unref(parser);
+}
+
+static void on_car_closed(SoupWebsocketConnection *conn, gpointer) {
+    if (H.car == conn) {
+        g_clear_object(&H.car);
+    }
+}
+
+static void on_car_connected(SoupServer*, SoupServerMessage*, const char*, SoupWebsocketConnection *conn, gpointer) {
+    if (H.car) {
+        fail("car opened a second signaling connection");
+        return;
+    }
+    H.car = (SoupWebsocketConnection*)g_object_ref(conn);
+    g_signal_connect(conn, "message", G_CALLBACK(on_car_message), NULL);
+    g_signal_connect(conn, "closed", G_CALLBACK(on_car_closed), NULL);
+}
+
+static guint server_start() {
+    H.server = soup_server_new(NULL, NULL);
+    soup_server_add_websocket_handler(H.server, "/ws", NULL, NULL, on_car_connected, NULL, NULL);
+    GError *error = nullptr;
+    if (!soup_server_listen_local(H.server, 0, SOUP_SERVER_LISTEN_IPV4_ONLY, &error)) {
+        fprintf(stderr, "loopback_e2e: cannot listen: %s\n", error->message);
+        g_error_free(error);
+        return 0;
+    }
+    GSList *uris = soup_server_get_uris(H.server);
+    guint port = uris ? (guint)g_uri_get_port((GUri*)uris->data) : 0;
+    g_slist_free_full(uris, (GDestroyNotify)g_uri_unref);
+    return port;
+}
+
+// --- Сценарій ---
+static gboolean scenario_tick(gpointer) {
+    gint64 now = g_get_monotonic_time();
+    guint64 frames = H.frames.load(std::memory_order_relaxed);
+
+    switch (H.phase) {
+    case PHASE_CONNECT:
+        if (H.first_frame_us.load(std::memory_order_relaxed)) {
+            enter_phase(PHASE_DROPS);
+            H.next_action_us = now + DROP_SETTLE_US;
+        } else if (now - H.phase_start_us > PHASE_TIMEOUT_US) {
+            fail(H.connected_us.load() ? "connected, but no frame arrived" : "viewer did not connect");
+        }
+        break;
+
+    case PHASE_DROPS:
+        if (H.waiting_resume) {
+            if (now - H.drop_us > PHASE_TIMEOUT_US) fail("car did not resume the session after a drop");
+        } else if (H.drops_done >= H.drops_wanted) {
+            enter_phase(PHASE_SOAK);
+            H.soak_frames_start = frames;
+            H.max_gap_us.store(0, std::memory_order_relaxed);
+        } else if (now >= H.next_action_us && H.car) {
+            // Розрив з боку сервера: машина перепідключається з відкладенням
+            H.drop_us = now;
+            H.frames_at_drop = frames;
+            H.waiting_resume = true;
+            soup_websocket_connection_close(H.car, SOUP_WEBSOCKET_CLOSE_GOING_AWAY, "forced drop");
+        }
+        break;
+
+    case PHASE_SOAK:
+        if (now - H.phase_start_us >= (gint64)H.soak_seconds * G_USEC_PER_SEC) {
+            double seconds = (now - H.phase_start_us) / 1e6;
+            H.soak_fps = (frames - H.soak_frames_start) / seconds;
+            H.soak_max_gap_ms = H.max_gap_us.load(std::memory_order_relaxed) / 1000.0;
+            H.phase = PHASE_DONE;
+            g_main_loop_quit(H.loop);
+        }
+        break;
+
+    case PHASE_DONE:
+        break;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static bool have_elements() {
+    static const char *const required[] = {
+        "videotestsrc", "x264enc", "h264parse", "rtph264pay", "rtph264depay",
+        "webrtcbin", "nicesrc", "dtlssrtpenc", "fakesink",
+    };
+    for (const char *name : required) {
+        GstElementFactory *f = gst_element_factory_find(name);
+        if (!f) {
+            fprintf(stderr, "loopback_e2e: GStreamer element %s is not available, skipping\n", name);
+            return false;
+        }
+        gst_object_unref(f);
+    }
+    return true;
+}
+
+static bool load_car_config() {
+    gchar *text = g_strdup_printf(
+        "[media]\nsource=test\nwidth=320\nheight=240\nframerate=%u\nbitrate=500000\nstun_server=\n"
+        "[signaling]\nreconnect_min_ms=100\nreconnect_max_ms=1000\n"
+        "[control]\nbackend=sim\n"
+        "[metrics]\nenabled=false\n"
+        "[log]\nlevel=warn\n",
+        TEST_FRAMERATE);
+    bool ok = config_load_from_data(text);
+    g_free(text);
+    return ok;
+}
+
+static double median(std::vector<double> v) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    return v[v.size() / 2];
+}
+
+static gchar *render_json() {
+    gint64 connected = H.connected_us.load(), first = H.first_frame_us.load();
+    JsonBuilder *b = json_builder_new();
+    json_builder_begin_object(b);
+    json_builder_set_member_name(b, "passed");
+    json_builder_add_boolean_value(b, H.failure == nullptr);
+    if (H.failure) {
+        json_builder_set_member_name(b, "failure");
+        json_builder_add_string_value(b, H.failure);
+    }
+    json_builder_set_member_name(b, "connection_setup_ms");
+    json_builder_add_double_value(b, connected ? (connected - H.ready_sent_us) / 1000.0 : -1);
+    json_builder_set_member_name(b, "first_frame_ms");
+    json_builder_add_double_value(b, first ? (first - H.ready_sent_us) / 1000.0 : -1);
+    json_builder_set_member_name(b, "reconnect_ms");
+    json_builder_begin_array(b);
+    for (double ms : H.reconnect_ms) json_builder_add_double_value(b, ms);
+    json_builder_end_array(b);
+    json_builder_set_member_name(b, "reconnect_median_ms");
+    json_builder_add_double_value(b, median(H.reconnect_ms));
+    json_builder_set_member_name(b, "frames_during_drops");
+    json_builder_add_int_value(b, H.frames_during_drops);
+    json_builder_set_member_name(b, "soak_seconds");
+    json_builder_add_int_value(b, H.soak_seconds);
+    json_builder_set_member_name(b, "soak_fps");
+    json_builder_add_double_value(b, H.soak_fps);
+    json_builder_set_member_name(b, "soak_max_gap_ms");
+    json_builder_add_double_value(b, H.soak_max_gap_ms);
+    json_builder_set_member_name(b, "frames_total");
+    json_builder_add_int_value(b, H.frames.load());
+    json_builder_end_object(b);
+    return report_to_json(b);
+}
+
+int main(int argc, char **argv) {
+    gint soak = 10, drops = 3;
+    gdouble min_fps_ratio = 0.8, max_gap_ms = 1000;
+    gchar *output = nullptr;
+    GOptionEntry entries[] = {
+        { "soak", 's', 0, G_OPTION_ARG_INT, &soak, "Seconds of continuous reception to check", "S" },
+        { "drops", 'd', 0, G_OPTION_ARG_INT, &drops, "Forced signaling drops before the soak", "N" },
+        { "min-fps-ratio", 0, 0, G_OPTION_ARG_DOUBLE, &min_fps_ratio, "Required share of the source frame rate", "R" },
+        { "max-gap-ms", 0, 0, G_OPTION_ARG_DOUBLE, &max_gap_ms, "Longest allowed pause between frames", "MS" },
+        { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output, "Write JSON results to FILE", "FILE" },
+        { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
+    };
+    GOptionContext *ctx = g_option_context_new("- loopback end-to-end test");
+    g_option_context_add_main_entries(ctx, entries, NULL);
+    g_option_context_add_group(ctx, gst_init_get_option_group());
+    GError *error = nullptr;
+    if (!g_option_context_parse(ctx, &argc, &argv, &error)) {
+        fprintf(stderr, "loopback_e2e: %s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(ctx);
+        return 2;
+    }
+    g_option_context_free(ctx);
+
+    if (!have_elements()) return EXIT_SKIP;
+    if (!load_car_config()) {
+        fprintf(stderr, "loopback_e2e: invalid built-in config\n");
+        return 2;
+    }
+    log_set_level(log_level_from_string(config_get()->log.level));
+    log_start();
+
+    H.loop = g_main_loop_new(NULL, FALSE);
+    H.drops_wanted = (guint)MAX(drops, 0);
+    H.soak_seconds = (guint)MAX(soak, 1);
+    guint port = server_start();
+    if (!port) return 2;
+
+    // Та сама послідовність, що й у main()
+    gchar *port_str = g_strdup_printf("%u", port);
+    config_use_device(DEVICE_ID, "127.0.0.1", port_str);
+    const DeviceConfig *device = &config_get()->devices[0];
+    Vehicle *vehicle = vehicle_new(DEVICE_ID, &device->motors);
+    if (!vehicle || !lifecycle_start() || !motor_thread_start(&vehicle, 1)) return 2;
+    enter_phase(PHASE_CONNECT);
+    Device *car = start_webrtc(device, vehicle);
+    if (!car) return 2;
+    guint tick = g_timeout_add(100, scenario_tick, NULL);
+
+    g_main_loop_run(H.loop);
+
+    g_source_remove(tick);
+    cleanup_webrtc(car);
+    lifecycle_stop();
+    // Завершення задач, поставлені вже після виходу з циклу, інакше
+    // не виконаються і втримають свої посилання
+    while (g_main_context_iteration(NULL, FALSE));
+    motor_thread_stop();
+    vehicle_free(vehicle);
+    if (H.viewer) {
+        gst_element_set_state(H.viewer, GST_STATE_NULL);
+        gst_object_unref(H.viewer);
+    }
+    g_clear_object(&H.car);
+    soup_server_disconnect(H.server);
+    g_object_unref(H.server);
+
+    if (!H.failure && H.soak_fps < TEST_FRAMERATE * min_fps_ratio) H.failure = "soak frame rate below threshold";
+    if (!H.failure && H.soak_max_gap_ms > max_gap_ms) H.failure = "frame delivery stalled during soak";
+
+    gchar *json = render_json();
+    if (output) g_file_set_contents(output, json, -1, NULL);
+    printf("%s\n", json);
+    if (H.failure) fprintf(stderr, "loopback_e2e: FAILED: %s\n", H.failure);
+
+    g_free(json);
+    g_free(output);
+    g_free(port_str);
+    g_free(H.session);
+    g_main_loop_unref(H.loop);
+    log_stop();
+    config_free();
+    return H.failure ? 1 : 0;
+}
@@ -1,472 +1,1184 @@
 #include "webrtc_pipeline.h"
 #include "gpio_control.h"
-#include "pwm_control.h"
+#include "control_channel.h"
+#include "media_ingest.h"
+#include "config.h"
+#include "rate_control.h"
+#include "motor_thread.h"
+#include "metrics.h"
+#include "log.h"
+#include "signaling_codec.h"
+#include "lifecycle.h"
+#include "dashcam.h"
+#include "telemetry.h"
+#include "frame_timing.h"
+#include "loss_recovery.h"
 #include <gst/gst.h>
 #include <gst/webrtc/webrtc.h>
 #include <gst/sdp/sdp.h>
 #include <libsoup/soup.h>
 #include <libsoup/soup-websocket.h>
-#include <json-glib/json-glib.h>
 #include <cstdio>
 
-// --- Глобальні змінні ---
-static GMainLoop *gloop = nullptr;
+// Повідомлення без поля "peer" належать цьому глядачу (старі клієнти)
+#define DEFAULT_PEER_ID "default"
+
+struct Device;
+
+// --- Один глядач: власна гілка queue ! rtph264pay ! webrtcbin на tee ---
+// Сигнали webrtcbin приходять з його потоків, тому кожне замикання
+// тримає посилання на Peer, а всі зміни стану робить головний цикл.
+// Гілка чекає (started == false), доки ingest не перейде в PLAYING.
+struct Peer {
+    Device *dev;          // власне посилання
+    gchar *id;
+    GstElement *bin;
+    GstElement *webrtc;
+    bool attached;        // гілка під'єднана до tee ingest
+    SignalingCodec codec; // кодування повідомлень, узгоджене в ready
+    bool driver;          // лише водій може керувати машиною
+    bool started;         // гілку додано в pipeline і під'єднано до tee
+    bool offer_sent;
+    bool answer_received;
+    bool connected;
+    bool closed;          // гілку вже прибрано, відкладені колбеки ігноруються
+    // Відновлення після втрати зв'язку (ICE restart)
+    gint64 lost_us;       // момент втрати зв'язку, 0 — зв'язок є
+    bool restarting;      // offer з ice-restart надіслано, чекаємо answer
+    guint restart_timer;
+    guint deadline_timer;
+};
+
+// --- Один пристрій: з'єднання з сигналізацією, ingest і глядачі ---
+// Усі пристрої процесу ділять головний цикл, робочий потік lifecycle і
+// потік керування. Відкладені колбеки тримають посилання на Device, а
+// після cleanup_webrtc бачать closed і нічого не роблять.
+struct Device {
+    const DeviceConfig *cfg;
+    Vehicle *vehicle;                 // nullptr — пристрій без моторів
+    bool closed;
+    SoupWebsocketConnection *ws_conn;
+    GCancellable *connect_cancel;     // незавершене підключення WebSocket
+    GstElement *pipeline;
+    MediaIngest *ingest;
+    bool ingest_playing;              // pipeline уже в PLAYING, гілки можна під'єднувати
+    GHashTable *peers;                // id → Peer*
+    guint ingest_restart_timer_id;
+    guint reconnect_timer_id;
+    guint reconnect_attempt;          // невдалих спроб поспіль, для backoff
+    bool ws_connecting;
+    gchar *session_token;             // маркер сесії машини для відновлення після розриву
+    guint connection_check_timer_id;
+    MotorQueue *ws_queue;             // команди з WebSocket, пише лише головний цикл
+    GString *out_buf;                 // кадр, що збирає головний цикл; перевикористовується
+    RateControl *rate;
+    Telemetry *telemetry;
+    LossRecovery *recovery;
+    Dashcam *dashcam;
+};
+
+// HTTP-сесія спільна для всіх пристроїв: одне сховище з'єднань і
+// резолвер замість копії на кожен пристрій
 static SoupSession *session = nullptr;
-static SoupWebsocketConnection *ws_conn = nullptr;
-static GstElement *pipeline = nullptr, *webrtc = nullptr;
-static bool pipeline_started = false;
-static gchar *g_device_id = nullptr;
-static gchar *g_sig_ip = nullptr;
-static gchar *g_sig_port = nullptr;
-static guint reconnect_timer_id = 0;
-static guint connection_check_timer_id = 0;
-static bool offer_sent = false;
-static bool answer_received = false;
-static bool webrtc_connected = false;
+static guint session_users = 0;
 
 // --- Прототипи ---
-static void attempt_connection();
+static void attempt_connection(Device *dev);
 static void on_ws_connected(GObject *src, GAsyncResult *res, gpointer data);
-static void stop_and_cleanup_pipeline();
+static void stop_and_cleanup_pipeline(Device *dev);
+static void remove_peer(Peer *peer);
+static bool ensure_ingest(Device *dev);
+static void release_ingest(Device *dev);
+static void start_peer_branch(Peer *peer);
+static void start_ice_recovery(Peer *peer, bool failed);
+static void on_offer_created(GstPromise *p, gpointer user_data);
+
+// --- Облік посилань на Device і Peer ---
+static void device_clear(Device *dev) {
+    media_ingest_unref(dev->ingest);
+    g_free(dev->session_token);
+    g_string_free(dev->out_buf, TRUE);
+}
+
+static Device *device_ref(Device *dev) {
+    return (Device*)g_rc_box_acquire(dev);
+}
+
+static void device_unref(Device *dev) {
+    g_rc_box_release_full(dev, (GDestroyNotify)device_clear);
+}
+
+static void peer_clear(Peer *peer) {
+    // webrtcbin живе, доки живий Peer: відкладені колбеки можуть звертатися до нього
+    if (peer->webrtc) gst_object_unref(peer->webrtc);
+    device_unref(peer->dev);
+    g_free(peer->id);
+}
+
+static Peer *peer_ref(Peer *peer) {
+    return (Peer*)g_rc_box_acquire(peer);
+}
+
+static void peer_unref(Peer *peer) {
+    g_rc_box_release_full(peer, (GDestroyNotify)peer_clear);
+}
+
+static void peer_closure_notify(gpointer data, GClosure*) {
+    peer_unref((Peer*)data);
+}
+
+static void connect_peer_signal(GstElement *elem, const char *signal, GCallback cb, Peer *peer) {
+    g_signal_connect_data(elem, signal, cb, peer_ref(peer), peer_closure_notify, (GConnectFlags)0);
+}
+
+// Виконати обробник у головному циклі, утримуючи Peer живим
+static void invoke_for_peer(GSourceFunc func, Peer *peer) {
+    g_main_context_invoke_full(NULL, G_PRIORITY_DEFAULT, func, peer_ref(peer), (GDestroyNotify)peer_unref);
+}
+
+static Peer *lookup_peer(Device *dev, const gchar *peer_id) {
+    return (Peer*)g_hash_table_lookup(dev->peers, peer_id);
+}
+
+static bool has_driver(Device *dev) {
+    GHashTableIter it;
+    gpointer value;
+    g_hash_table_iter_init(&it, dev->peers);
+    while (g_hash_table_iter_next(&it, NULL, &value)) {
+        if (((Peer*)value)->driver) return true;
+    }
+    return false;
+}
+
+// Команди водія: повідомлення має належати водію. Без глядача взагалі —
+// старий клієнт без "peer"; невідомий peer при наявних глядачах — ні
+static bool from_driver(Device *dev, Peer *peer) {
+    return peer ? peer->driver : g_hash_table_size(dev->peers) == 0;
+}
 
 // --- Логіка перепідключення ---
+// Експоненційна затримка з випадковим розкидом: короткий збій сервера
+// коштує частки секунди, а тривалий не перетворюється на шквал спроб.
 static gboolean reconnect_cb(gpointer user_data) {
-    g_print("[RECONNECT] Timer fired. Attempting to reconnect...\n");
-    attempt_connection();
-    return G_SOURCE_CONTINUE;
+    Device *dev = (Device*)user_data;
+    dev->reconnect_timer_id = 0;
+    LOG_INFO("RECONNECT", "%s: timer fired. Attempting to reconnect...", dev->cfg->id);
+    attempt_connection(dev);
+    return G_SOURCE_REMOVE;
 }
 
-static void schedule_reconnection() {
-    if (reconnect_timer_id > 0) return;
-    g_print("[RECONNECT] Scheduling reconnection in 30 seconds...\n");
-    reconnect_timer_id = g_timeout_add_seconds(30, reconnect_cb, NULL);
+static void schedule_reconnection(Device *dev) {
+    if (dev->closed || dev->reconnect_timer_id > 0 || dev->ws_connecting) return;
+    const SignalingConfig &sc = config_get()->signaling;
+    guint64 delay = sc.reconnect_min_ms;
+    for (guint i = 0; i < dev->reconnect_attempt && delay < sc.reconnect_max_ms; i++) delay *= 2;
+    delay = MIN(delay, (guint64)sc.reconnect_max_ms);
+    // Рівномірно в [delay/2, delay]
+    guint ms = (guint)(delay / 2 + g_random_int_range(0, (gint32)(delay / 2) + 1));
+    dev->reconnect_attempt++;
+    LOG_INFO("RECONNECT", "%s: scheduling reconnection in %u ms (attempt %u)...",
+             dev->cfg->id, ms, dev->reconnect_attempt);
+    dev->reconnect_timer_id = g_timeout_add(ms, reconnect_cb, dev);
 }
 
-static void cancel_reconnection() {
-    if (reconnect_timer_id > 0) {
-        g_print("[RECONNECT] Connection successful. Cancelling reconnection timer.\n");
-        g_source_remove(reconnect_timer_id);
-        reconnect_timer_id = 0;
+static void cancel_reconnection(Device *dev) {
+    if (dev->reconnect_timer_id > 0) {
+        g_source_remove(dev->reconnect_timer_id);
+        dev->reconnect_timer_id = 0;
     }
 }
 
 // --- Нова функція для перевірки стану з'єднання ---
 static gboolean check_connection_state(gpointer user_data) {
-    if (!webrtc || !pipeline_started) {
+    Device *dev = (Device*)user_data;
+    GList *all = g_hash_table_get_values(dev->peers);
+    for (GList *l = all; l; l = l->next) {
+        Peer *peer = (Peer*)l->data;
+
+        // Перевіряємо стан WebRTC з'єднання
+        GstWebRTCPeerConnectionState conn_state;
+        g_object_get(peer->webrtc, "connection-state", &conn_state, NULL);
+
+        if (conn_state == GST_WEBRTC_PEER_CONNECTION_STATE_CLOSED) {
+            LOG_INFO("CONNECTION", "Peer %s connection state: %d. Removing peer.", peer->id, conn_state);
+            remove_peer(peer);
+        } else if (conn_state == GST_WEBRTC_PEER_CONNECTION_STATE_DISCONNECTED ||
+                   conn_state == GST_WEBRTC_PEER_CONNECTION_STATE_FAILED) {
+            // Прибере тайм-аут відновлення, якщо ICE restart не допоможе
+            start_ice_recovery(peer, conn_state == GST_WEBRTC_PEER_CONNECTION_STATE_FAILED);
+        }
+    }
+    g_list_free(all);
+
+    if (g_hash_table_size(dev->peers) > 0) {
         return G_SOURCE_CONTINUE;
     }
 
-    // Перевіряємо стан WebRTC з'єднання
-    GstWebRTCPeerConnectionState conn_state;
-    g_object_get(webrtc, "connection-state", &conn_state, NULL);
+    // Якщо WebSocket ще живий, спробуємо переподключитися
+    if (dev->ws_conn && soup_websocket_connection_get_state(dev->ws_conn) == SOUP_WEBSOCKET_STATE_OPEN) {
+        LOG_INFO("CONNECTION", "%s: WebSocket still alive, will restart pipeline on next ready signal.",
+                 dev->cfg->id);
+    } else {
+        schedule_reconnection(dev);
+    }
+    dev->connection_check_timer_id = 0;
+    return G_SOURCE_REMOVE;
+}
 
-    if (conn_state == GST_WEBRTC_PEER_CONNECTION_STATE_DISCONNECTED ||
-        conn_state == GST_WEBRTC_PEER_CONNECTION_STATE_FAILED ||
-        conn_state == GST_WEBRTC_PEER_CONNECTION_STATE_CLOSED) {
+static void start_connection_monitoring(Device *dev) {
+    if (dev->connection_check_timer_id > 0) return;
+    dev->connection_check_timer_id = g_timeout_add_seconds(5, check_connection_state, dev);
+}
 
-        g_print("[CONNECTION] WebRTC connection state: %d. Stopping pipeline.\n", conn_state);
-        webrtc_connected = false;
-        stop_and_cleanup_pipeline();
+static void stop_connection_monitoring(Device *dev) {
+    if (dev->connection_check_timer_id > 0) {
+        g_source_remove(dev->connection_check_timer_id);
+        dev->connection_check_timer_id = 0;
+    }
+}
 
-        // Якщо WebSocket ще живий, спробуємо переподключитися
-        if (ws_conn && soup_websocket_connection_get_state(ws_conn) == SOUP_WEBSOCKET_STATE_OPEN) {
-            g_print("[CONNECTION] WebSocket still alive, will restart pipeline on next ready signal.\n");
-        } else {
-            schedule_reconnection();
-        }
+// Зупинка машини пристрою; пристрій без моторів зупиняти нічого
+static void request_stop(Device *dev) {
+    if (dev->vehicle) motor_thread_request_stop(dev->vehicle);
+}
+
+// --- Основна логіка ---
+static void on_ws_message(SoupWebsocketConnection*, SoupWebsocketDataType type, GBytes *frame, gpointer user_data);
+
+static void drop_ws_conn(Device *dev);
+
+static void on_ws_closed(SoupWebsocketConnection*, gpointer user_data) {
+    Device *dev = (Device*)user_data;
+    // Медіа і data channel не залежать від WebSocket: глядачі лишаються,
+    // а після перепідключення їх можна відновити за маркером сесії
+    LOG_ERROR("CONNECTION", "%s: WebSocket disconnected, keeping %u peer(s)",
+              dev->cfg->id, g_hash_table_size(dev->peers));
+    drop_ws_conn(dev);
+    // Команди з WebSocket більше не прийдуть — не лишаємо машину їхати за останньою
+    request_stop(dev);
+    schedule_reconnection(dev);
+}
 
-        return G_SOURCE_REMOVE;
+static void drop_ws_conn(Device *dev) {
+    if (!dev->ws_conn) return;
+    g_signal_handlers_disconnect_by_func(dev->ws_conn, (void*)on_ws_closed, dev);
+    g_signal_handlers_disconnect_by_func(dev->ws_conn, (void*)on_ws_message, dev);
+    g_object_unref(dev->ws_conn);
+    dev->ws_conn = nullptr;
+}
+
+// Кадр для сокета пристрою, переданий у головний цикл
+struct OutgoingFrame {
+    Device *dev;
+    GBytes *frame;
+    SoupWebsocketDataType type;
+};
+
+static void free_outgoing(gpointer data) {
+    OutgoingFrame *out = (OutgoingFrame*)data;
+    device_unref(out->dev);
+    g_bytes_unref(out->frame);
+    g_free(out);
+}
+
+static gboolean send_frame_cb(gpointer data) {
+    OutgoingFrame *out = (OutgoingFrame*)data;
+    SoupWebsocketConnection *conn = out->dev->ws_conn;
+    if (conn && soup_websocket_connection_get_state(conn) == SOUP_WEBSOCKET_STATE_OPEN) {
+        soup_websocket_connection_send_message(conn, out->type, out->frame);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+// Головний цикл пише в буфер пристрою без виділень; потоки webrtcbin
+// (offer, кандидати — кілька на узгодження) збирають власний кадр
+static void begin_message(Device *dev, SignalingWriter *w, SignalingCodec codec) {
+    if (g_main_context_is_owner(NULL)) signaling_writer_begin_in(w, codec, dev->out_buf);
+    else signaling_writer_begin(w, codec);
+}
+
+static void send_message(Device *dev, SignalingWriter *w) {
+    if (w->buf == dev->out_buf) {
+        // soup копіює корисне навантаження у свій кадр, буфер вільний одразу
+        signaling_writer_end(w);
+        SoupWebsocketConnection *conn = dev->ws_conn;
+        if (!conn || soup_websocket_connection_get_state(conn) != SOUP_WEBSOCKET_STATE_OPEN) return;
+        if (w->codec == SIGNALING_CODEC_MSGPACK) soup_websocket_connection_send_binary(conn, w->buf->str, w->buf->len);
+        else soup_websocket_connection_send_text(conn, w->buf->str);
+        return;
     }
 
-    return G_SOURCE_CONTINUE;
+    OutgoingFrame *out = g_new(OutgoingFrame, 1);
+    out->dev = device_ref(dev);
+    out->type = w->codec == SIGNALING_CODEC_MSGPACK ? SOUP_WEBSOCKET_DATA_BINARY : SOUP_WEBSOCKET_DATA_TEXT;
+    out->frame = signaling_writer_finish(w);
+    // Викликається і з потоків webrtcbin; сокет обслуговує лише головний цикл
+    g_main_context_invoke_full(NULL, G_PRIORITY_DEFAULT, send_frame_cb, out, free_outgoing);
+}
+
+// Початок повідомлення, адресованого конкретному глядачу
+static void begin_peer_message(Device *dev, SignalingWriter *w, const gchar *peer_id, SignalingCodec codec) {
+    begin_message(dev, w, codec);
+    signaling_writer_string(w, "device", dev->cfg->id);
+    signaling_writer_string(w, "peer", peer_id);
 }
 
-static void start_connection_monitoring() {
-    if (connection_check_timer_id > 0) {
-        g_source_remove(connection_check_timer_id);
+// --- Відновлення зв'язку через ICE restart ---
+// webrtcbin і гілка живуть далі: новий offer з ice-restart змінює лише
+// ICE-облікові дані, тож кодер, DTLS-сесія і закешована GOP лишаються,
+// і відео повертається за кілька RTT замість повного ready/offer/answer.
+static void request_ice_restart(Peer *peer) {
+    // Поки первинний answer не прийшов, перезапускати нічого
+    if (peer->restarting || !peer->answer_received) return;
+    peer->restarting = true;
+    peer->answer_received = false;
+
+    LOG_INFO("WEBRTC", "Peer %s: offering ICE restart", peer->id);
+    metrics_inc(METRIC_ICE_RESTARTS);
+    GstStructure *options = gst_structure_new("offer-options", "ice-restart", G_TYPE_BOOLEAN, TRUE, NULL);
+    GstPromise *pr = gst_promise_new_with_change_func(on_offer_created, peer_ref(peer), (GDestroyNotify)peer_unref);
+    g_signal_emit_by_name(peer->webrtc, "create-offer", options, pr);
+    gst_structure_free(options);
+}
+
+static gboolean ice_restart_timer_cb(gpointer data) {
+    Peer *peer = (Peer*)data;
+    peer->restart_timer = 0;
+    if (!peer->closed && peer->lost_us) request_ice_restart(peer);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean ice_deadline_expired(gpointer data) {
+    Peer *peer = (Peer*)data;
+    peer->deadline_timer = 0;
+    if (!peer->closed && peer->lost_us) {
+        LOG_INFO("WEBRTC", "Peer %s did not recover in %u ms, removing",
+                 peer->id, config_get()->webrtc.ice_restart_timeout_ms);
+        metrics_inc(METRIC_PEERS_LOST);
+        remove_peer(peer);
     }
-    connection_check_timer_id = g_timeout_add_seconds(5, check_connection_state, NULL);
+    return G_SOURCE_REMOVE;
 }
 
-static void stop_connection_monitoring() {
-    if (connection_check_timer_id > 0) {
-        g_source_remove(connection_check_timer_id);
-        connection_check_timer_id = 0;
+static void cancel_ice_recovery(Peer *peer) {
+    if (peer->restart_timer) {
+        g_source_remove(peer->restart_timer);
+        peer->restart_timer = 0;
+    }
+    if (peer->deadline_timer) {
+        g_source_remove(peer->deadline_timer);
+        peer->deadline_timer = 0;
     }
 }
 
-// --- Основна логіка ---
-static void on_ws_closed(SoupWebsocketConnection *conn, gpointer user_data) {
-    g_printerr("[CONNECTION] WebSocket disconnected. Stopping stream.\n");
-    if (ws_conn) {
-        g_signal_handlers_disconnect_by_func(ws_conn, (void*)on_ws_closed, user_data);
-        g_object_unref(ws_conn);
-        ws_conn = nullptr;
+// failed — ICE уже здався, чекати самостійного відновлення марно
+static void start_ice_recovery(Peer *peer, bool failed) {
+    const WebRTCConfig &wc = config_get()->webrtc;
+    peer->connected = false;
+    if (!peer->lost_us) {
+        peer->lost_us = g_get_monotonic_time();
+        peer->deadline_timer = g_timeout_add_full(G_PRIORITY_DEFAULT, wc.ice_restart_timeout_ms,
+                                                  ice_deadline_expired, peer_ref(peer), (GDestroyNotify)peer_unref);
+    }
+    if (!wc.ice_restart) return;
+
+    if (failed) {
+        if (peer->restart_timer) {
+            g_source_remove(peer->restart_timer);
+            peer->restart_timer = 0;
+        }
+        request_ice_restart(peer);
+    } else if (!peer->restart_timer && !peer->restarting) {
+        peer->restart_timer = g_timeout_add_full(G_PRIORITY_DEFAULT, wc.ice_restart_delay_ms,
+                                                 ice_restart_timer_cb, peer_ref(peer), (GDestroyNotify)peer_unref);
     }
-    webrtc_connected = false;
-    stop_and_cleanup_pipeline();
-    stop_connection_monitoring();
-    schedule_reconnection();
 }
 
-static void send_json(JsonBuilder *b) {
-    if (!ws_conn || soup_websocket_connection_get_state(ws_conn) != SOUP_WEBSOCKET_STATE_OPEN) return;
-    JsonGenerator *gen = json_generator_new();
-    json_generator_set_root(gen, json_builder_get_root(b));
-    gchar *text = json_generator_to_data(gen, NULL);
-    soup_websocket_connection_send_text(ws_conn, text);
-    g_free(text);
-    g_object_unref(gen);
+static void finish_ice_recovery(Peer *peer) {
+    peer->connected = true;
+    if (!peer->lost_us) return;
+    gint64 elapsed = g_get_monotonic_time() - peer->lost_us;
+    metrics_observe(METRIC_ICE_RECOVERY, elapsed);
+    LOG_INFO("WEBRTC", "Peer %s recovered in %lld ms", peer->id, (long long)(elapsed / 1000));
+    peer->lost_us = 0;
+    cancel_ice_recovery(peer);
 }
 
 // --- Обробники стану WebRTC з'єднання ---
-static void on_connection_state_change(GstElement *webrtc_elem, GParamSpec *pspec, gpointer user_data) {
+static gboolean handle_connection_state(gpointer data) {
+    Peer *peer = (Peer*)data;
+    if (peer->closed) return G_SOURCE_REMOVE;
+
     GstWebRTCPeerConnectionState state;
-    g_object_get(webrtc_elem, "connection-state", &state, NULL);
+    g_object_get(peer->webrtc, "connection-state", &state, NULL);
 
-    g_print("[WEBRTC] Connection state changed to: %d\n", state);
+    LOG_INFO("WEBRTC", "Peer %s connection state changed to: %d", peer->id, state);
 
     switch (state) {
         case GST_WEBRTC_PEER_CONNECTION_STATE_CONNECTED:
-            g_print("[WEBRTC] Peer connected successfully\n");
-            webrtc_connected = true;
-            start_connection_monitoring();
+            LOG_INFO("WEBRTC", "Peer %s connected successfully", peer->id);
+            finish_ice_recovery(peer);
+            start_connection_monitoring(peer->dev);
             break;
         case GST_WEBRTC_PEER_CONNECTION_STATE_DISCONNECTED:
         case GST_WEBRTC_PEER_CONNECTION_STATE_FAILED:
+            LOG_INFO("WEBRTC", "Peer %s lost connectivity (state: %d)", peer->id, state);
+            start_ice_recovery(peer, state == GST_WEBRTC_PEER_CONNECTION_STATE_FAILED);
+            break;
         case GST_WEBRTC_PEER_CONNECTION_STATE_CLOSED:
-            g_print("[WEBRTC] Peer disconnected (state: %d)\n", state);
-            webrtc_connected = false;
-            stop_and_cleanup_pipeline();
+            LOG_INFO("WEBRTC", "Peer %s closed", peer->id);
+            peer->connected = false;
+            remove_peer(peer);
             break;
         default:
             break;
     }
+    return G_SOURCE_REMOVE;
+}
+
+static void on_connection_state_change(GstElement*, GParamSpec*, gpointer user_data) {
+    invoke_for_peer(handle_connection_state, (Peer*)user_data);
 }
 
-static void on_ice_connection_state_change(GstElement *webrtc_elem, GParamSpec *pspec, gpointer user_data) {
+static gboolean handle_ice_connection_state(gpointer data) {
+    Peer *peer = (Peer*)data;
+    if (peer->closed) return G_SOURCE_REMOVE;
+
     GstWebRTCICEConnectionState state;
-    g_object_get(webrtc_elem, "ice-connection-state", &state, NULL);
-
-    g_print("[WEBRTC] ICE connection state changed to: %d\n", state);
-
-    if (state == GST_WEBRTC_ICE_CONNECTION_STATE_DISCONNECTED ||
-        state == GST_WEBRTC_ICE_CONNECTION_STATE_FAILED ||
-        state == GST_WEBRTC_ICE_CONNECTION_STATE_CLOSED) {
-        g_print("[WEBRTC] ICE connection lost\n");
-        webrtc_connected = false;
-        // Даємо трохи часу для відновлення перед зупинкою
-        g_timeout_add_seconds(3, [](gpointer data) -> gboolean {
-            if (!webrtc_connected) {
-                stop_and_cleanup_pipeline();
-            }
-            return G_SOURCE_REMOVE;
-        }, NULL);
-    }
-}
-
-static void on_negotiation_needed(GstElement *webrtc_elem, gpointer) {
-    if (offer_sent) return;
-    offer_sent = true;
-    GstPromise *pr = gst_promise_new_with_change_func(
-      +[](GstPromise *p, gpointer user_data){
-        GstElement *webrtc = GST_ELEMENT(user_data);
-        GstWebRTCSessionDescription *offer = nullptr;
-        gst_structure_get(gst_promise_get_reply(p), "offer", GST_TYPE_WEBRTC_SESSION_DESCRIPTION, &offer, NULL);
-        gst_promise_unref(p);
-        GstPromise *lp = gst_promise_new();
-        g_signal_emit_by_name(webrtc, "set-local-description", offer, lp);
-        gst_promise_unref(lp);
-        JsonBuilder *b = json_builder_new();
-        json_builder_begin_object(b);
-        json_builder_set_member_name(b, "device");
-        json_builder_add_string_value(b, g_device_id);
-        json_builder_set_member_name(b, "sdp");
-        gchar *s = gst_sdp_message_as_text(offer->sdp);
-        json_builder_add_string_value(b, s);
-        g_free(s);
-        json_builder_set_member_name(b, "type");
-        json_builder_add_string_value(b, gst_webrtc_sdp_type_to_string(offer->type));
-        json_builder_end_object(b);
-        send_json(b);
-        g_object_unref(b);
-        gst_webrtc_session_description_free(offer);
-      }, webrtc_elem, nullptr);
+    g_object_get(peer->webrtc, "ice-connection-state", &state, NULL);
+
+    LOG_INFO("WEBRTC", "Peer %s ICE connection state changed to: %d", peer->id, state);
+
+    switch (state) {
+        case GST_WEBRTC_ICE_CONNECTION_STATE_CONNECTED:
+        case GST_WEBRTC_ICE_CONNECTION_STATE_COMPLETED:
+            finish_ice_recovery(peer);
+            break;
+        case GST_WEBRTC_ICE_CONNECTION_STATE_DISCONNECTED:
+        case GST_WEBRTC_ICE_CONNECTION_STATE_FAILED:
+            LOG_INFO("WEBRTC", "Peer %s ICE connection lost", peer->id);
+            start_ice_recovery(peer, state == GST_WEBRTC_ICE_CONNECTION_STATE_FAILED);
+            break;
+        case GST_WEBRTC_ICE_CONNECTION_STATE_CLOSED:
+            remove_peer(peer);
+            break;
+        default:
+            break;
+    }
+    return G_SOURCE_REMOVE;
+}
+
+static void on_ice_connection_state_change(GstElement*, GParamSpec*, gpointer user_data) {
+    invoke_for_peer(handle_ice_connection_state, (Peer*)user_data);
+}
+
+static void on_offer_created(GstPromise *p, gpointer user_data) {
+    Peer *peer = (Peer*)user_data;
+    GstWebRTCSessionDescription *offer = nullptr;
+    gst_structure_get(gst_promise_get_reply(p), "offer", GST_TYPE_WEBRTC_SESSION_DESCRIPTION, &offer, NULL);
+    gst_promise_unref(p);
+    if (!offer || peer->closed) {
+        if (offer) gst_webrtc_session_description_free(offer);
+        return;
+    }
+
+    GstPromise *lp = gst_promise_new();
+    g_signal_emit_by_name(peer->webrtc, "set-local-description", offer, lp);
+    gst_promise_unref(lp);
+
+    SignalingWriter w;
+    begin_peer_message(peer->dev, &w, peer->id, peer->codec);
+    gchar *s = gst_sdp_message_as_text(offer->sdp);
+    signaling_writer_string(&w, "sdp", s);
+    g_free(s);
+    signaling_writer_string(&w, "type", gst_webrtc_sdp_type_to_string(offer->type));
+    send_message(peer->dev, &w);
+    gst_webrtc_session_description_free(offer);
+}
+
+static void on_negotiation_needed(GstElement *webrtc_elem, gpointer user_data) {
+    Peer *peer = (Peer*)user_data;
+    if (peer->offer_sent) return;
+    peer->offer_sent = true;
+    GstPromise *pr = gst_promise_new_with_change_func(on_offer_created, peer_ref(peer), (GDestroyNotify)peer_unref);
     g_signal_emit_by_name(webrtc_elem, "create-offer", NULL, pr);
 }
 
-static void on_ice_candidate(GstElement*, guint mline, gchar *cand, gpointer){
+static void on_ice_candidate(GstElement*, guint mline, gchar *cand, gpointer user_data) {
     if (!cand) return;
-    JsonBuilder *b = json_builder_new();
-    json_builder_begin_object(b);
-      json_builder_set_member_name(b, "device");
-      json_builder_add_string_value(b, g_device_id);
-      json_builder_set_member_name(b, "candidate");
-      json_builder_add_string_value(b, cand);
-      json_builder_set_member_name(b, "sdpMLineIndex");
-      json_builder_add_int_value(b, mline);
-    json_builder_end_object(b);
-    send_json(b);
-    g_object_unref(b);
-}
-
-static void on_bus_error(GstBus*, GstMessage *msg, gpointer) {
+    Peer *peer = (Peer*)user_data;
+    SignalingWriter w;
+    begin_peer_message(peer->dev, &w, peer->id, peer->codec);
+    signaling_writer_string(&w, "candidate", cand);
+    signaling_writer_int(&w, "sdpMLineIndex", mline);
+    send_message(peer->dev, &w);
+}
+
+static gboolean restart_ingest_cb(gpointer user_data) {
+    Device *dev = (Device*)user_data;
+    dev->ingest_restart_timer_id = 0;
+    ensure_ingest(dev);
+    return G_SOURCE_REMOVE;
+}
+
+// При помилці ingest зупиняємо всіх глядачів і сам pipeline
+static void on_ingest_failed(Device *dev) {
+    stop_and_cleanup_pipeline(dev);
+    release_ingest(dev);
+    if (dev->cfg->media.hot_standby && !dev->closed && dev->ingest_restart_timer_id == 0) {
+        LOG_INFO("PIPELINE", "%s: restarting ingest in 1 second...", dev->cfg->id);
+        dev->ingest_restart_timer_id = g_timeout_add_seconds(1, restart_ingest_cb, dev);
+    }
+}
+
+static Peer *find_peer_by_object(Device *dev, GstObject *obj) {
+    GHashTableIter it;
+    gpointer value;
+    g_hash_table_iter_init(&it, dev->peers);
+    while (g_hash_table_iter_next(&it, NULL, &value)) {
+        Peer *peer = (Peer*)value;
+        if (gst_object_has_as_ancestor(obj, GST_OBJECT(peer->bin))) return peer;
+    }
+    return nullptr;
+}
+
+static void on_bus_error(GstBus*, GstMessage *msg, gpointer user_data) {
+    Device *dev = (Device*)user_data;
     GError *e; gchar *dbg;
     gst_message_parse_error(msg, &e, &dbg);
-    g_printerr("[ERROR] %s: %s\nDebug: %s\n", GST_OBJECT_NAME(msg->src), e->message, dbg);
+    LOG_ERROR("PIPELINE", "%s: %s (debug: %s)", GST_OBJECT_NAME(msg->src), e->message, dbg);
     g_error_free(e);
     g_free(dbg);
 
-    // При помилці зупиняємо pipeline
-    stop_and_cleanup_pipeline();
+    // Помилка у гілці глядача зачіпає лише цього глядача
+    Peer *peer = find_peer_by_object(dev, GST_MESSAGE_SRC(msg));
+    if (peer) {
+        remove_peer(peer);
+        return;
+    }
+
+    on_ingest_failed(dev);
 }
 
 static void on_bus_warning(GstBus*, GstMessage *msg, gpointer) {
     GError *e; gchar *dbg;
     gst_message_parse_warning(msg, &e, &dbg);
-    g_printerr("[WARNING] %s: %s\nDebug: %s\n", GST_OBJECT_NAME(msg->src), e->message, dbg);
+    LOG_WARN("PIPELINE", "%s: %s (debug: %s)", GST_OBJECT_NAME(msg->src), e->message, dbg);
     g_error_free(e);
     g_free(dbg);
 }
 
-static void on_bus_state_changed(GstBus*, GstMessage *msg, gpointer) {
-    if (GST_MESSAGE_SRC(msg) == GST_OBJECT(pipeline)) {
+static void on_bus_state_changed(GstBus*, GstMessage *msg, gpointer user_data) {
+    Device *dev = (Device*)user_data;
+    if (GST_MESSAGE_SRC(msg) == GST_OBJECT(dev->pipeline)) {
         GstState old_state, new_state, pending_state;
         gst_message_parse_state_changed(msg, &old_state, &new_state, &pending_state);
-        g_print("[LOG] Pipeline state changed from %s to %s\n",
-                gst_element_state_get_name(old_state),
-                gst_element_state_get_name(new_state));
+        LOG_INFO("PIPELINE", "%s: pipeline state changed from %s to %s", dev->cfg->id,
+                 gst_element_state_get_name(old_state),
+                 gst_element_state_get_name(new_state));
     }
 }
 
-// ✅ --- ВИПРАВЛЕНА ФУНКЦІЯ ЗУПИНКИ --- ✅
-static void stop_and_cleanup_pipeline() {
-    if (!pipeline_started) return;
+// --- Ingest: джерело → h264parse → tee, живе довше за сесію в режимі hot standby ---
+// Запуск і зупинку виконує робочий потік lifecycle; головний цикл лише
+// ставить задачі і під'єднує гілки, коли pipeline уже грає.
+struct IngestStart {
+    Device *dev;                      // власне посилання
+    GstElement *pipeline;
+    gint64 start_us;
+    bool ok;
+};
+
+static void ingest_play_task(gpointer data) {
+    IngestStart *task = (IngestStart*)data;
+    task->ok = media_ingest_play(task->pipeline);
+}
 
-    g_print("[PIPELINE] Stopping GStreamer pipeline...\n");
+static void ingest_play_done(gpointer data) {
+    IngestStart *task = (IngestStart*)data;
+    Device *dev = task->dev;
+    // Поки pipeline запускався, його могли відпустити — тоді результат застарів
+    if (task->pipeline == dev->pipeline) {
+        if (task->ok) {
+            metrics_observe(METRIC_INGEST_START, g_get_monotonic_time() - task->start_us);
+            dev->ingest_playing = true;
+            dashcam_start(dev->dashcam, dev->pipeline);
+            // Невдалий старт гілки прибирає її з таблиці, тож тримаємо посилання
+            GList *all = g_hash_table_get_values(dev->peers);
+            g_list_foreach(all, (GFunc)peer_ref, NULL);
+            for (GList *l = all; l; l = l->next) {
+                Peer *peer = (Peer*)l->data;
+                if (dev->ingest_playing && !peer->started && !peer->closed) start_peer_branch(peer);
+            }
+            g_list_free_full(all, (GDestroyNotify)peer_unref);
+        } else {
+            on_ingest_failed(dev);
+        }
+    }
+    gst_object_unref(task->pipeline);
+    device_unref(dev);
+    g_free(task);
+}
 
-    // Зупиняємо моніторинг з'єднання
-    stop_connection_monitoring();
+static bool ensure_ingest(Device *dev) {
+    if (dev->pipeline) return true;
 
-    if (pipeline) {
-        // Спочатку переводимо в стан READY, потім в NULL
-        GstStateChangeReturn ret = gst_element_set_state(pipeline, GST_STATE_READY);
-        if (ret == GST_STATE_CHANGE_ASYNC) {
-            // Чекаємо завершення зміни стану
-            gst_element_get_state(pipeline, NULL, NULL, GST_CLOCK_TIME_NONE);
-        }
+    dev->pipeline = media_ingest_create(dev->ingest);
+    if (!dev->pipeline) return false;
+    dev->ingest_playing = false;
 
-        // Тепер переводимо в NULL
-        gst_element_set_state(pipeline, GST_STATE_NULL);
-        ret = gst_element_get_state(pipeline, NULL, NULL, 5 * GST_SECOND);
+    GstBus *bus = gst_element_get_bus(dev->pipeline);
+    gst_bus_add_signal_watch(bus);
+    g_signal_connect(bus, "message::error", G_CALLBACK(on_bus_error), dev);
+    g_signal_connect(bus, "message::warning", G_CALLBACK(on_bus_warning), dev);
+    g_signal_connect(bus, "message::state-changed", G_CALLBACK(on_bus_state_changed), dev);
+    gst_object_unref(bus);
 
-        if (ret == GST_STATE_CHANGE_SUCCESS) {
-            g_print("[PIPELINE] Pipeline stopped successfully\n");
-        } else {
-            g_print("[PIPELINE] Pipeline stop timeout or failure\n");
-        }
+    IngestStart *task = g_new0(IngestStart, 1);
+    task->dev = device_ref(dev);
+    task->pipeline = (GstElement*)gst_object_ref(dev->pipeline);
+    task->start_us = g_get_monotonic_time();
+    lifecycle_submit(ingest_play_task, ingest_play_done, task);
+    return true;
+}
+
+static void release_ingest(Device *dev) {
+    if (!dev->pipeline) return;
+
+    dashcam_stop(dev->dashcam, dev->pipeline);
+
+    GstBus *bus = gst_element_get_bus(dev->pipeline);
+    g_signal_handlers_disconnect_by_data(bus, dev);
+    gst_bus_remove_signal_watch(bus);
+    gst_object_unref(bus);
+
+    dev->pipeline = nullptr;
+    dev->ingest_playing = false;
+    lifecycle_dispose(media_ingest_release(dev->ingest), METRIC_INGEST_STOP);
+}
+
+// ✅ --- ЗУПИНКА ОДНОГО ГЛЯДАЧА --- ✅
+// Головний цикл лише від'єднує гілку; перехід у NULL, що чекає на
+// потоки webrtcbin, виконується в робочому потоці lifecycle.
+static void remove_peer(Peer *peer) {
+    if (peer->closed) return;
+    peer->closed = true;
+    Device *dev = peer->dev;
+
+    LOG_INFO("PIPELINE", "%s: removing peer %s...", dev->cfg->id, peer->id);
+
+    if (peer->driver) {
+        // Водій пішов — машина не повинна їхати далі без керування
+        request_stop(dev);
+    }
+
+    cancel_ice_recovery(peer);
+
+    // Відключаємо сигнали перед видаленням
+    g_signal_handlers_disconnect_by_data(peer->webrtc, peer);
+    rate_control_remove_peer(dev->rate, peer->id);
+    telemetry_detach(dev->telemetry, peer->id);
+    loss_recovery_detach(dev->recovery, peer->id);
+
+    // Спершу від'єднуємо гілку від tee, щоб ingest не писав у неї під час зупинки
+    if (peer->attached) {
+        media_ingest_detach(peer->bin);
+        peer->attached = false;
+    }
+
+    GstElement *bin = peer->bin;
+    peer->bin = nullptr;
+    if (peer->started) {
+        gst_object_ref(bin);
+        gst_bin_remove(GST_BIN(dev->pipeline), bin);
+    } else {
+        gst_object_ref_sink(bin);
+    }
+    lifecycle_dispose(bin, METRIC_PEER_STOP);
+
+    g_hash_table_remove(dev->peers, peer->id);
 
-        // Відключаємо сигнали перед видаленням
-        if (webrtc) {
-            g_signal_handlers_disconnect_by_func(webrtc, (void*)on_negotiation_needed, webrtc);
-            g_signal_handlers_disconnect_by_func(webrtc, (void*)on_ice_candidate, NULL);
-            g_signal_handlers_disconnect_by_func(webrtc, (void*)on_connection_state_change, NULL);
-            g_signal_handlers_disconnect_by_func(webrtc, (void*)on_ice_connection_state_change, NULL);
+    if (g_hash_table_size(dev->peers) == 0) {
+        stop_connection_monitoring(dev);
+        // Без hot standby ingest живе рівно стільки, скільки сесії
+        if (!dev->cfg->media.hot_standby) {
+            release_ingest(dev);
         }
+    }
+
+    LOG_INFO("PIPELINE", "%s: peer cleanup completed, %u peer(s) left", dev->cfg->id, g_hash_table_size(dev->peers));
+}
 
-        g_object_unref(pipeline);
-        pipeline = nullptr;
+// Зупиняє всіх глядачів
+static void stop_and_cleanup_pipeline(Device *dev) {
+    GList *all = g_hash_table_get_values(dev->peers);
+    for (GList *l = all; l; l = l->next) {
+        remove_peer((Peer*)l->data);
     }
-    webrtc = nullptr;
+    g_list_free(all);
+}
 
-    // Скидаємо прапори для наступного з'єднання
-    pipeline_started = false;
-    offer_sent = false;
-    answer_received = false;
-    webrtc_connected = false;
+// Додає гілку в pipeline і під'єднує до tee; лише коли ingest уже грає
+static void start_peer_branch(Peer *peer) {
+    Device *dev = peer->dev;
+    gint64 start = g_get_monotonic_time();
+    peer->started = true;
+    gst_bin_add(GST_BIN(dev->pipeline), peer->bin);
+
+    // Data channel можна створити лише після переходу webrtcbin у READY
+    gst_element_set_state(peer->bin, GST_STATE_READY);
+    if (peer->driver && dev->vehicle) {
+        control_channel_attach(peer->webrtc, dev->vehicle);
+    }
+    telemetry_attach(dev->telemetry, peer->id, peer->webrtc);
 
-    g_print("[PIPELINE] Pipeline cleanup completed\n");
+    LOG_INFO("PIPELINE", "Starting peer branch...");
+    if (!gst_element_sync_state_with_parent(peer->bin)) {
+        LOG_ERROR("PIPELINE", "Failed to start peer branch");
+        remove_peer(peer);
+        return;
+    }
+
+    // Під'єднуємо до tee вже запущену гілку: першим піде закешований IDR.
+    // Камера кодується один раз, скільки б глядачів не було.
+    peer->attached = media_ingest_attach(dev->ingest, peer->bin);
+    if (!peer->attached) {
+        remove_peer(peer);
+        return;
+    }
+    metrics_observe(METRIC_PEER_START, g_get_monotonic_time() - start);
+
+    LOG_INFO("PIPELINE", "%s: peer %s started successfully, %u peer(s) total",
+             dev->cfg->id, peer->id, g_hash_table_size(dev->peers));
 }
 
-static void start_pipeline() {
-    if (pipeline_started) return;
+static void create_peer(Device *dev, const gchar *peer_id, bool driver, SignalingCodec codec,
+                        const gchar *recovery) {
     GError *error = NULL;
 
-    g_print("[PIPELINE] Starting new pipeline...\n");
+    LOG_INFO("PIPELINE", "%s: starting session for peer %s (%s)...",
+             dev->cfg->id, peer_id, driver ? "driver" : "observer");
 
-    gchar *pipeline_str = g_strdup_printf(
-        "udpsrc port=5001 caps=\"application/x-rtp, media=(string)video, clock-rate=(int)90000, encoding-name=(string)H264\" ! "
-        "rtph264depay ! h264parse ! rtph264pay config-interval=1 ! "
-        "webrtcbin name=webrtc stun-server=stun://stun.l.google.com:19302"
-    );
+    if (!ensure_ingest(dev)) {
+        LOG_ERROR("PIPELINE", "Ingest pipeline is not available");
+        return;
+    }
 
-    g_print("[LOG] Using final UDP-loopback pipeline: %s\n", pipeline_str);
-    pipeline = gst_parse_launch(pipeline_str, &error);
-    g_free(pipeline_str);
+    const MediaConfig &mc = dev->cfg->media;
+    gchar *queue = media_ingest_branch_queue_description(dev->ingest);
+    gchar *branch_str = g_strdup_printf(
+        "%s ! rtph264pay name=pay config-interval=-1 ! "
+        "webrtcbin name=webrtc%s%s",
+        queue, mc.stun_server[0] ? " stun-server=" : "", mc.stun_server);
+    g_free(queue);
 
-    if (!pipeline || error) {
-        g_printerr("[ERROR] Failed to create GStreamer pipeline: %s\n", error ? error->message : "Unknown error");
+    LOG_INFO("PIPELINE", "Using peer branch: %s", branch_str);
+    GstElement *bin = gst_parse_bin_from_description(branch_str, TRUE, &error);
+    g_free(branch_str);
+
+    if (!bin || error) {
+        LOG_ERROR("PIPELINE", "Failed to create peer branch: %s", error ? error->message : "Unknown error");
         if (error) g_error_free(error);
+        if (bin) gst_object_unref(bin);
         return;
     }
 
-    GstBus *bus = gst_element_get_bus(pipeline);
-    gst_bus_add_signal_watch(bus);
-    g_signal_connect(bus, "message::error", G_CALLBACK(on_bus_error), NULL);
-    g_signal_connect(bus, "message::warning", G_CALLBACK(on_bus_warning), NULL);
-    g_signal_connect(bus, "message::state-changed", G_CALLBACK(on_bus_state_changed), NULL);
-    gst_object_unref(bus);
+    Peer *peer = g_rc_box_new0(Peer);
+    peer->dev = device_ref(dev);
+    peer->id = g_strdup(peer_id);
+    peer->driver = driver;
+    peer->codec = codec;
+    peer->bin = bin;
+    peer->webrtc = gst_bin_get_by_name(GST_BIN(bin), "webrtc");
+    g_hash_table_insert(dev->peers, peer->id, peer);
 
-    webrtc = gst_bin_get_by_name(GST_BIN(pipeline), "webrtc");
-    g_signal_connect(webrtc, "on-negotiation-needed", G_CALLBACK(on_negotiation_needed), webrtc);
-    g_signal_connect(webrtc, "on-ice-candidate", G_CALLBACK(on_ice_candidate), NULL);
+    connect_peer_signal(peer->webrtc, "on-negotiation-needed", G_CALLBACK(on_negotiation_needed), peer);
+    connect_peer_signal(peer->webrtc, "on-ice-candidate", G_CALLBACK(on_ice_candidate), peer);
 
     // ✅ ДОДАЄМО МОНІТОРИНГ СТАНУ WEBRTC З'ЄДНАННЯ
-    g_signal_connect(webrtc, "notify::connection-state", G_CALLBACK(on_connection_state_change), NULL);
-    g_signal_connect(webrtc, "notify::ice-connection-state", G_CALLBACK(on_ice_connection_state_change), NULL);
+    connect_peer_signal(peer->webrtc, "notify::connection-state", G_CALLBACK(on_connection_state_change), peer);
+    connect_peer_signal(peer->webrtc, "notify::ice-connection-state", G_CALLBACK(on_ice_connection_state_change), peer);
+
+    // Регулятору потрібні request-aux-sender і TWCC на payloader до узгодження,
+    // так само й розширенню abs-capture-time і RTX/FEC на трансивері
+    GstElement *pay = gst_bin_get_by_name(GST_BIN(bin), "pay");
+    rate_control_add_peer(dev->rate, peer->id, bin, peer->webrtc, pay);
+    frame_timing_attach_branch(bin, pay, mc.capture_timestamps);
+    gst_object_unref(pay);
+    loss_recovery_attach(dev->recovery, peer->id, bin, peer->webrtc, recovery);
+
+    // Поки ingest запускається, гілка чекає; її під'єднає ingest_play_done
+    if (dev->ingest_playing) {
+        start_peer_branch(peer);
+    } else {
+        LOG_INFO("PIPELINE", "Peer %s waits for ingest to start", peer_id);
+    }
+}
+
+// Глядач повернувся після розриву WebSocket і його сесія ще жива:
+// лишаємо webrtcbin як є, без нового offer і без очікування IDR
+static void resume_peer(Peer *peer, SignalingCodec codec) {
+    LOG_INFO("PIPELINE", "Peer %s resumed its session", peer->id);
+    peer->codec = codec;
+
+    SignalingWriter w;
+    begin_peer_message(peer->dev, &w, peer->id, codec);
+    signaling_writer_string(&w, "action", "resumed");
+    send_message(peer->dev, &w);
+
+    // Offer з ice-restart міг загубитися разом із WebSocket
+    if (peer->restarting) {
+        peer->restarting = false;
+        peer->answer_received = true;
+        request_ice_restart(peer);
+    }
+}
 
-    g_print("[LOG] Starting GStreamer pipeline...\n");
-    GstStateChangeReturn ret = gst_element_set_state(pipeline, GST_STATE_PLAYING);
+static void on_peer_ready(Device *dev, const gchar *peer_id, const gchar *role, guint codecs,
+                          const gchar *session, const gchar *recovery) {
+    SignalingCodec codec = signaling_codec_pick(codecs);
 
-    if (ret == GST_STATE_CHANGE_FAILURE) {
-        g_printerr("[ERROR] Failed to start pipeline\n");
-        stop_and_cleanup_pipeline();
+    Peer *existing = lookup_peer(dev, peer_id);
+    if (existing && (existing->answer_received || existing->restarting) &&
+        !g_strcmp0(session, dev->session_token)) {
+        resume_peer(existing, codec);
         return;
     }
 
-    pipeline_started = true;
-    g_print("[PIPELINE] Pipeline started successfully\n");
-}
+    // Повторний ready від того ж глядача без маркера — перезапускаємо лише його
+    if (existing) {
+        LOG_INFO("PIPELINE", "Restarting session for peer %s", peer_id);
+        remove_peer(existing);
+    }
 
-static void on_ws_message(SoupWebsocketConnection*, SoupWebsocketDataType, GBytes *msg, gpointer) {
-    gsize size;
-    const gchar *data = (const gchar*)g_bytes_get_data(msg, &size);
-    JsonParser *parser = json_parser_new();
-    GError *error = nullptr;
-    if (!json_parser_load_from_data(parser, data, size, &error)) { g_object_unref(parser); return; }
-    JsonNode *root = json_parser_get_root(parser);
-    if (!JSON_NODE_HOLDS_OBJECT(root)) { g_object_unref(parser); return; }
-    JsonObject *obj = json_node_get_object(root);
-
-    if (json_object_has_member(obj, "device") && g_strcmp0(json_object_get_string_member(obj, "device"), g_device_id) != 0) {
-        g_object_unref(parser);
+    guint max_peers = config_get()->webrtc.max_peers;
+    if (max_peers <= 1) {
+        // Одиночний режим: новий глядач витісняє попереднього
+        if (g_hash_table_size(dev->peers) > 0) {
+            LOG_INFO("PIPELINE", "Stopping existing pipeline before starting new one");
+            stop_and_cleanup_pipeline(dev);
+        }
+    } else if (g_hash_table_size(dev->peers) >= max_peers) {
+        LOG_INFO("PIPELINE", "Rejecting peer %s: %u peers already connected", peer_id, max_peers);
+        SignalingWriter w;
+        begin_peer_message(dev, &w, peer_id, codec);
+        signaling_writer_string(&w, "action", "busy");
+        send_message(dev, &w);
         return;
     }
 
-    if (json_object_has_member(obj, "action")) {
-        const gchar *action = json_object_get_string_member(obj, "action");
-        if (!g_strcmp0(action, "ready")) {
-            // Якщо pipeline вже запущений, спочатку зупиняємо його
-            if (pipeline_started) {
-                g_print("[LOG] Stopping existing pipeline before starting new one\n");
-                stop_and_cleanup_pipeline();
-            }
-            start_pipeline();
-        } else if (!g_strcmp0(action, "control")) {
-            const gchar *direction = json_object_get_string_member_with_default(obj, "direction", nullptr);
-            const gchar *turn = json_object_get_string_member_with_default(obj, "turn", nullptr);
-            int speed = json_object_get_int_member_with_default(obj, "speed", 50);
-            control_vehicle(direction, turn, speed);
-        } else if (!g_strcmp0(action, "stop")) {
-            stop_vehicle();
-        } else if (!g_strcmp0(action, "disconnect")) {
-            // Обробляємо явне відключення клієнта
-            g_print("[LOG] Client requested disconnect\n");
-            stop_and_cleanup_pipeline();
-        }
-    } else if (json_object_has_member(obj, "type") && !g_strcmp0(json_object_get_string_member(obj, "type"), "answer")) {
-        if (answer_received) { g_object_unref(parser); return; }
-        answer_received = true;
-        const gchar *sdp_text = json_object_get_string_member(obj, "sdp");
-        GstSDPMessage *sdpmsg = nullptr;
-        if (gst_sdp_message_new_from_text(sdp_text, &sdpmsg) == GST_SDP_OK) {
-            GstWebRTCSessionDescription *desc = gst_webrtc_session_description_new(GST_WEBRTC_SDP_TYPE_ANSWER, sdpmsg);
-            g_signal_emit_by_name(webrtc, "set-remote-description", desc, nullptr);
-            gst_webrtc_session_description_free(desc);
+    // Першим водієм стає той, хто попросив, або перший глядач без ролі
+    bool driver;
+    if (!g_strcmp0(role, "observer")) {
+        driver = false;
+    } else {
+        driver = !has_driver(dev);
+        if (!driver && !g_strcmp0(role, "driver")) {
+            LOG_INFO("PIPELINE", "Peer %s asked to drive, but a driver is already connected", peer_id);
         }
-    } else if (json_object_has_member(obj, "candidate")) {
-        const gchar *cand = json_object_get_string_member(obj, "candidate");
-        guint idx = json_object_get_int_member(obj, "sdpMLineIndex");
-        g_signal_emit_by_name(webrtc, "add-ice-candidate", idx, cand);
     }
-    g_object_unref(parser);
+    LOG_INFO("PIPELINE", "Peer %s uses %s signaling", peer_id, signaling_codec_name(codec));
+    create_peer(dev, peer_id, driver, codec, recovery);
 }
 
-static void on_ws_connected(GObject *src, GAsyncResult *res, gpointer) {
-    GError *err = NULL;
-    SoupSession *local_session = SOUP_SESSION(src);
+// --- Обробники вхідних повідомлень, індексовані SignalingType ---
+typedef void (*SignalingHandler)(Device *dev, const SignalingMessage *msg, const gchar *peer_id, Peer *peer,
+                                 gint64 received_us);
 
-    ws_conn = soup_session_websocket_connect_finish(local_session, res, &err);
+static void handle_ready(Device *dev, const SignalingMessage *msg, const gchar *peer_id, Peer*, gint64) {
+    on_peer_ready(dev, peer_id, msg->role, msg->codecs, msg->session, msg->recovery);
+}
 
-    if (err) {
-        g_printerr("[CONNECTION] WebSocket connection failed: %s\n", err->message);
-        g_error_free(err);
-        ws_conn = nullptr;
-        schedule_reconnection();
+static void handle_control(Device *dev, const SignalingMessage *msg, const gchar*, Peer *peer,
+                           gint64 received_us) {
+    // Спостерігачі бачать відео, але не керують
+    if (!from_driver(dev, peer)) return;
+    metrics_inc(METRIC_COMMANDS_RECEIVED_WS);
+    MotorCommand cmd = {};
+    cmd.direction = motor_direction_from_string(msg->direction);
+    cmd.turn = motor_turn_from_string(msg->turn);
+    cmd.speed = msg->speed >= 0 ? MIN(msg->speed, 100) : 50;
+    cmd.source = MOTOR_SOURCE_WEBSOCKET;
+    cmd.received_us = received_us;
+    if (dev->ws_queue) motor_queue_push(dev->ws_queue, &cmd);
+}
+
+static void handle_stop(Device *dev, const SignalingMessage*, const gchar*, Peer*, gint64) {
+    // Зупинку приймаємо від будь-кого
+    request_stop(dev);
+}
+
+static void handle_disconnect(Device*, const SignalingMessage*, const gchar *peer_id, Peer *peer, gint64) {
+    // Обробляємо явне відключення клієнта
+    LOG_INFO("PIPELINE", "Peer %s requested disconnect", peer_id);
+    if (peer) remove_peer(peer);
+}
+
+static void handle_answer(Device*, const SignalingMessage *msg, const gchar*, Peer *peer, gint64) {
+    if (!peer || peer->answer_received || !msg->sdp) return;
+    peer->answer_received = true;
+    peer->restarting = false;
+    GstSDPMessage *sdpmsg = nullptr;
+    if (gst_sdp_message_new_from_text(msg->sdp, &sdpmsg) == GST_SDP_OK) {
+        GstWebRTCSessionDescription *desc = gst_webrtc_session_description_new(GST_WEBRTC_SDP_TYPE_ANSWER, sdpmsg);
+        g_signal_emit_by_name(peer->webrtc, "set-remote-description", desc, nullptr);
+        gst_webrtc_session_description_free(desc);
+    }
+}
+
+static void handle_candidate(Device*, const SignalingMessage *msg, const gchar*, Peer *peer, gint64) {
+    if (!peer) return;
+    guint idx = msg->sdp_mline_index > 0 ? (guint)msg->sdp_mline_index : 0;
+    g_signal_emit_by_name(peer->webrtc, "add-ice-candidate", idx, msg->candidate);
+}
+
+static void handle_lock(Device *dev, const SignalingMessage *msg, const gchar *peer_id, Peer *peer, gint64) {
+    // Зберегти запис може лише водій
+    if (!from_driver(dev, peer)) return;
+    guint seconds = msg->seconds > 0 ? (guint)MIN(msg->seconds, G_MAXUINT) : dev->cfg->dashcam.lock_seconds;
+    bool ok = dashcam_lock(dev->dashcam, seconds);
+
+    SignalingWriter w;
+    begin_peer_message(dev, &w, peer_id, peer ? peer->codec : SIGNALING_CODEC_JSON);
+    signaling_writer_string(&w, "action", ok ? "locked" : "lock-unavailable");
+    signaling_writer_int(&w, "seconds", seconds);
+    send_message(dev, &w);
+}
+
+// Межі, за якими запит configure вважається помилкою клієнта
+#define CONFIGURE_MAX_DIMENSION 4096
+#define CONFIGURE_MAX_FRAMERATE 120
+
+static void send_configure_reply(Device *dev, const gchar *peer_id, Peer *peer, const char *action,
+                                 const char *reason) {
+    const VideoSettings *v = media_ingest_video_settings(dev->ingest);
+    SignalingWriter w;
+    begin_peer_message(dev, &w, peer_id, peer ? peer->codec : SIGNALING_CODEC_JSON);
+    signaling_writer_string(&w, "action", action);
+    if (reason) signaling_writer_string(&w, "reason", reason);
+    signaling_writer_int(&w, "width", v->width);
+    signaling_writer_int(&w, "height", v->height);
+    signaling_writer_int(&w, "framerate", v->framerate);
+    signaling_writer_int(&w, "bitrate", v->bitrate);
+    send_message(dev, &w);
+}
+
+static void handle_configure(Device *dev, const SignalingMessage *msg, const gchar *peer_id, Peer *peer, gint64) {
+    // Якість потоку для всіх глядачів змінює лише водій
+    if (!from_driver(dev, peer)) return;
+
+    // Набір задає основу, окремі поля уточнюють її; решта — як зараз
+    VideoSettings v = *media_ingest_video_settings(dev->ingest);
+    if (msg->preset) {
+        const VideoPreset *p = config_find_preset(msg->preset);
+        if (!p) {
+            send_configure_reply(dev, peer_id, peer, "configure-failed", "unknown-preset");
+            return;
+        }
+        v.width = p->width;
+        v.height = p->height;
+        v.framerate = p->framerate;
+        v.bitrate = p->bitrate;
+    }
+    if (msg->width >= 0) v.width = (guint)MIN(msg->width, G_MAXUINT);
+    if (msg->height >= 0) v.height = (guint)MIN(msg->height, G_MAXUINT);
+    if (msg->framerate >= 0) v.framerate = (guint)MIN(msg->framerate, G_MAXUINT);
+    if (msg->bitrate >= 0) v.bitrate = (guint)MIN(msg->bitrate, G_MAXUINT);
+
+    // H.264 4:2:0 вимагає парних розмірів
+    if (v.width < 16 || v.width > CONFIGURE_MAX_DIMENSION || (v.width & 1) ||
+        v.height < 16 || v.height > CONFIGURE_MAX_DIMENSION || (v.height & 1) ||
+        v.framerate == 0 || v.framerate > CONFIGURE_MAX_FRAMERATE ||
+        v.bitrate < config_get()->rate.min_bitrate) {
+        send_configure_reply(dev, peer_id, peer, "configure-failed", "invalid");
         return;
     }
 
-    cancel_reconnection();
-    g_print("[CONNECTION] WebSocket connected successfully\n");
+    if (!media_ingest_configure(dev->ingest, &v)) {
+        LOG_WARN("PIPELINE", "Configure %ux%u@%u %u bps from %s rejected",
+                 v.width, v.height, v.framerate, v.bitrate, peer_id);
+        const char *reason = media_ingest_layer_count(dev->ingest) > 1 ? "layered"
+                           : media_ingest_has_encoder(dev->ingest) ? "unsupported-format" : "no-encoder";
+        send_configure_reply(dev, peer_id, peer, "configure-failed", reason);
+        return;
+    }
+    rate_control_video_changed(dev->rate);
+    LOG_INFO("PIPELINE", "Video reconfigured by %s: %ux%u@%u, %u bps",
+             peer_id, v.width, v.height, v.framerate, v.bitrate);
+    send_configure_reply(dev, peer_id, peer, "configured", nullptr);
+}
+
+// Глядач рахує затримку від камери до екрана за часом захоплення з SEI
+// і своїм годинником (синхронізованим через NTP) та повідомляє її
+static void handle_latency(Device*, const SignalingMessage *msg, const gchar*, Peer *peer, gint64) {
+    if (!peer || msg->latency_us < 0) return;
+    metrics_observe(METRIC_GLASS_TO_GLASS, msg->latency_us);
+}
+
+static const SignalingHandler signaling_handlers[SIGNALING_TYPE_COUNT] = {
+    nullptr,            // SIGNALING_UNKNOWN
+    handle_ready,
+    handle_control,
+    handle_stop,
+    handle_disconnect,
+    handle_answer,
+    handle_candidate,
+    handle_lock,
+    handle_configure,
+    handle_latency,
+};
+
+static void on_ws_message(SoupWebsocketConnection*, SoupWebsocketDataType type, GBytes *frame, gpointer user_data) {
+    Device *dev = (Device*)user_data;
+    gint64 received_us = g_get_monotonic_time();
+    gsize size;
+    const guint8 *data = (const guint8*)g_bytes_get_data(frame, &size);
+
+    // Бінарні кадри — MessagePack, текстові — JSON
+    SignalingCodec codec = type == SOUP_WEBSOCKET_DATA_BINARY ? SIGNALING_CODEC_MSGPACK : SIGNALING_CODEC_JSON;
+    SignalingMessage msg;
+    if (!signaling_decode(codec, data, size, &msg)) return;
 
-    soup_websocket_connection_set_keepalive_interval(ws_conn, 15);
-    g_signal_connect(ws_conn, "message", G_CALLBACK(on_ws_message), NULL);
-    g_signal_connect(ws_conn, "closed", G_CALLBACK(on_ws_closed), NULL);
+    if (msg.device && g_strcmp0(msg.device, dev->cfg->id) != 0) return;
 
-    JsonBuilder *b = json_builder_new();
-    json_builder_begin_object(b);
-      json_builder_set_member_name(b, "action");
-      json_builder_add_string_value(b, "ready");
-      json_builder_set_member_name(b, "device");
-      json_builder_add_string_value(b, g_device_id);
-    json_builder_end_object(b);
-    send_json(b);
-    g_object_unref(b);
+    SignalingHandler handler = signaling_handlers[msg.type];
+    if (!handler) return;
+
+    const gchar *peer_id = msg.peer ? msg.peer : DEFAULT_PEER_ID;
+    handler(dev, &msg, peer_id, lookup_peer(dev, peer_id), received_us);
 }
 
-static void attempt_connection() {
-    if (session) {
-        soup_session_abort(session);
-        g_object_unref(session);
+static void on_ws_connected(GObject *src, GAsyncResult *res, gpointer user_data) {
+    Device *dev = (Device*)user_data;
+    GError *err = NULL;
+    SoupWebsocketConnection *conn = soup_session_websocket_connect_finish(SOUP_SESSION(src), res, &err);
+
+    dev->ws_connecting = false;
+    g_clear_object(&dev->connect_cancel);
+    if (err) {
+        // Скасовано в cleanup_webrtc — перепідключатися нікуди
+        bool cancelled = g_error_matches(err, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+        LOG_ERROR("CONNECTION", "%s: WebSocket connection failed: %s", dev->cfg->id, err->message);
+        g_error_free(err);
+        if (!cancelled) schedule_reconnection(dev);
+        device_unref(dev);
+        return;
+    }
+    if (dev->closed) {
+        soup_websocket_connection_close(conn, SOUP_WEBSOCKET_CLOSE_NORMAL, NULL);
+        g_object_unref(conn);
+        device_unref(dev);
+        return;
     }
-    gchar *addr = g_strdup_printf("ws://%s:%s/ws", g_sig_ip, g_sig_port);
-    g_print("[CONNECTION] Attempting to connect to %s\n", addr);
 
-    session = soup_session_new();
+    dev->ws_conn = conn;
+    cancel_reconnection(dev);
+    dev->reconnect_attempt = 0;
+    LOG_INFO("CONNECTION", "%s: WebSocket connected successfully", dev->cfg->id);
+
+    soup_websocket_connection_set_keepalive_interval(conn, 15);
+    g_signal_connect(conn, "message", G_CALLBACK(on_ws_message), dev);
+    g_signal_connect(conn, "closed", G_CALLBACK(on_ws_closed), dev);
+
+    // Оголошення завжди в JSON: кодування обирає кожен глядач у своєму ready
+    static const char *const codecs[] = { "msgpack", "json" };
+    SignalingWriter w;
+    begin_message(dev, &w, SIGNALING_CODEC_JSON);
+    signaling_writer_string(&w, "action", "ready");
+    signaling_writer_string(&w, "device", dev->cfg->id);
+    signaling_writer_int(&w, "maxPeers", config_get()->webrtc.max_peers);
+    signaling_writer_string_array(&w, "codecs", codecs, G_N_ELEMENTS(codecs));
+    // Маркер і живі глядачі: сервер може з'єднати їх знову без переузгодження
+    signaling_writer_string(&w, "session", dev->session_token);
+    guint n_peers = 0;
+    const gchar **live = (const gchar**)g_hash_table_get_keys_as_array(dev->peers, &n_peers);
+    signaling_writer_string_array(&w, "peers", live, n_peers);
+    g_free(live);
+    send_message(dev, &w);
+    device_unref(dev);
+}
+
+static void attempt_connection(Device *dev) {
+    if (dev->closed || dev->ws_connecting || dev->ws_conn) return;
+    gchar *addr = g_strdup_printf("ws://%s:%s/ws", dev->cfg->server, dev->cfg->port);
+    LOG_INFO("CONNECTION", "%s: attempting to connect to %s", dev->cfg->id, addr);
+
     SoupMessage *msg = soup_message_new(SOUP_METHOD_GET, addr);
     g_free(addr);
 
-    soup_session_websocket_connect_async(session, msg, NULL, NULL, G_PRIORITY_DEFAULT, NULL, on_ws_connected, session);
+    dev->ws_connecting = true;
+    dev->connect_cancel = g_cancellable_new();
+    soup_session_websocket_connect_async(session, msg, NULL, NULL, G_PRIORITY_DEFAULT, dev->connect_cancel,
+                                         on_ws_connected, device_ref(dev));
+    g_object_unref(msg);
 }
 
-void start_webrtc(const char *sig_ip, const char *sig_port, const char *device_id, GMainLoop *loop) {
-    g_sig_ip = g_strdup(sig_ip);
-    g_sig_port = g_strdup(sig_port);
-    g_device_id = g_strdup(device_id);
-    gloop = loop;
-    attempt_connection();
-}
+Device *start_webrtc(const DeviceConfig *cfg, Vehicle *vehicle) {
+    // Без черги команди WebSocket мовчки губилися б: машина не відповідала б
+    MotorQueue *ws_queue = vehicle ? motor_queue_new(vehicle, "websocket") : nullptr;
+    if (vehicle && !ws_queue) {
+        LOG_ERROR("PIPELINE", "Device %s: no command queue for WebSocket control", cfg->id);
+        return nullptr;
+    }
 
-// Головна функція очищення
-void cleanup_webrtc() {
-    cancel_reconnection();
-    stop_connection_monitoring();
-    stop_and_cleanup_pipeline();
+    Device *dev = g_rc_box_new0(Device);
+    dev->cfg = cfg;
+    dev->vehicle = vehicle;
+    dev->session_token = g_uuid_string_random();
+    dev->out_buf = g_string_sized_new(256);
+    dev->peers = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)peer_unref);
+    dev->ingest = media_ingest_new(&cfg->media);
+    dev->rate = rate_control_new(dev->ingest);
+    dev->telemetry = telemetry_new(vehicle, dev->rate, dev->ingest);
+    dev->recovery = loss_recovery_new(dev->rate);
+    dev->dashcam = dashcam_new(&cfg->dashcam, dev->ingest);
+    dev->ws_queue = ws_queue;
+
+    // Сесія одна на весь час роботи: повторні спроби не перестворюють її стан
+    if (session_users++ == 0) session = soup_session_new();
+
+    LOG_INFO("PIPELINE", "Device %s: signaling %s:%s, %s", cfg->id, cfg->server, cfg->port,
+             vehicle ? vehicle_name(vehicle) : "no motors");
+    // У режимі hot standby ingest запускається одразу і не зупиняється між сесіями
+    if (cfg->media.hot_standby) {
+        ensure_ingest(dev);
+    }
+    attempt_connection(dev);
+    return dev;
+}
 
-    if (ws_conn) {
-        if (soup_websocket_connection_get_state(ws_conn) == SOUP_WEBSOCKET_STATE_OPEN) {
-             soup_websocket_connection_close(ws_conn, SOUP_WEBSOCKET_CLOSE_NORMAL, NULL);
+// Головна функція очищення; зупинку гілок і ingest дочікується lifecycle_stop
+void cleanup_webrtc(Device *dev) {
+    if (!dev) return;
+    dev->closed = true;
+    cancel_reconnection(dev);
+    stop_connection_monitoring(dev);
+    stop_and_cleanup_pipeline(dev);
+    if (dev->ingest_restart_timer_id > 0) {
+        g_source_remove(dev->ingest_restart_timer_id);
+        dev->ingest_restart_timer_id = 0;
+    }
+    release_ingest(dev);
+    dashcam_free(dev->dashcam);
+    loss_recovery_free(dev->recovery);
+    telemetry_free(dev->telemetry);
+    rate_control_free(dev->rate);
+    g_clear_pointer(&dev->peers, g_hash_table_unref);
+    if (dev->ws_queue) motor_queue_release(dev->ws_queue);
+    dev->ws_queue = nullptr;
+
+    if (dev->connect_cancel) g_cancellable_cancel(dev->connect_cancel);
+    if (dev->ws_conn) {
+        SoupWebsocketConnection *conn = (SoupWebsocketConnection*)g_object_ref(dev->ws_conn);
+        drop_ws_conn(dev);
+        if (soup_websocket_connection_get_state(conn) == SOUP_WEBSOCKET_STATE_OPEN) {
+             soup_websocket_connection_close(conn, SOUP_WEBSOCKET_CLOSE_NORMAL, NULL);
         }
-        g_object_unref(ws_conn);
-        ws_conn = nullptr;
+        g_object_unref(conn);
     }
-    if (session) {
+    if (--session_users == 0) {
         soup_session_abort(session);
-        g_object_unref(session);
-        session = nullptr;
+        g_clear_object(&session);
     }
-
-    g_free(g_device_id); g_device_id = nullptr;
-    g_free(g_sig_ip); g_sig_ip = nullptr;
-    g_free(g_sig_port); g_sig_port = nullptr;
+    device_unref(dev);
 }
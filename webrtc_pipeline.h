@@ -3,8 +3,17 @@
 
 #include <glib.h>
 
-void start_webrtc(const char *sig_ip, const char *sig_port,
-                  const char *device_id, GMainLoop *loop);
-void cleanup_webrtc();
+struct Device;
+struct DeviceConfig;
+struct Vehicle;
+
+// Сесія одного пристрою ([device:ID]): з'єднання з сигналізацією, ingest
+// і глядачі. Пристрої ділять головний цикл і робочі потоки; lifecycle і
+// потік керування запускає викликач. vehicle == nullptr — лише камера.
+// Конфігурація і машина живуть довше за пристрій. nullptr — машині
+// не вистачило черги команд.
+Device *start_webrtc(const DeviceConfig *cfg, Vehicle *vehicle);
+// Прибирає пристрій; зупинку його гілок і ingest дочікується lifecycle_stop
+void cleanup_webrtc(Device *dev);
 
 #endif // WEBRTC_PIPELINE_H